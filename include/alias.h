@@ -1,13 +1,23 @@
 #ifndef _ALIAS_H
 #define _ALIAS_H
 
-struct alias_table;
+struct command_table;
 
-struct alias_table *alias_table_new(void);
-void alias_table_free(struct alias_table *table);
-void alias_set(struct alias_table *table, const char *name,
+/*
+ * Aliases are kept in the command table alongside functions and
+ * builtins, see commands.h.
+ */
+void alias_set(struct command_table *table, const char *name,
 	       const char *replacement);
-void alias_unset(struct alias_table *table, const char *name);
-const char *alias_get(struct alias_table *table, const char *name);
+void alias_unset(struct command_table *table, const char *name);
+const char *alias_get(struct command_table *table, const char *name);
+
+/**
+ * alias_foreach() - Call func with each alias, in no particular order.
+ */
+void alias_foreach(struct command_table *table,
+		   void (*func)(const char *name, const char *replacement,
+				void *data),
+		   void *data);
 
 #endif /* _ALIAS_H */
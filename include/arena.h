@@ -9,9 +9,26 @@ struct arena {
 	struct arena_header *pages;
 };
 
+/* A point in an arena to rewind to, see arena_rewind() */
+struct arena_mark {
+	struct arena_header *page;
+	void *ptr;
+};
+
 void *arena_malloc(struct arena *arena, size_t member_size, size_t count);
 void *arena_calloc(struct arena *arena, size_t member_size, size_t count);
 char *arena_strdup(struct arena *arena, const char *str);
 void arena_free(struct arena *arena);
 
+void arena_mark(struct arena *arena, struct arena_mark *mark);
+
+/**
+ * arena_rewind() - Free everything allocated since a mark was taken.
+ *
+ * Rewinding to a mark taken of an empty arena keeps its first page, so
+ * a loop which allocates a little and rewinds each time does not go
+ * back to malloc().
+ */
+void arena_rewind(struct arena *arena, const struct arena_mark *mark);
+
 #endif /* _ARENA_H_ */
@@ -0,0 +1,50 @@
+#ifndef _ARITH_H
+#define _ARITH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A compiled arithmetic expression, as found in $(( ... )). The
+ * expression is constant-folded and compiled to a stack bytecode
+ * once, when it is parsed, and kept in the AST so that re-running a
+ * statement does not reparse it.
+ *
+ * The program is a single allocation containing no pointers, so it
+ * is freed with free() and may be copied byte for byte.
+ */
+struct arith_program;
+
+/**
+ * arith_compile() - Compile the text of an arithmetic expression.
+ *
+ * @text: The expression, which need not be NUL-terminated.
+ * @len: The length of the expression.
+ *
+ * Raises ERROR_SYNTAX if the expression is malformed.
+ *
+ * Return: The program, to be freed with free().
+ */
+struct arith_program *arith_compile(const char *text, size_t len);
+
+/**
+ * arith_eval() - Run a compiled expression. Variables, and parameters
+ * such as $1 and $?, are looked up by name with lookup(data, ...),
+ * which returns NULL if one is unset; unset or empty variables are zero.
+ *
+ * Raises ERROR_INVALID_ARGUMENT for division by zero or a variable
+ * which is not a number.
+ */
+int64_t arith_eval(const struct arith_program *program,
+		   const char *(*lookup)(void *data, const char *name,
+					 size_t len),
+		   void *data);
+
+/* The total size of a program in bytes */
+size_t arith_program_size(const struct arith_program *program);
+
+/* The expression text a program was compiled from (not NUL-terminated) */
+const char *arith_program_source(const struct arith_program *program,
+				 size_t *len);
+
+#endif /* _ARITH_H */
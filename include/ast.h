@@ -1,13 +1,13 @@
 #ifndef _AST_H
 #define _AST_H
 
-#include <graphviz/cgraph.h>
 #include <stdbool.h>
 #include <stddef.h>
 
 #include "common.h"
 
 struct arena;
+struct arith_program;
 
 enum ast_glob_type {
 	GLOB_STAR,
@@ -15,21 +15,42 @@ enum ast_glob_type {
 	GLOB_CHARSET,
 };
 
+enum ast_loop_kind {
+	LOOP_FOR,
+	LOOP_WHILE,
+	LOOP_UNTIL,
+};
+
+/* How an and-or list continues after a pipeline */
+enum ast_connective {
+	CONNECTIVE_AND,
+	CONNECTIVE_OR,
+};
+
 #define __m_ast_string(V, P, A, S) P(char *, data) S() V(size_t, size)
 
 #define __m_ast_glob(V, P, A, S) \
 	V(enum ast_glob_type, type) S() A(ast_string, charset)
 
-#define __m_ast_argument_part(V, P, A, S) \
-	A(ast_string, string)             \
-	S()                               \
-	A(ast_string, parameter)          \
-	S() A(ast_glob, glob) S() A(ast_statement_list, substitution)
+#define __m_ast_arith(V, P, A, S) P(struct arith_program *, program)
+
+#define __m_ast_argument_part(V, P, A, S)   \
+	A(ast_string, string)               \
+	S()                                 \
+	A(ast_string, parameter)            \
+	S()                                 \
+	A(ast_glob, glob)                   \
+	S()                                 \
+	A(ast_statement_list, substitution) \
+	S()                                 \
+	A(ast_arith, arith)                 \
+	S() V(bool, quoted)
 
 #define __m_ast_argument_part_list(V, P, A, S) \
 	A(ast_argument_part, first) S() A(ast_argument_part_list, rest)
 
-#define __m_ast_argument(V, P, A, S) A(ast_argument_part_list, parts)
+#define __m_ast_argument(V, P, A, S) \
+	A(ast_argument_part_list, parts) S() V(bool, literal)
 
 #define __m_ast_argument_list(V, P, A, S) \
 	A(ast_argument, first) S() A(ast_argument_list, rest)
@@ -40,19 +61,54 @@ enum ast_glob_type {
 #define __m_ast_assignment_list(V, P, A, S) \
 	A(ast_assignment, first) S() A(ast_assignment_list, rest)
 
+/* for variable in words; do body; done, or while/until condition */
+#define __m_ast_loop(V, P, A, S)            \
+	V(enum ast_loop_kind, kind)         \
+	S()                                 \
+	A(ast_string, variable)             \
+	S()                                 \
+	A(ast_argument_list, words)         \
+	S()                                 \
+	A(ast_statement_list, condition)    \
+	S() A(ast_statement_list, body)
+
+/* name() { body } */
+#define __m_ast_function(V, P, A, S) \
+	A(ast_string, name) S() A(ast_statement_list, body)
+
+/*
+ * A simple command, or a loop when loop is set, or the definition of a
+ * function when function is set
+ */
 #define __m_ast_command(V, P, A, S)         \
 	A(ast_assignment_list, assignments) \
 	S()                                 \
 	A(ast_argument_list, arglist)       \
 	S()                                 \
 	A(ast_argument, input_file)         \
-	S() A(ast_argument, output_file) S() A(ast_argument, append_file)
+	S()                                 \
+	A(ast_argument, output_file)        \
+	S()                                 \
+	A(ast_argument, append_file)        \
+	S()                                 \
+	P(char **, argv)                    \
+	S()                                 \
+	A(ast_loop, loop)                   \
+	S() A(ast_function, function)
 
 #define __m_ast_pipeline(V, P, A, S) \
 	A(ast_command, first) S() A(ast_pipeline, rest)
 
+#define __m_ast_and_or(V, P, A, S)         \
+	A(ast_pipeline, pipeline)          \
+	S()                                \
+	V(bool, timed)                     \
+	S()                                \
+	V(enum ast_connective, connective) \
+	S() A(ast_and_or, rest)
+
 #define __m_ast_statement(V, P, A, S) \
-	A(ast_pipeline, pipeline) S() V(bool, background)
+	A(ast_and_or, and_or) S() V(bool, background)
 
 #define __m_ast_statement_list(V, P, A, S) \
 	A(ast_statement, first)            \
@@ -63,6 +119,8 @@ enum ast_glob_type {
 	S()                       \
 	M(ast_glob)               \
 	S()                       \
+	M(ast_arith)              \
+	S()                       \
 	M(ast_argument_part)      \
 	S()                       \
 	M(ast_argument_part_list) \
@@ -75,8 +133,14 @@ enum ast_glob_type {
 	S()                       \
 	M(ast_assignment_list)    \
 	S()                       \
+	M(ast_loop)               \
+	S()                       \
+	M(ast_function)           \
+	S()                       \
 	M(ast_command)            \
-	S() M(ast_pipeline) S() M(ast_statement) S() M(ast_statement_list)
+	S()                       \
+	M(ast_pipeline)           \
+	S() M(ast_and_or) S() M(ast_statement) S() M(ast_statement_list)
 
 /* Forward-declare everything to allow for circular definitions */
 #define AST_FORWARD_DECL(NAME) struct NAME
@@ -91,6 +155,8 @@ AST_PPLIST(AST_FORWARD_DECL, SEMICOLON);
 			   AST_DEFSTRUCT_AST_TYPE, SEMICOLON);               \
 		struct {                                                     \
 			bool marked_for_deletion;                            \
+			/* The pointer fields belong to someone else */      \
+			bool borrowed;                                       \
 		} priv;                                                      \
 	}
 AST_PPLIST(AST_DEFSTRUCT, SEMICOLON);
@@ -108,9 +174,11 @@ AST_PPLIST(AST_DEFNEW, SEMICOLON);
 #define AST_DEFFREE(NAME) void NAME##_free(struct NAME *ptr)
 AST_PPLIST(AST_DEFFREE, SEMICOLON);
 
-#define AST_DEFGRAPH(NAME)                                           \
-	Agnode_t *NAME##_graph(struct NAME *astobj, Agraph_t *graph, \
-			       struct arena *arena)
-AST_PPLIST(AST_DEFGRAPH, SEMICOLON);
+/*
+ * Create function prototypes for copy functions, which make a tree
+ * owning all of its memory, even of one which borrows its strings
+ */
+#define AST_DEFCOPY(NAME) struct NAME *NAME##_copy(const struct NAME *ptr)
+AST_PPLIST(AST_DEFCOPY, SEMICOLON);
 
 #endif /* _AST_H */
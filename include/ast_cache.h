@@ -0,0 +1,60 @@
+#ifndef _AST_CACHE_H
+#define _AST_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/stat.h>
+
+#include "ast.h"
+
+/*
+ * An on-disk cache of parsed scripts, so that running a large script
+ * again goes straight to executing it.
+ *
+ * A cache file holds the tree exactly as it is laid out in memory,
+ * written by functions generated from AST_PPLIST, with every pointer
+ * stored as if the file were mapped at AST_CACHE_BASE. Loading it is a
+ * single mmap() at that address; if the address is taken, the file is
+ * mapped elsewhere and the pointers listed in its relocation table are
+ * moved by the difference.
+ *
+ * Files are named by the device and inode of the script, and hold its
+ * mtime and size, so an edited script is parsed (and cached) again.
+ */
+
+/* Where cached trees prefer to be mapped */
+#define AST_CACHE_BASE 0x5a5000000000UL
+
+struct ast_cache_mapping {
+	struct ast_statement_list *list;
+	void *addr;
+	size_t size;
+	/* Whether the tree had to be moved from AST_CACHE_BASE */
+	bool relocated;
+};
+
+/**
+ * ast_cache_load() - Map the cached tree for a script, if the cache
+ * holds one for the script as it is now.
+ *
+ * @dir: The cache directory.
+ * @script: The status of the script.
+ *
+ * The tree lives in the mapping: it must not be freed with
+ * ast_statement_list_free(), only unmapped with ast_cache_unmap().
+ *
+ * Return: Whether the tree was loaded.
+ */
+bool ast_cache_load(const char *dir, const struct stat *script,
+		    struct ast_cache_mapping *mapping);
+
+void ast_cache_unmap(struct ast_cache_mapping *mapping);
+
+/**
+ * ast_cache_store() - Write the tree parsed from a script to the cache,
+ * replacing what was cached for it before. Errors are raised.
+ */
+void ast_cache_store(const char *dir, const struct stat *script,
+		     struct ast_statement_list *list);
+
+#endif /* _AST_CACHE_H */
@@ -0,0 +1,21 @@
+#ifndef _AST_GRAPH_H
+#define _AST_GRAPH_H
+
+#include <graphviz/cgraph.h>
+
+#include "ast.h"
+
+/*
+ * Rendering of the AST as a graphviz graph, for parseview. This is
+ * kept apart from the rest of the AST so that only the binaries which
+ * draw graphs need to link (and load) graphviz.
+ */
+
+struct arena;
+
+#define AST_DEFGRAPH(NAME)                                           \
+	Agnode_t *NAME##_graph(struct NAME *astobj, Agraph_t *graph, \
+			       struct arena *arena)
+AST_PPLIST(AST_DEFGRAPH, SEMICOLON);
+
+#endif /* _AST_GRAPH_H */
@@ -0,0 +1,76 @@
+#ifndef _CAPTURE_H
+#define _CAPTURE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct arena;
+struct ast_statement_list;
+struct interpreter_state;
+
+/* The pipe capacity requested for captures, see F_SETPIPE_SZ */
+#define CAPTURE_PIPE_SIZE (1 << 20)
+
+/* Chunks start at this size and double up to the maximum */
+#define CAPTURE_INITIAL_CHUNK (1 << 16)
+#define CAPTURE_MAX_CHUNK (1 << 24)
+
+/*
+ * Output captured from a file descriptor, stored as a series of
+ * arena-allocated chunks exactly as they were read. Each chunk has
+ * one spare byte past len, so a word at the end of a chunk can be
+ * NUL-terminated in place.
+ */
+struct capture_chunk {
+	char *data;
+	size_t len;
+};
+
+struct capture {
+	struct capture_chunk *chunks;
+	size_t count;
+	size_t capacity;
+	size_t total;
+	struct arena *arena;
+};
+
+/**
+ * capture_pipe() - Create a close-on-exec pipe for capturing output,
+ * raising its capacity to CAPTURE_PIPE_SIZE where permitted so that
+ * the writer blocks less often.
+ */
+void capture_pipe(int pipefd[2]);
+
+/**
+ * capture_read() - Read from fd until end of file, directly into the
+ * chunks of the capture.
+ */
+void capture_read(struct capture *cap, int fd);
+
+/**
+ * capture_read_available() - Read what is available from a
+ * non-blocking fd, without waiting, into a chunk of exactly the size
+ * needed.
+ *
+ * Return: false once end of file is reached.
+ */
+bool capture_read_available(struct capture *cap, int fd);
+
+/**
+ * capture_trim_newlines() - Remove trailing newlines, as required for
+ * command substitution.
+ */
+void capture_trim_newlines(struct capture *cap);
+
+/**
+ * capture_statement_list() - Run a statement list in a subshell and
+ * capture its standard output. The exit status is recorded as the
+ * interpreter's last status.
+ *
+ * Return: The capture, allocated in arena.
+ */
+struct capture *capture_statement_list(struct interpreter_state *interp,
+				       struct ast_statement_list *list,
+				       struct arena *arena);
+
+#endif /* _CAPTURE_H */
@@ -0,0 +1,67 @@
+#ifndef _COMMANDS_H
+#define _COMMANDS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct builtin_command;
+struct shell_function;
+
+/*
+ * What a command name stands for. Aliases, functions and builtins are
+ * all kept in the one table, so running a command takes a single lookup
+ * to find which of them it is: an alias is expanded first, a function
+ * is run before a builtin of the same name, and a name which is none of
+ * them is an external command.
+ */
+struct command {
+	char *name;
+	uint32_t hash;
+	/* The replacement, if the name is an alias */
+	char *alias;
+	/* See functions.h */
+	struct shell_function *function;
+	struct builtin_command *builtin;
+	struct command *next;
+};
+
+struct command_table;
+
+/**
+ * command_table_new() - Create a table holding every builtin.
+ */
+struct command_table *command_table_new(void);
+void command_table_free(struct command_table *table);
+
+/**
+ * command_lookup() - Find what a name stands for.
+ *
+ * Return: The entry for the name, or NULL if it is none of an alias, a
+ *         function and a builtin.
+ */
+struct command *command_lookup(struct command_table *table,
+			       const char *name);
+struct command *command_sized_lookup(struct command_table *table,
+				     const char *name, size_t name_len);
+
+/**
+ * command_add() - Find the entry for a name, adding an empty one if
+ * there is none, for an alias or function to be set in.
+ */
+struct command *command_add(struct command_table *table, const char *name);
+
+/**
+ * command_prune() - Remove an entry once its alias or function has been
+ * removed, if that leaves it standing for nothing.
+ */
+void command_prune(struct command_table *table, struct command *command);
+
+/**
+ * command_table_foreach() - Call func with each entry, in no particular
+ * order.
+ */
+void command_table_foreach(struct command_table *table,
+			   void (*func)(struct command *command, void *data),
+			   void *data);
+
+#endif /* _COMMANDS_H */
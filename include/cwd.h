@@ -0,0 +1,76 @@
+#ifndef _CWD_H
+#define _CWD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * The working directory of the shell, kept as an O_PATH descriptor
+ * along with its logical path (the value of $PWD, which follows the
+ * symbolic links the user went through rather than resolving them).
+ *
+ * cd works out the new logical path itself, so $PWD never needs a
+ * getcwd(). Relative targets are opened from the descriptor of the
+ * current directory, and the shell changes to a directory with
+ * fchdir(). The directories on the pushd stack keep their descriptors
+ * open, so popd does not look up their paths again.
+ */
+struct cwd;
+
+/**
+ * cwd_new() - Start tracking the working directory. $PWD is used as
+ * its logical path if it names the working directory; otherwise the
+ * path comes from getcwd().
+ */
+struct cwd *cwd_new(void);
+
+void cwd_free(struct cwd *cwd);
+
+/* The logical path of the working directory */
+const char *cwd_path(const struct cwd *cwd);
+
+/* A descriptor for the working directory, to use with openat() */
+int cwd_fd(const struct cwd *cwd);
+
+/**
+ * cwd_change() - Change to a directory, as for cd.
+ *
+ * Return: false, with errno set, if the directory could not be
+ *         opened or changed to.
+ */
+bool cwd_change(struct cwd *cwd, const char *target);
+
+/**
+ * cwd_push() - Change to a directory, saving the current one on the
+ * directory stack, as for pushd.
+ *
+ * Return: false, with errno set, if the directory could not be changed
+ *         to; the stack is then unchanged.
+ */
+bool cwd_push(struct cwd *cwd, const char *target);
+
+/**
+ * cwd_pop() - Change back to the directory on top of the stack, as for
+ * popd, or with swap, exchange the two, as for pushd with no
+ * arguments.
+ *
+ * Return: false, with errno set, if the stack is empty or the
+ *         directory could not be changed to.
+ */
+bool cwd_pop(struct cwd *cwd, bool swap);
+
+/* The number of directories on the stack, not counting the current one */
+size_t cwd_stack_count(const struct cwd *cwd);
+
+/* The path of a directory on the stack, 0 being the top */
+const char *cwd_stack_path(const struct cwd *cwd, size_t index);
+
+/**
+ * cwd_logical_path() - Resolve a path against a logical directory,
+ * removing "." and ".." components textually.
+ *
+ * Return: The absolute path, which the caller must free.
+ */
+char *cwd_logical_path(const char *base, const char *target);
+
+#endif /* _CWD_H */
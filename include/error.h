@@ -78,9 +78,11 @@ void *checked_malloc(size_t member_size, size_t count);
 void *checked_calloc(size_t member_size, size_t count);
 void *checked_realloc(void *ptr, size_t member_size, size_t count);
 char *checked_strdup(const char *str);
+char *checked_strndup(const char *str, size_t len);
 void checked_pipe(int pipefd[2]);
 int checked_dup2(int filedes, int filedes2);
 int checked_open(const char *pathname, int flags, mode_t mode);
+int checked_openat(int dirfd, const char *pathname, int flags, mode_t mode);
 void checked_close(int fd);
 size_t checked_read(int fd, void *buf, size_t count);
 bool checked_read_all(int fd, void *buf, size_t count);
@@ -0,0 +1,61 @@
+#ifndef _EXPAND_H
+#define _EXPAND_H
+
+struct arena;
+struct ast_argument;
+struct ast_argument_list;
+struct ast_command;
+struct interpreter_state;
+
+/* Characters which separate fields produced by unquoted expansions */
+#define EXPAND_IFS " \t\n"
+
+/**
+ * expand_arguments() - Expand an argument list into an argv.
+ *
+ * Unquoted parameter expansions and command substitutions are split
+ * into fields, and arguments containing unquoted globs undergo
+ * pathname expansion. Substitution output is split in place in the
+ * capture buffer, so a word standing on its own is not copied.
+ *
+ * Return: A NULL-terminated array of words, allocated in arena.
+ */
+char **expand_arguments(struct interpreter_state *interp,
+			struct ast_argument_list *args, struct arena *arena);
+
+/**
+ * expand_argument() - Expand a single argument as expand_arguments()
+ * would, into however many fields it makes.
+ *
+ * Return: A NULL-terminated array of words, allocated in arena.
+ */
+char **expand_argument(struct interpreter_state *interp,
+		       struct ast_argument *arg, struct arena *arena);
+
+/**
+ * expand_command() - Get the argv of a command: its precomputed argv if
+ * every argument is literal, or else its expanded arguments.
+ */
+char **expand_command(struct interpreter_state *interp,
+		      struct ast_command *cmd, struct arena *arena);
+
+/**
+ * expand_word() - Expand an argument to exactly one string, without
+ * field splitting or pathname expansion, as for the value of an
+ * assignment or the target of a redirection.
+ *
+ * Return: The string, allocated in arena.
+ */
+char *expand_word(struct interpreter_state *interp, struct ast_argument *arg,
+		  struct arena *arena);
+
+/**
+ * expand_alias() - Replace the command name of an expanded argv by
+ * the words of its alias.
+ *
+ * Return: The new argv, allocated in arena.
+ */
+char **expand_alias(char **argv, const char *replacement,
+		    struct arena *arena);
+
+#endif /* _EXPAND_H */
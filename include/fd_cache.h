@@ -0,0 +1,46 @@
+#ifndef _FD_CACHE_H
+#define _FD_CACHE_H
+
+#include <stddef.h>
+
+/*
+ * A cache of descriptors for redirections which append to a file, for
+ * scripts which write to the same log from thousands of commands. It
+ * is opt-in, with SHELL_FDCACHE=1.
+ *
+ * Entries are keyed by the logical path and the open flags, and are
+ * reused only while the path still leads to the same file: every hit
+ * is checked with one fstatat() against the device and inode the file
+ * was opened with, so a log which has been renamed or removed is opened
+ * again. The descriptors are close-on-exec; commands get their own
+ * copy through dup2(), so appends stay appends.
+ */
+
+/* The most files kept open at once; the oldest is closed beyond it */
+#define FD_CACHE_MAX 32
+
+struct fd_cache;
+
+struct fd_cache *fd_cache_new(void);
+
+/* Close every cached descriptor and free the cache */
+void fd_cache_free(struct fd_cache *cache);
+
+/**
+ * fd_cache_open() - Get a descriptor for a file, opening it only if it
+ * is not already cached.
+ *
+ * @dirfd: The directory path is relative to.
+ * @key: The absolute logical path of the file.
+ * @flags: The flags to open it with, which are part of the key.
+ *
+ * Return: The descriptor, which belongs to the cache and must not be
+ *         closed. Errors opening the file are raised.
+ */
+int fd_cache_open(struct fd_cache *cache, int dirfd, const char *key,
+		  const char *path, int flags);
+
+/* The number of descriptors in the cache */
+size_t fd_cache_count(const struct fd_cache *cache);
+
+#endif /* _FD_CACHE_H */
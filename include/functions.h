@@ -0,0 +1,36 @@
+#ifndef _FUNCTIONS_H
+#define _FUNCTIONS_H
+
+struct ast_function;
+struct ast_statement_list;
+struct command_table;
+struct vm_program;
+
+/*
+ * A function defined with name() { body }. The body is copied out of
+ * the tree it was parsed in, which may be freed (or unmapped, see
+ * ast_cache.h) long before the function is called, and compiled once
+ * when it is defined rather than at every call.
+ */
+struct shell_function {
+	struct ast_statement_list *body;
+	struct vm_program *program;
+	/*
+	 * The table holds one reference, and each call in progress
+	 * another, so a function which redefines itself finishes running
+	 * the body it started with.
+	 */
+	unsigned refs;
+};
+
+/**
+ * function_define() - Define a function, replacing any function of the
+ * same name.
+ */
+void function_define(struct command_table *table,
+		     const struct ast_function *definition);
+
+struct shell_function *function_ref(struct shell_function *function);
+void function_unref(struct shell_function *function);
+
+#endif /* _FUNCTIONS_H */
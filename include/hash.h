@@ -0,0 +1,17 @@
+#ifndef _HASH_H
+#define _HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * hash_bytes() - Hash a buffer using 32-bit FNV-1a.
+ *
+ * @buf: The buffer to hash.
+ * @len: The number of bytes in the buffer.
+ *
+ * Return: The hash value.
+ */
+uint32_t hash_bytes(const void *buf, size_t len);
+
+#endif /* _HASH_H */
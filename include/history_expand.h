@@ -0,0 +1,31 @@
+#ifndef _HISTORY_EXPAND_H
+#define _HISTORY_EXPAND_H
+
+struct arena;
+struct history_log;
+
+enum history_expansion {
+	HISTORY_EXPANSION_NONE,
+	HISTORY_EXPANSION_EXPANDED,
+	HISTORY_EXPANSION_PRINT_ONLY,
+};
+
+/**
+ * history_expand() - Perform history expansion (!!, !n, !-n,
+ * !prefix, !?search?, !# and their modifiers) on a line.
+ *
+ * @log: The history to expand from.
+ * @line: The line typed by the user.
+ * @arena: Where to allocate the result.
+ * @result: Set to the expanded line if an expansion occurred.
+ *
+ * Return: HISTORY_EXPANSION_NONE if the line had nothing to expand,
+ *         HISTORY_EXPANSION_EXPANDED if it did, or
+ *         HISTORY_EXPANSION_PRINT_ONLY if the :p modifier was
+ *         used. Errors in expansion are raised.
+ */
+enum history_expansion history_expand(struct history_log *log,
+				      const char *line, struct arena *arena,
+				      char **result);
+
+#endif /* _HISTORY_EXPAND_H */
@@ -0,0 +1,68 @@
+#ifndef _HISTORY_INDEX_H
+#define _HISTORY_INDEX_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * Indexes over the history log. These are maintained incrementally
+ * by the log as lines are appended, and are built on first use so
+ * they do not add to startup time.
+ */
+
+/*
+ * The trigram index maps every three-byte substring of a history
+ * line to the (increasing) list of line numbers containing it.
+ */
+struct trigram_index;
+
+struct trigram_index *trigram_index_new(void);
+void trigram_index_free(struct trigram_index *index);
+void trigram_index_add(struct trigram_index *index, size_t id,
+		       const char *line);
+
+/**
+ * trigram_index_candidates() - Get the smallest posting list which
+ * any line containing needle must appear in.
+ *
+ * @index: The trigram index.
+ * @needle: The substring to search for. Must be at least 3 bytes.
+ * @ids: Set to the posting list (valid until the next add).
+ * @count: Set to the number of entries in the posting list.
+ */
+void trigram_index_candidates(struct trigram_index *index, const char *needle,
+			      const unsigned **ids, size_t *count);
+
+/*
+ * The prefix index is a radix tree over the first word of each
+ * history line. Each node records the most recent line in its
+ * subtree, so the most recent line starting with a prefix is found
+ * in time proportional to the length of the prefix.
+ */
+struct prefix_index;
+
+struct prefix_index *prefix_index_new(void);
+void prefix_index_free(struct prefix_index *index);
+void prefix_index_add(struct prefix_index *index, size_t id,
+		      const char *line);
+
+/**
+ * prefix_index_latest() - Find the most recent line whose first word
+ * starts with prefix.
+ *
+ * Return: The id of the line, or -1 if there is none.
+ */
+ssize_t prefix_index_latest(struct prefix_index *index, const char *prefix,
+			    size_t prefix_len);
+
+/**
+ * prefix_index_complete() - Call func with each distinct first word
+ * which starts with prefix. The word passed is not NUL-terminated.
+ */
+void prefix_index_complete(struct prefix_index *index, const char *prefix,
+			   size_t prefix_len,
+			   void (*func)(const char *word, size_t len,
+					void *data),
+			   void *data);
+
+#endif /* _HISTORY_INDEX_H */
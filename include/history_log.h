@@ -0,0 +1,105 @@
+#ifndef _HISTORY_LOG_H
+#define _HISTORY_LOG_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * The history log is an append-only file of NUL-terminated lines,
+ * paired with an index file of 64-bit offsets (one per line). Both
+ * are mapped into memory on open, so opening a history of any size
+ * costs a constant number of system calls, and every entry can be
+ * accessed in O(1) directly from the mapping.
+ */
+struct history_log;
+
+/* Number of appends between calls to fdatasync */
+#define HISTORY_LOG_SYNC_BATCH 16
+
+/**
+ * history_log_open() - Open (or create) a history log.
+ *
+ * @path: The path to the log. The index is stored next to it, with
+ *        ".idx" appended to the name.
+ *
+ * Return: The history log. Errors opening the files are raised.
+ */
+struct history_log *history_log_open(const char *path);
+
+/**
+ * history_log_new_memory() - Create a history log which is not backed
+ * by any file.
+ */
+struct history_log *history_log_new_memory(void);
+
+/**
+ * history_log_close() - Flush any pending appends to disk and free
+ * the log.
+ */
+void history_log_close(struct history_log *log);
+
+size_t history_log_count(struct history_log *log);
+
+/**
+ * history_log_get() - Get an entry from the history.
+ *
+ * @log: The history log.
+ * @index: The zero-based index of the entry. Note the user sees
+ *         history numbered from one.
+ *
+ * Return: The entry, or NULL if the index is out of range. The
+ *         string is valid for the lifetime of the log.
+ */
+const char *history_log_get(struct history_log *log, size_t index);
+
+/**
+ * history_log_append() - Append a line to the history. Lines are
+ * written immediately, but only synced to disk every
+ * HISTORY_LOG_SYNC_BATCH appends.
+ */
+void history_log_append(struct history_log *log, const char *line);
+
+/**
+ * history_log_search() - Find the most recent entry containing a
+ * substring.
+ *
+ * The first search builds a trigram index over the log, which is
+ * then kept up to date as lines are appended. Searches after that
+ * take time proportional to the number of candidate lines, rather
+ * than the size of the history.
+ *
+ * @log: The history log.
+ * @needle: The substring to search for.
+ * @before: Only consider entries with an index less than this.
+ *
+ * Return: The index of the entry, or -1 if there is none.
+ */
+ssize_t history_log_search(struct history_log *log, const char *needle,
+			   size_t before);
+
+/**
+ * history_log_search_prefix() - Find the most recent entry starting
+ * with a prefix (which may not contain whitespace). Like
+ * history_log_search, this builds an index on first use.
+ *
+ * Return: The index of the entry, or -1 if there is none.
+ */
+ssize_t history_log_search_prefix(struct history_log *log, const char *prefix,
+				  size_t prefix_len);
+
+/**
+ * history_log_complete() - Call func with each distinct command name
+ * (first word) in the history starting with prefix. The word passed
+ * is not NUL-terminated.
+ */
+void history_log_complete(struct history_log *log, const char *prefix,
+			  void (*func)(const char *word, size_t len,
+				       void *data),
+			  void *data);
+
+/**
+ * history_log_sync() - Sync any pending appends to disk now.
+ */
+void history_log_sync(struct history_log *log);
+
+#endif /* _HISTORY_LOG_H */
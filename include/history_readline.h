@@ -0,0 +1,17 @@
+#ifndef _HISTORY_READLINE_H
+#define _HISTORY_READLINE_H
+
+struct history_log;
+
+/**
+ * history_readline_init() - Hook the history log into readline,
+ * replacing readline's reverse-i-search (C-r) with one which uses the
+ * indexed search of the log, and completing command names from
+ * builtins and previously used commands.
+ *
+ * This should only be called once readline is actually going to be
+ * used for interactive input.
+ */
+void history_readline_init(struct history_log *log);
+
+#endif /* _HISTORY_READLINE_H */
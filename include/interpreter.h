@@ -2,16 +2,136 @@
 #define _INTERPRETER_H
 
 #include <stdbool.h>
+#include <sys/types.h>
 
 #include "ast.h"
+#include "trace.h"
+
+struct vm_program;
+
+/*
+ * The positional parameters of a function being run. Calls push a frame
+ * on the C stack rather than setting $1, $2, ... as variables, so a
+ * call costs nothing for the parameters it is not passed.
+ */
+struct call_frame {
+	/* The function name, then its arguments */
+	char **argv;
+	size_t argc;
+	size_t depth;
+	struct call_frame *parent;
+};
 
 struct interpreter_state {
-	struct alias_table *aliases;
-	/* Define anything else you need to store the state of the
-	   interpreter. */
+	/* Aliases, functions and builtins, see commands.h */
+	struct command_table *commands;
+	bool aliases_enabled;
+	/* The innermost function call, or NULL outside of any */
+	struct call_frame *frame;
+	struct variable_table *variables;
+	struct history_log *history;
+	/* The working directory and directory stack, see cwd.h */
+	struct cwd *cwd;
+	/* Descriptors kept for >> while SHELL_FDCACHE=1, or NULL */
+	struct fd_cache *fd_cache;
+	/* The interactive prompt, which cd keeps up to date, or NULL */
+	struct prompt *prompt;
+	/* Background jobs, see jobs.h */
+	struct job_table *jobs;
+	/* The exit status of the last statement, for $? */
+	int last_status;
+	/* Where output to BUILTIN_CAPTURE_FD goes, see shell_builtins.h */
+	struct string_builder *capture;
+	/* Instrumentation, see trace.h: the SHELL_TRACE file, if any */
+	struct trace *trace;
+	/* The totals for the pipeline being timed, if any */
+	struct trace_totals *timing;
+	struct trace_launches launches;
+	/* In a child started with a probe, its write end; otherwise -1 */
+	int probe_fd;
+};
+
+/* The file descriptors a command runs with */
+struct io_fds {
+	int input_fd;
+	int output_fd;
+	int error_fd;
 };
 
 struct interpreter_state *interpreter_new(bool aliases_enabled);
 void interpreter_free(struct interpreter_state *interp);
 
+/**
+ * interpreter_run() - Run a statement list using the standard input,
+ * output and error of the shell.
+ *
+ * Errors in a statement are reported and give it a status of 1; only
+ * ERROR_SYSTEM_EXIT (from the exit builtin) propagates.
+ *
+ * Return: The exit status of the last statement.
+ */
+int interpreter_run(struct interpreter_state *interp,
+		    struct ast_statement_list *list);
+
+/**
+ * interpreter_run_fds() - Like interpreter_run(), with the given file
+ * descriptors in place of the standard ones.
+ */
+int interpreter_run_fds(struct interpreter_state *interp,
+			struct ast_statement_list *list,
+			const struct io_fds *fds);
+
+/**
+ * interpreter_run_program() - Run a compiled statement list (see vm.h),
+ * as interpreter_run_fds() does after compiling one.
+ */
+int interpreter_run_program(struct interpreter_state *interp,
+			    const struct vm_program *program,
+			    const struct io_fds *fds);
+
+/**
+ * interpreter_run_final() - Like interpreter_run(), for the last input
+ * a shell runs before it exits, as for -c or a script: its last command
+ * may replace the shell rather than run in a child of it (see VM_EXEC
+ * in vm.h), so this need not return.
+ */
+int interpreter_run_final(struct interpreter_state *interp,
+			  struct ast_statement_list *list);
+
+/**
+ * interpreter_exec() - Replace the shell by an external command, with
+ * the given descriptors as its standard ones, as the exec builtin does.
+ *
+ * Return: Only if the command could not be found, its exit status.
+ */
+int interpreter_exec(struct interpreter_state *interp, char **argv,
+		     const struct io_fds *fds);
+
+/**
+ * interpreter_subshell() - Run a statement list in a child process.
+ *
+ * Return: The pid of the child, to be passed to interpreter_wait().
+ */
+pid_t interpreter_subshell(struct interpreter_state *interp,
+			   struct ast_statement_list *list,
+			   const struct io_fds *fds);
+
+/**
+ * interpreter_spawn() - Start an already expanded command in a child
+ * process, as for a pipeline stage: a builtin runs in the child, and
+ * anything else is exec'd with the shell's exported variables.
+ *
+ * Return: The pid of the child, to be passed to interpreter_wait().
+ */
+pid_t interpreter_spawn(struct interpreter_state *interp, char **argv,
+			const struct io_fds *fds);
+
+/**
+ * interpreter_wait() - Wait for a child process to exit.
+ *
+ * Return: The exit status in the form used for $?, which is 128 plus
+ *         the signal number for a child killed by a signal.
+ */
+int interpreter_wait(struct interpreter_state *interp, pid_t pid);
+
 #endif /* _INTERPRETER_H */
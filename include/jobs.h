@@ -0,0 +1,123 @@
+#ifndef _JOBS_H
+#define _JOBS_H
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * The job table tracks background pipelines. SIGCHLD is blocked in
+ * the shell and delivered through a signalfd instead, so reaping is a
+ * non-blocking read followed, only when something changed, by one
+ * waitid(P_ALL, WNOHANG) loop, however many jobs are running.
+ */
+
+enum job_state {
+	JOB_RUNNING,
+	JOB_STOPPED,
+	JOB_DONE,
+};
+
+struct job_process {
+	pid_t pid;
+	bool exited;
+};
+
+struct job {
+	/* The number shown by jobs and used in %n */
+	int id;
+	/* Every process of the job is in this process group */
+	pid_t pgid;
+	struct job_process *processes;
+	size_t process_count;
+	/* The number of processes which have not exited */
+	size_t live;
+	/* The status of the last process in the pipeline, once done */
+	int status;
+	enum job_state state;
+	char *command;
+};
+
+struct job_table {
+	/* Jobs in the order they were started; the last is current */
+	struct job **jobs;
+	size_t count;
+	size_t capacity;
+	int signal_fd;
+	/* The signal mask from before SIGCHLD was blocked */
+	sigset_t saved_mask;
+};
+
+/**
+ * job_table_new() - Create a job table, blocking SIGCHLD and opening
+ * a signalfd for it.
+ */
+struct job_table *job_table_new(void);
+
+/**
+ * job_table_free() - Free a job table and restore the signal mask.
+ * Jobs which are still running are not waited for.
+ */
+void job_table_free(struct job_table *table);
+
+/**
+ * jobs_child_init() - Restore the signal mask the shell started with.
+ * To be called in a child before it execs, so that the program does
+ * not inherit a blocked SIGCHLD.
+ */
+void jobs_child_init(struct job_table *table);
+
+/**
+ * job_add() - Add a job for processes which have been started.
+ *
+ * @pids: The processes of the job, the first being the group leader.
+ * @command: A description of the job, which is copied.
+ */
+struct job *job_add(struct job_table *table, const pid_t *pids, size_t count,
+		    const char *command);
+
+/* Remove a job from the table and free it */
+void job_remove(struct job_table *table, struct job *job);
+
+/**
+ * job_find() - Look up a job by specification: %n, %+ or %% for the
+ * current job, %- for the previous one, or the pid of a process.
+ *
+ * Return: The job, or NULL if there is no such job.
+ */
+struct job *job_find(struct job_table *table, const char *spec);
+
+/* The most recently started job, or NULL if there are none */
+struct job *job_current(struct job_table *table);
+
+/**
+ * jobs_reap() - Collect the status of every child which has changed
+ * state, without blocking.
+ */
+void jobs_reap(struct job_table *table);
+
+/**
+ * job_wait() - Block until a job is done, or until it is stopped if
+ * stopped is set.
+ *
+ * Return: The status of the job, as for $?.
+ */
+int job_wait(struct job_table *table, struct job *job, bool stopped);
+
+/**
+ * jobs_notify() - Report jobs which have finished since the last
+ * report to fd, and remove them from the table.
+ */
+void jobs_notify(struct job_table *table, int fd);
+
+/**
+ * job_describe() - Format a job as jobs lists it, for example
+ * "[2]+  Running                 sleep 10 &".
+ *
+ * Return: The description, NUL-terminated in buf.
+ */
+const char *job_describe(struct job_table *table, const struct job *job,
+			 char *buf, size_t len);
+
+#endif /* _JOBS_H */
@@ -1,6 +1,8 @@
 #ifndef _LEX_H
 #define _LEX_H
 
+#include <stddef.h>
+#include <stdint.h>
 #include <sys/types.h>
 
 #include "common.h"
@@ -46,4 +48,42 @@ struct lexer_state {
 void init_lexer(struct lexer_state *lex, const char *input);
 void lexer_next(struct lexer_state *lex);
 
+/* A token of an input which has been lexed in full */
+struct token {
+	enum token_type type;
+	uint32_t begin;
+	uint32_t length;
+};
+
+struct token_array {
+	struct token *tokens;
+	/* Including the final TT_STOP */
+	size_t count;
+	size_t capacity;
+};
+
+/*
+ * A guess at the average size of a token, from lexview's statistics
+ * for typical scripts, used to size the array up front
+ */
+#define LEX_BYTES_PER_TOKEN 4
+
+/**
+ * lex_all() - Split a whole input into tokens in one pass, so the
+ * parser can index them rather than lexing as it goes.
+ *
+ * The array ends with a TT_STOP token. Syntax errors are raised, and
+ * the array is then left empty.
+ */
+void lex_all(const char *input, struct token_array *tokens);
+
+/**
+ * lex_prefix() - Lex as lex_all() does, but end the tokens with TT_STOP
+ * where there is a lex error, for input which may have been cut short
+ * in the middle of a token (an unclosed quote, say).
+ */
+void lex_prefix(const char *input, struct token_array *tokens);
+
+void token_array_free(struct token_array *tokens);
+
 #endif /* _LEX_H */
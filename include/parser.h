@@ -5,4 +5,35 @@
 
 struct ast_statement_list *parse_input(const char *input);
 
+/**
+ * parse_input_view() - Parse an input, leaving strings without escapes
+ * pointing into it rather than copying them.
+ *
+ * The input must not be changed or freed until the tree has been.
+ */
+struct ast_statement_list *parse_input_view(const char *input);
+
+/**
+ * parse_input_prefix() - Parse the statements at the start of an input
+ * which is read a piece at a time, as parse_input_view() does.
+ * @end: Set to the offset just past the last statement parsed.
+ * @awaiting: Set to NULL if the statement after those is a syntax error
+ *            whatever follows. If it ran into the end of the input
+ *            instead, set to text which must come later for it to
+ *            parse, such as the done of an open loop, or "" if any
+ *            text might do.
+ *
+ * Parsing stops at the first statement which does not parse, or has not
+ * been ended by a newline, ; or &.
+ */
+struct ast_statement_list *parse_input_prefix(const char *input, size_t *end,
+					      const char **awaiting);
+
+/**
+ * ast_simplify() - Merge adjacent literal parts of arguments, and give
+ * commands whose arguments are all literal a precomputed argv, so they
+ * run without any expansion. parse_input() does this already.
+ */
+void ast_simplify(struct ast_statement_list *list);
+
 #endif /* _PARSER_H */
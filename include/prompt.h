@@ -0,0 +1,41 @@
+#ifndef _PROMPT_H
+#define _PROMPT_H
+
+/*
+ * The interactive prompt, which looks like
+ *
+ *     user ~/dir :) $
+ *
+ * with ":)" replaced by ":( N" after a command fails with status N.
+ *
+ * The username and home directory are looked up once, when the prompt
+ * is created, since getpwuid() may go through slow NSS backends. The
+ * working directory is told to the prompt by cd rather than asked for
+ * with getcwd(), and the string is only rendered again when one of its
+ * inputs has changed.
+ */
+struct prompt;
+
+/**
+ * prompt_new() - Create a prompt, looking up the username, the home
+ * directory and the working directory.
+ */
+struct prompt *prompt_new(void);
+
+void prompt_free(struct prompt *prompt);
+
+/* Called by cd whenever the working directory changes */
+void prompt_set_cwd(struct prompt *prompt, const char *cwd);
+
+/* Set the status of the last command */
+void prompt_set_status(struct prompt *prompt, int status);
+
+/**
+ * prompt_render() - Get the prompt string.
+ *
+ * Return: The prompt, which stays valid until the next call to any of
+ *         the prompt functions.
+ */
+const char *prompt_render(struct prompt *prompt);
+
+#endif /* _PROMPT_H */
@@ -0,0 +1,64 @@
+#ifndef _REDIRECT_H
+#define _REDIRECT_H
+
+#include <spawn.h>
+
+#include "interpreter.h"
+
+/*
+ * A redirection plan works out which descriptors a command's standard
+ * input, output and error end up as, before anything is started.
+ *
+ * Redirection targets are opened close-on-exec, and the shell's own
+ * standard descriptors are never touched: a builtin is simply handed
+ * the planned layout, and an external command gets it as the
+ * dup2() file actions of posix_spawn() (or, in a child which has
+ * already been forked, by redirect_plan_apply()). The dup2() in the
+ * child clears close-on-exec on the standard descriptors only, so
+ * every descriptor the plan opened disappears at exec.
+ */
+
+/*
+ * The most descriptors a plan opens: one for each kind of redirection,
+ * and a copy of each standard descriptor which has to be moved
+ */
+#define REDIRECT_MAX_OPENED 6
+
+struct redirect_plan {
+	/* What the command's standard input, output and error will be */
+	struct io_fds layout;
+	/* Descriptors opened for the plan, to be closed once it has run */
+	int opened[REDIRECT_MAX_OPENED];
+	size_t opened_count;
+};
+
+/* Start a plan in which the command inherits fds unchanged */
+void redirect_plan_init(struct redirect_plan *plan, const struct io_fds *fds);
+
+/**
+ * redirect_plan_open() - Open a file, relative to dirfd, as standard
+ * descriptor target_fd of the command. Errors opening it are raised.
+ */
+void redirect_plan_open(struct redirect_plan *plan, int target_fd, int dirfd,
+			const char *path, int flags);
+
+/**
+ * redirect_plan_use() - Use a descriptor the plan does not own, such as
+ * one from the fd cache, as standard descriptor target_fd.
+ */
+void redirect_plan_use(struct redirect_plan *plan, int target_fd, int fd);
+
+/**
+ * redirect_plan_file_actions() - Add the dup2() calls which put the
+ * layout in place to a set of posix_spawn() file actions.
+ */
+void redirect_plan_file_actions(struct redirect_plan *plan,
+				posix_spawn_file_actions_t *actions);
+
+/* In a forked child, move the layout into place before exec */
+void redirect_plan_apply(struct redirect_plan *plan);
+
+/* Close the descriptors opened for the plan */
+void redirect_plan_close(struct redirect_plan *plan);
+
+#endif /* _REDIRECT_H */
@@ -1,13 +1,25 @@
 #ifndef _SHELL_BUILTINS_H
 #define _SHELL_BUILTINS_H
 
+#include <stddef.h>
+
 struct interpreter_state;
 
+/*
+ * The builtin has no effect on the shell state, so a command
+ * substitution running only such builtins may be evaluated without
+ * forking a subshell.
+ */
+#define BUILTIN_PURE (1 << 0)
+/* As BUILTIN_PURE, but only when given no arguments */
+#define BUILTIN_PURE_WITHOUT_ARGS (1 << 1)
+
 struct builtin_command {
 	const char *name;
 	int (*function)(struct interpreter_state *state,
 			const char *const *argv, int input_fd, int output_fd,
 			int error_fd);
+	unsigned flags;
 };
 
 struct builtin_command_list {
@@ -18,17 +30,21 @@ struct builtin_command_list {
 extern struct builtin_command_list *builtin_command_list;
 
 #define DEFINE_BUILTIN_COMMAND(NAME, FUNCTION) \
-	___define_builtin_command(NAME, FUNCTION, __LINE__)
+	___define_builtin_command(NAME, FUNCTION, 0, __LINE__)
+
+#define DEFINE_BUILTIN_COMMAND_FLAGS(NAME, FUNCTION, FLAGS) \
+	___define_builtin_command(NAME, FUNCTION, FLAGS, __LINE__)
 
-#define ___define_builtin_command(NAME, FUNCTION, LINE) \
-	___define_builtin_command_2(NAME, FUNCTION, LINE)
+#define ___define_builtin_command(NAME, FUNCTION, FLAGS, LINE) \
+	___define_builtin_command_2(NAME, FUNCTION, FLAGS, LINE)
 
-#define ___define_builtin_command_2(NAME, FUNCTION, LINE)                 \
+#define ___define_builtin_command_2(NAME, FUNCTION, FLAGS, LINE)          \
 	static __constructor void setup_builtin_##FUNCTION##_##LINE(void) \
 	{                                                                 \
 		static struct builtin_command this_command = {            \
 			.name = NAME,                                     \
 			.function = FUNCTION,                             \
+			.flags = FLAGS,                                   \
 		};                                                        \
 		static struct builtin_command_list this_entry = {         \
 			.first = &this_command,                           \
@@ -47,4 +63,18 @@ extern struct builtin_command_list *builtin_command_list;
  */
 struct builtin_command *builtin_command_get(const char *name);
 
+/*
+ * Passed as the output_fd of a builtin evaluated in-process for a
+ * command substitution. Builtins write their output with
+ * builtin_write() or builtin_printf(), which append it to the
+ * interpreter's capture buffer instead.
+ */
+#define BUILTIN_CAPTURE_FD (-2)
+
+void builtin_write(struct interpreter_state *state, int fd, const char *buf,
+		   size_t len);
+__attribute__((format(printf, 3, 4))) void
+builtin_printf(struct interpreter_state *state, int fd, const char *format,
+	       ...);
+
 #endif /* _SHELL_BUILTINS_H */
@@ -0,0 +1,148 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+/*
+ * Instrumentation of the processes the shell starts, used by the time
+ * keyword and by SHELL_TRACE=file.
+ *
+ * Each traced child gets a close-on-exec "probe" pipe. Just before it
+ * execs (or starts a builtin) the child writes the time and its
+ * command name to the probe; the parent reads it once it has reaped
+ * the child with wait4(), which also gives its resource usage.
+ * Children started with posix_spawn() need no probe, as it only
+ * returns once they have exec'd.
+ *
+ * Records for SHELL_TRACE go into a single-producer, single-consumer
+ * lock-free ring, written as JSON lines by a flusher thread, so the
+ * shell itself never blocks on the trace file. When the ring is full,
+ * records are dropped and counted rather than waited for.
+ */
+
+/* Capacity of the ring, which must be a power of two */
+#define TRACE_RING_SIZE 1024
+/* The flusher writes at least this often while records are pending */
+#define TRACE_FLUSH_INTERVAL_MS 100
+/* Command names longer than this are truncated */
+#define TRACE_NAME_MAX 32
+
+struct trace_record {
+	/* CLOCK_MONOTONIC when the child was forked */
+	uint64_t start_ns;
+	/* From fork until the child exec'd or began a builtin, or 0 */
+	uint64_t exec_ns;
+	/* From fork until the child was reaped */
+	uint64_t wall_ns;
+	uint64_t user_us;
+	uint64_t sys_us;
+	uint64_t max_rss_kb;
+	pid_t pid;
+	/* The status as for $? */
+	int status;
+	char name[TRACE_NAME_MAX];
+};
+
+/* Resource usage summed over the children started under time */
+struct trace_totals {
+	uint64_t wall_ns;
+	uint64_t user_us;
+	uint64_t sys_us;
+	uint64_t max_rss_kb;
+	/* The longest fork-to-exec latency of any child */
+	uint64_t exec_ns;
+	size_t children;
+};
+
+/* Traced children which have not yet been reaped */
+struct trace_launches {
+	struct trace_launch *launches;
+	size_t count;
+	size_t capacity;
+};
+
+struct trace;
+
+/* The current CLOCK_MONOTONIC time in nanoseconds */
+uint64_t trace_now(void);
+
+/**
+ * trace_open() - Start tracing to a file, which is appended to.
+ *
+ * Raises an error if the file cannot be opened.
+ */
+struct trace *trace_open(const char *path);
+
+/**
+ * trace_close() - Write out every pending record, stop the flusher
+ * thread and close the file.
+ */
+void trace_close(struct trace *trace);
+
+const char *trace_path(const struct trace *trace);
+
+/**
+ * trace_push() - Queue a record to be written, without blocking.
+ *
+ * Return: false if the ring was full and the record was dropped.
+ */
+bool trace_push(struct trace *trace, const struct trace_record *record);
+
+/* The number of records dropped because the ring was full */
+uint64_t trace_dropped(struct trace *trace);
+
+/**
+ * trace_format() - Format a record as a line of JSON, with a trailing
+ * newline.
+ *
+ * Return: The length of the line, as for snprintf().
+ */
+int trace_format(const struct trace_record *record, char *buf, size_t len);
+
+/**
+ * trace_launch_add() - Remember a child started with a probe.
+ *
+ * @probe_fd: The read end of the child's probe pipe, which is closed
+ *            once the child is finished.
+ */
+void trace_launch_add(struct trace_launches *launches, pid_t pid,
+		      int probe_fd, uint64_t start_ns);
+
+/**
+ * trace_launch_spawned() - Remember a child started by posix_spawn().
+ * It has already exec'd when that returns, so it needs no probe: its
+ * fork-to-exec latency is taken as the time until now.
+ */
+void trace_launch_spawned(struct trace_launches *launches, pid_t pid,
+			  uint64_t start_ns, const char *name);
+
+/**
+ * trace_launch_finish() - Complete the record of a child which has
+ * been reaped, if it was started with a probe.
+ *
+ * Return: false if the child was not started with a probe.
+ */
+bool trace_launch_finish(struct trace_launches *launches, pid_t pid,
+			 int status, const struct rusage *usage,
+			 struct trace_record *record);
+
+void trace_launches_free(struct trace_launches *launches);
+
+/**
+ * trace_probe() - Called in a child just before it execs or starts a
+ * builtin, to report the time and its name to the parent.
+ */
+void trace_probe(int probe_fd, const char *name);
+
+/* Add a finished child to the totals for time */
+void trace_totals_add(struct trace_totals *totals,
+		      const struct trace_record *record);
+
+/* Print the totals in the format of time, as bash does */
+void trace_report_time(int fd, const struct trace_totals *totals);
+
+#endif /* _TRACE_H */
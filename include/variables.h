@@ -0,0 +1,68 @@
+#ifndef _VARIABLES_H
+#define _VARIABLES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * The variable table holds both shell local parameters and
+ * environment variables. Environment variables are simply entries
+ * with the exported flag set.
+ */
+struct variable_table;
+
+struct variable_table *variable_table_new(void);
+void variable_table_free(struct variable_table *table);
+
+/**
+ * variable_table_import() - Import an environment (such as environ)
+ * into the table, marking each entry as exported.
+ *
+ * @table: The variable table.
+ * @envp: A NULL-terminated list of NAME=value strings.
+ */
+void variable_table_import(struct variable_table *table, char *const envp[]);
+
+/**
+ * variable_sized_get() - Lookup a variable by a name which may not be
+ * NUL-terminated (for example, the data of an ast_string).
+ *
+ * Return: The value of the variable, or NULL if it is not set.
+ */
+const char *variable_sized_get(struct variable_table *table, const char *name,
+			       size_t name_len);
+const char *variable_get(struct variable_table *table, const char *name);
+
+/**
+ * variable_set() - Set a variable.
+ *
+ * If the variable is already exported, it stays exported. Otherwise,
+ * it is set as a shell local parameter.
+ */
+void variable_set(struct variable_table *table, const char *name,
+		  const char *value);
+void variable_sized_set(struct variable_table *table, const char *name,
+			size_t name_len, const char *value, size_t value_len);
+/**
+ * variable_export() - Mark a variable to be exported.
+ *
+ * A name which is not set stays unset, and only enters the environment
+ * once it is given a value.
+ */
+void variable_export(struct variable_table *table, const char *name);
+void variable_unset(struct variable_table *table, const char *name);
+bool variable_is_exported(struct variable_table *table, const char *name);
+
+/**
+ * variable_table_envp() - Get an environment suitable for execve.
+ *
+ * The array is cached and only rebuilt when an exported variable has
+ * changed since the last call.
+ *
+ * Return: A NULL-terminated list of NAME=value strings. This is
+ *         owned by the table, and is only valid until the table is
+ *         next modified.
+ */
+char *const *variable_table_envp(struct variable_table *table);
+
+#endif /* _VARIABLES_H */
@@ -0,0 +1,118 @@
+#ifndef _VM_H
+#define _VM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "ast.h"
+#include "common.h"
+
+/*
+ * Statement lists are compiled to a flat array of instructions before
+ * they are run, so running them is a loop over the array rather than a
+ * walk down the tree. The machine has a status register, and an argv
+ * register holding the words of the command being built.
+ *
+ * VM_STATEMENT   Start a statement: reap jobs, follow SHELL_TRACE and
+ *                SHELL_FDCACHE, and free what the last one allocated.
+ *                An error in the statement continues at arg.
+ * VM_TRY         Start a pipeline. An error in it fails the pipeline
+ *                with status 1 and continues at arg.
+ * VM_ARGV        Set the argv register to the precomputed argv at ptr,
+ *                or to an empty one if ptr is NULL.
+ * VM_PUSH        Push the literal word at ptr.
+ * VM_EXPAND      Push the fields of the argument at ptr.
+ * VM_RUN         Run the command at ptr in the foreground, with the
+ *                words in the argv register.
+ * VM_EXEC        As VM_RUN, for the last command the shell runs before
+ *                it exits, see vm_compile_final(). If that is an
+ *                external command and the shell has nothing left to
+ *                do, such as waiting for background jobs, the shell
+ *                execs it in its own place instead of forking.
+ * VM_PIPELINE    Run the pipeline at ptr in child processes, in the
+ *                background if arg is set.
+ * VM_TIME_START  Start timing a pipeline.
+ * VM_TIME_STOP   Report the time taken since VM_TIME_START.
+ * VM_JUMP_IF_FAILURE  Jump to arg if the status is not 0.
+ * VM_JUMP_IF_SUCCESS  Jump to arg if the status is 0.
+ * VM_SET_STATUS  Make the status the one $? gives.
+ * VM_BACKGROUND  Fork a background job for the and-or list at ptr. The
+ *                child continues with the next instruction; the parent
+ *                jumps to arg.
+ * VM_EXIT        Exit the background job with the status.
+ * VM_LOOP_START  Enter the loop command at ptr: open its redirections,
+ *                and for a for loop, take the argv register as the
+ *                words to loop over. Memory allocated inside the loop
+ *                is freed at each statement, back to this point.
+ * VM_FOR_NEXT    Set the variable named at ptr to the next word, or
+ *                jump to arg once there are none left.
+ * VM_LOOP_NEXT   Keep the status of the body, and jump to arg for the
+ *                next iteration.
+ * VM_LOOP_END    Leave the loop, with the status of its body.
+ * VM_DEFINE      Define the function at ptr, see functions.h.
+ */
+#define VM_OP_PPLIST(M)        \
+	M(VM_STATEMENT)        \
+	M(VM_TRY)              \
+	M(VM_ARGV)             \
+	M(VM_PUSH)             \
+	M(VM_EXPAND)           \
+	M(VM_RUN)              \
+	M(VM_EXEC)             \
+	M(VM_PIPELINE)         \
+	M(VM_TIME_START)       \
+	M(VM_TIME_STOP)        \
+	M(VM_JUMP_IF_FAILURE)  \
+	M(VM_JUMP_IF_SUCCESS)  \
+	M(VM_SET_STATUS)       \
+	M(VM_BACKGROUND)       \
+	M(VM_EXIT)             \
+	M(VM_LOOP_START)       \
+	M(VM_FOR_NEXT)         \
+	M(VM_LOOP_NEXT)        \
+	M(VM_LOOP_END)         \
+	M(VM_DEFINE)
+
+enum vm_op PPLIST_PASTE(VM_OP_PPLIST);
+extern const char *vm_op_as_string[];
+
+struct vm_insn {
+	enum vm_op op;
+	uint32_t arg;
+	void *ptr;
+};
+
+struct vm_program {
+	struct vm_insn *code;
+	size_t count;
+	size_t capacity;
+	/* The literal words pushed by VM_PUSH */
+	struct arena strings;
+};
+
+/**
+ * vm_compile() - Compile a statement list.
+ *
+ * The program points into the tree, which must outlive it.
+ *
+ * Return: The program, to be freed with vm_program_free().
+ */
+struct vm_program *vm_compile(struct ast_statement_list *list);
+
+/**
+ * vm_compile_final() - Compile the whole of what a shell runs before it
+ * exits, as for -c or a script, with the command which would be the
+ * last to run as VM_EXEC.
+ */
+struct vm_program *vm_compile_final(struct ast_statement_list *list);
+
+/**
+ * vm_compile_command() - Compile a single command as a statement of its
+ * own, as for a loop run by a child in a pipeline.
+ */
+struct vm_program *vm_compile_command(struct ast_command *cmd);
+
+void vm_program_free(struct vm_program *program);
+
+#endif /* _VM_H */
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 /*
  * Readline headers are stupid and need to be included after the
@@ -14,32 +15,35 @@
 static void lexview(const char *input)
 {
 	struct error error;
-	struct lexer_state lexer;
+	struct token_array tokens;
+	size_t input_len = strlen(input);
 
-	init_lexer(&lexer, input);
-	for (;;) {
-		if (GET_ERROR(&error)) {
-			switch (error.type) {
-			case ERROR_SYNTAX:
-				printf("Lex error! In %s at %s:%u.",
-				       error.function, error.file, error.line);
-				if (error.message)
-					printf(" %s", error.message);
-				printf("\n");
-				exit_error_handler(&error);
-				return;
-			default:
-				reraise(&error);
-			}
+	if (GET_ERROR(&error)) {
+		switch (error.type) {
+		case ERROR_SYNTAX:
+			printf("Lex error! In %s at %s:%u.", error.function,
+			       error.file, error.line);
+			if (error.message)
+				printf(" %s", error.message);
+			printf("\n");
+			exit_error_handler(&error);
+			return;
+		default:
+			reraise(&error);
 		}
-		lexer_next(&lexer);
-		exit_error_handler(&error);
-		printf("%s: ", token_type_as_string[lexer.type]);
-		fwrite(input + lexer.begin, lexer.length, 1, stdout);
+	}
+	lex_all(input, &tokens);
+	exit_error_handler(&error);
+
+	for (size_t i = 0; i < tokens.count; i++) {
+		printf("%s: ", token_type_as_string[tokens.tokens[i].type]);
+		fwrite(input + tokens.tokens[i].begin, tokens.tokens[i].length,
+		       1, stdout);
 		printf("\n");
-		if (lexer.type == TT_STOP)
-			return;
 	}
+	printf("%zu tokens, %zu bytes, %.2f bytes per token\n", tokens.count,
+	       input_len, (double)input_len / tokens.count);
+	token_array_free(&tokens);
 }
 
 int main(void)
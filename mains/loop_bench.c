@@ -0,0 +1,121 @@
+#include <errno.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "error.h"
+#include "string_builder.h"
+
+/*
+ * loop_bench [shell [n]]
+ *
+ * Measures how long an iteration of a shell loop takes, by timing
+ *
+ *     for i in 1 .. n; do for j in 1 .. n; do x=$j; done; done
+ *
+ * run with `shell -c`. The time of `shell -c true` is taken off, so
+ * what is left is the n * n iterations of the inner loop: expanding its
+ * body, running an assignment, and setting the loop variable.
+ */
+
+#define DEFAULT_N 1000
+#define RUNS 5
+
+extern char **environ;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t run_once(const char *shell, const char *script)
+{
+	char *const argv[] = { (char *)shell, "-c", (char *)script, NULL };
+	uint64_t start = now_ns();
+	pid_t pid;
+	int status;
+	int rv;
+
+	rv = posix_spawn(&pid, shell, NULL, NULL, argv, environ);
+	if (rv)
+		RAISE(ERROR_INVALID_ARGUMENT, "posix_spawn %s: %s", shell,
+		      strerror(rv));
+	while (waitpid(pid, &status, 0) < 0)
+		CHECK(errno == EINTR);
+	if (!WIFEXITED(status) || WEXITSTATUS(status))
+		RAISE(ERROR_INVALID_ARGUMENT, "%s -c %.20s... failed", shell,
+		      script);
+	return now_ns() - start;
+}
+
+/* The fastest of a few runs, as the noise only ever adds time */
+static uint64_t best_of(const char *shell, const char *script)
+{
+	uint64_t best = UINT64_MAX;
+	uint64_t ns;
+
+	for (int i = 0; i < RUNS; i++) {
+		ns = run_once(shell, script);
+		if (ns < best)
+			best = ns;
+	}
+	return best;
+}
+
+static char *loop_script(struct arena *arena, long n)
+{
+	struct string_builder *words = string_builder_new(arena);
+	struct string_builder *sb = string_builder_new(arena);
+	char *list;
+
+	for (long i = 1; i <= n; i++) {
+		char *word = arena_malloc(arena, sizeof(char), 24);
+
+		snprintf(word, 24, " %ld", i);
+		string_builder_append(words, word);
+	}
+	list = string_builder_finalize(words);
+
+	string_builder_append(sb, "for i in");
+	string_builder_append(sb, list);
+	string_builder_append(sb, "; do for j in");
+	string_builder_append(sb, list);
+	string_builder_append(sb, "; do x=$j; done; done");
+	return string_builder_finalize(sb);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *shell = argc > 1 ? argv[1] : "build/release/bin/shell";
+	long n = argc > 2 ? strtol(argv[2], NULL, 10) : DEFAULT_N;
+	struct arena arena = { NULL };
+	uint64_t startup, loop;
+
+	if (n <= 0) {
+		fprintf(stderr, "usage: %s [shell [n]]\n", argv[0]);
+		return 1;
+	}
+
+	/* Warm up the page cache before timing anything */
+	run_once(shell, "true");
+	startup = best_of(shell, "true");
+	loop = best_of(shell, loop_script(&arena, n));
+	if (loop < startup)
+		loop = startup;
+
+	printf("%s nested for loops, %ld x %ld iterations\n", shell, n, n);
+	printf("%-8s %8.1f ms\n", "total", (loop - startup) / 1e6);
+	printf("%-8s %8.1f ns\n", "per iter",
+	       (double)(loop - startup) / ((double)n * n));
+	arena_free(&arena);
+	return 0;
+}
@@ -11,6 +11,7 @@
 #include <readline/readline.h>
 
 #include "arena.h"
+#include "ast_graph.h"
 #include "error.h"
 #include "parser.h"
 
@@ -1,6 +1,576 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Readline headers are stupid and need to be included after the
+ * standard libraries, even though r comes before s :(
+ */
+#include <readline/readline.h>
+
+#include "arena.h"
+#include "ast_cache.h"
 #include "error.h"
+#include "history_expand.h"
+#include "history_log.h"
+#include "history_readline.h"
+#include "interpreter.h"
+#include "jobs.h"
+#include "parser.h"
+#include "prompt.h"
+#include "variables.h"
+
+/* How much of a script is read at a time in batch mode */
+#define BATCH_BLOCK_SIZE (1 << 20)
+
+/* The exit status for a syntax error in a script, as in other shells */
+#define SYNTAX_ERROR_STATUS 2
+
+#define DEFAULT_HISTFILE ".shell_history"
+
+static void print_error(struct error *error)
+{
+	dprintf(STDERR_FILENO, "shell: %s\n",
+		error->message ? error->message :
+				 error_type_as_string[error->type]);
+}
+
+/* Set $0 and the positional parameters */
+static void set_arguments(struct interpreter_state *interp, char **argv)
+{
+	char name[16];
+
+	for (int i = 0; argv[i]; i++) {
+		snprintf(name, sizeof(name), "%d", i);
+		variable_set(interp->variables, name, argv[i]);
+	}
+}
+
+/* Run a parsed list, which is freed */
+static void run_list(struct interpreter_state *interp,
+		     struct ast_statement_list *list, bool final)
+{
+	struct error error;
+
+	if (GET_ERROR(&error)) {
+		ast_statement_list_free(list);
+		reraise(&error);
+	}
+	if (final)
+		interpreter_run_final(interp, list);
+	else
+		interpreter_run(interp, list);
+	exit_error_handler(&error);
+	ast_statement_list_free(list);
+}
+
+/*
+ * Parse and run source text. A syntax error is reported as such, and
+ * the statements are not run. If final is set, the shell runs nothing
+ * after the text, and may be replaced by its last command.
+ *
+ * Return: false if the text could not be parsed.
+ */
+static bool run_text(struct interpreter_state *interp, const char *text,
+		     bool final)
+{
+	struct ast_statement_list *list;
+	struct error error;
+
+	if (GET_ERROR(&error)) {
+		if (error.type != ERROR_SYNTAX)
+			reraise(&error);
+		print_error(&error);
+		exit_error_handler(&error);
+		interp->last_status = SYNTAX_ERROR_STATUS;
+		return false;
+	}
+	list = parse_input_view(text);
+	exit_error_handler(&error);
+
+	run_list(interp, list, final);
+	return true;
+}
+
+struct batch {
+	int fd;
+	/*
+	 * Whether the script is also the input of the commands it runs, as
+	 * when it is the shell's stdin. Nothing past what is being run may
+	 * then be taken from it: a regular file is seeked back to the end
+	 * of what is run, and anything else, such as a pipe, is read a
+	 * byte at a time, a line at a time.
+	 */
+	bool shared;
+	bool regular;
+	bool eof;
+	char *buf;
+	size_t len;
+	size_t capacity;
+	/* The text before this has been parsed, and did not all parse */
+	size_t tried;
+	/* If so, what it needs to be followed by to parse; see parser.h */
+	const char *awaiting;
+};
+
+static off_t batch_lseek(struct batch *batch, off_t offset, int whence)
+{
+	off_t pos = lseek(batch->fd, offset, whence);
+
+	if (pos < 0)
+		RAISE(ERROR_INVALID_ARGUMENT, "lseek: %s", strerror(errno));
+	return pos;
+}
+
+static void batch_read(struct batch *batch, size_t size)
+{
+	ssize_t n;
+
+	/* One spare byte, for the NUL terminator */
+	if (batch->capacity - batch->len < size + 1) {
+		batch->capacity = batch->len + BATCH_BLOCK_SIZE + 1;
+		batch->buf = checked_realloc(batch->buf, sizeof(char),
+					     batch->capacity);
+	}
+
+	do
+		n = read(batch->fd, batch->buf + batch->len, size);
+	while (n < 0 && errno == EINTR);
+	if (n < 0)
+		RAISE(ERROR_INVALID_ARGUMENT, "read: %s", strerror(errno));
+
+	batch->len += n;
+	batch->eof = !n;
+}
+
+static void batch_fill(struct batch *batch)
+{
+	if (batch->shared && !batch->regular) {
+		do
+			batch_read(batch, 1);
+		while (!batch->eof && batch->buf[batch->len - 1] != '\n');
+		return;
+	}
+
+	batch_read(batch, BATCH_BLOCK_SIZE);
+	/*
+	 * Reading ahead in a file never waits, and finding where it ends
+	 * before running its last lines lets the last command replace the
+	 * shell.
+	 */
+	if (batch->regular && !batch->eof &&
+	    batch->buf[batch->len - 1] == '\n')
+		batch_read(batch, BATCH_BLOCK_SIZE);
+}
+
+/*
+ * Run what has been read of the script from start to end: the list, if
+ * it has been parsed already, or else the text. If the commands can
+ * read the script, it is left at end while they run.
+ *
+ * Return: false if the text could not be parsed.
+ */
+static bool batch_run(struct interpreter_state *interp, struct batch *batch,
+		      size_t start, size_t end,
+		      struct ast_statement_list *list, bool final)
+{
+	off_t ahead = batch->len - end;
+	bool seek = batch->shared && batch->regular;
+	char saved = batch->buf[end];
+	off_t pos = 0;
+	bool parsed = true;
+
+	if (seek)
+		pos = batch_lseek(batch, -ahead, SEEK_CUR);
+
+	if (list) {
+		run_list(interp, list, final);
+	} else {
+		batch->buf[end] = '\0';
+		parsed = run_text(interp, batch->buf + start, final);
+		batch->buf[end] = saved;
+	}
+
+	if (!seek)
+		return parsed;
+	if (batch_lseek(batch, 0, SEEK_CUR) == pos) {
+		batch_lseek(batch, ahead, SEEK_CUR);
+	} else {
+		/* The commands read on from there, so what follows is gone */
+		batch->len = batch->tried = end;
+		batch->eof = false;
+	}
+	return parsed;
+}
+
+/*
+ * Run the statements read so far, as far as they parse, leaving the
+ * rest in the buffer for when more has been read. Statements are parsed
+ * once, except one which goes on past what has been read: that is tried
+ * again once what closes it (a done, say) may have been read.
+ *
+ * Return: false at a syntax error, after which nothing more is run.
+ */
+static bool batch_run_buffered(struct interpreter_state *interp,
+			       struct batch *batch)
+{
+	struct ast_statement_list *list;
+	size_t start = 0;
+	bool parsed = true;
+
+	for (;;) {
+		const char *text = batch->buf + batch->tried;
+		size_t size = batch->len - batch->tried;
+		const char *newline, *awaiting;
+		size_t limit, end;
+		bool final;
+		char saved;
+
+		/*
+		 * When the script is the commands' input, a line (or what
+		 * it takes to finish a statement) is run at a time.
+		 */
+		newline = batch->shared ? memchr(text, '\n', size) :
+					  memrchr(text, '\n', size);
+		if (newline)
+			limit = newline - batch->buf + 1;
+		else if (batch->eof && start < batch->len)
+			limit = batch->len;
+		else
+			break;
+		final = batch->eof && limit == batch->len;
+
+		/* Parsing again is no use until that has been read */
+		if (!final && batch->awaiting &&
+		    !memmem(batch->buf + batch->tried, limit - batch->tried,
+			    batch->awaiting, strlen(batch->awaiting))) {
+			batch->tried = limit;
+			continue;
+		}
+
+		saved = batch->buf[limit];
+		batch->buf[limit] = '\0';
+		list = parse_input_prefix(batch->buf + start, &end, &awaiting);
+		batch->buf[limit] = saved;
+
+		end += start;
+		if (batch->shared && end < limit && awaiting && !final) {
+			ast_statement_list_free(list);
+			end = start;
+		}
+		batch->tried = limit;
+		batch->awaiting = end < limit ? awaiting : NULL;
+		if (end > start)
+			batch_run(interp, batch, start, end, list,
+				  final && end == limit);
+		else
+			ast_statement_list_free(list);
+		start = end;
+		if (batch->len < limit)
+			break;
+
+		/*
+		 * What does not parse is an error at the end of the input,
+		 * or once it stops short of the end of what has been read.
+		 */
+		if (final || !awaiting) {
+			if (start < limit)
+				parsed = batch_run(interp, batch, start, limit,
+						   NULL, final);
+			start = limit;
+			batch->awaiting = NULL;
+			if (!parsed || final)
+				break;
+		}
+	}
+
+	memmove(batch->buf, batch->buf + start, batch->len - start);
+	batch->len -= start;
+	batch->tried -= start;
+	return parsed;
+}
+
+/*
+ * Run a script from fd, reading it a block at a time, or less when its
+ * commands read from it too. Only at the end of the input is a syntax
+ * error final: before then, the last statement may just be incomplete.
+ */
+static int run_batch(struct interpreter_state *interp, int fd)
+{
+	struct batch batch = {
+		.fd = fd,
+		.shared = fd == STDIN_FILENO,
+	};
+	struct error error;
+	struct stat st;
+
+	batch.regular = !fstat(fd, &st) && S_ISREG(st.st_mode);
+
+	if (GET_ERROR(&error)) {
+		free(batch.buf);
+		reraise(&error);
+	}
+	do
+		batch_fill(&batch);
+	while (batch_run_buffered(interp, &batch) && !batch.eof);
+	exit_error_handler(&error);
+
+	free(batch.buf);
+	return interp->last_status;
+}
+
+/* Parse a whole script and cache the tree, if it parses */
+static struct ast_statement_list *parse_script(int fd, const struct stat *st,
+					       const char *dir, char **text)
+{
+	struct batch batch = { .fd = fd };
+	struct ast_statement_list *list;
+	struct error error;
+
+	while (!batch.eof)
+		batch_fill(&batch);
+	batch.buf[batch.len] = '\0';
+
+	if (GET_ERROR(&error)) {
+		free(batch.buf);
+		reraise(&error);
+	}
+	list = parse_input_view(batch.buf);
+	exit_error_handler(&error);
+
+	if (GET_ERROR(&error)) {
+		/* Not being able to cache it only makes the next run slower */
+		exit_error_handler(&error);
+	} else {
+		ast_cache_store(dir, st, list);
+		exit_error_handler(&error);
+	}
+
+	*text = batch.buf;
+	return list;
+}
+
+/*
+ * Run a whole script, from the tree in the cache directory dir if it
+ * is there, without parsing it at all.
+ *
+ * Return: false, having run nothing, if the script has a syntax error,
+ *         so that run_batch() can run the statements before it.
+ */
+static bool run_cached(struct interpreter_state *interp, int fd,
+		       const struct stat *st, const char *dir)
+{
+	struct ast_cache_mapping mapping = { NULL };
+	struct ast_statement_list *list = NULL;
+	char *text = NULL;
+	struct error error;
+
+	if (!ast_cache_load(dir, st, &mapping)) {
+		if (GET_ERROR(&error)) {
+			if (error.type != ERROR_SYNTAX)
+				reraise(&error);
+			exit_error_handler(&error);
+			if (lseek(fd, 0, SEEK_SET) < 0)
+				RAISE(ERROR_INVALID_ARGUMENT, "lseek: %s",
+				      strerror(errno));
+			return false;
+		}
+		list = parse_script(fd, st, dir, &text);
+		exit_error_handler(&error);
+	}
+
+	if (GET_ERROR(&error)) {
+		if (mapping.addr)
+			ast_cache_unmap(&mapping);
+		else
+			ast_statement_list_free(list);
+		free(text);
+		reraise(&error);
+	}
+	interpreter_run_final(interp, mapping.addr ? mapping.list : list);
+	exit_error_handler(&error);
+
+	if (mapping.addr)
+		ast_cache_unmap(&mapping);
+	else
+		ast_statement_list_free(list);
+	free(text);
+	return true;
+}
+
+static int run_script(struct interpreter_state *interp, const char *path)
+{
+	const char *cache_dir = getenv("SHELL_ASTCACHE");
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	struct stat st;
+	int status;
+
+	if (fd < 0) {
+		dprintf(STDERR_FILENO, "shell: %s: %s\n", path,
+			strerror(errno));
+		return errno == ENOENT ? 127 : 126;
+	}
+	if (cache_dir && *cache_dir && !fstat(fd, &st) && S_ISREG(st.st_mode) &&
+	    run_cached(interp, fd, &st, cache_dir))
+		status = interp->last_status;
+	else
+		status = run_batch(interp, fd);
+	checked_close(fd);
+	return status;
+}
+
+static struct history_log *open_history(void)
+{
+	const char *histfile = getenv("HISTFILE");
+	const char *home = getenv("HOME");
+	struct history_log *log;
+	struct error error;
+	char *path = NULL;
+
+	if (!histfile && home) {
+		path = checked_malloc(sizeof(char), strlen(home) + 1 +
+						    sizeof(DEFAULT_HISTFILE));
+		sprintf(path, "%s/%s", home, DEFAULT_HISTFILE);
+		histfile = path;
+	}
+	if (!histfile)
+		return history_log_new_memory();
+
+	if (GET_ERROR(&error)) {
+		print_error(&error);
+		exit_error_handler(&error);
+		free(path);
+		return history_log_new_memory();
+	}
+	log = history_log_open(histfile);
+	exit_error_handler(&error);
+	free(path);
+	return log;
+}
+
+/* Expand history references in a line, and record it in the history */
+static const char *history_line(struct interpreter_state *interp,
+				const char *line, struct arena *arena)
+{
+	char *expanded;
+
+	switch (history_expand(interp->history, line, arena, &expanded)) {
+	case HISTORY_EXPANSION_NONE:
+		break;
+	case HISTORY_EXPANSION_EXPANDED:
+		printf("%s\n", expanded);
+		line = expanded;
+		break;
+	case HISTORY_EXPANSION_PRINT_ONLY:
+		printf("%s\n", expanded);
+		history_log_append(interp->history, expanded);
+		return NULL;
+	}
+
+	if (line[strspn(line, " \t")])
+		history_log_append(interp->history, line);
+	return line;
+}
+
+static void interactive_line(struct interpreter_state *interp,
+			     const char *line)
+{
+	struct arena arena = { NULL };
+	struct error error;
+
+	if (GET_ERROR(&error)) {
+		arena_free(&arena);
+		if (error.type == ERROR_SYSTEM_EXIT)
+			reraise(&error);
+		print_error(&error);
+		exit_error_handler(&error);
+		return;
+	}
+
+	line = history_line(interp, line, &arena);
+	if (line)
+		run_text(interp, line, false);
+
+	exit_error_handler(&error);
+	arena_free(&arena);
+}
+
+static int run_interactive(struct interpreter_state *interp)
+{
+	char *line;
+
+	interp->history = open_history();
+	interp->prompt = prompt_new();
+	history_readline_init(interp->history);
+
+	for (;;) {
+		jobs_notify(interp->jobs, STDERR_FILENO);
+		prompt_set_status(interp->prompt, interp->last_status);
+		line = readline(prompt_render(interp->prompt));
+		if (!line)
+			break;
+		interactive_line(interp, line);
+		free(line);
+	}
+	return interp->last_status;
+}
+
+static void usage(void)
+{
+	dprintf(STDERR_FILENO, "usage: shell [-c command [name [args...]] | "
+			       "script [args...]]\n");
+}
 
 int main(int argc, char *argv[])
 {
-	TODO("Write a main function!");
+	struct interpreter_state *interp;
+	bool interactive;
+	struct error error;
+	int status;
+
+	if (argc > 1 && !strcmp(argv[1], "-c") && argc < 3) {
+		usage();
+		return SYNTAX_ERROR_STATUS;
+	}
+
+	interactive = argc == 1 && isatty(STDIN_FILENO);
+	interp = interpreter_new(interactive);
+
+	if (GET_ERROR(&error)) {
+		if (error.type != ERROR_SYSTEM_EXIT)
+			reraise(&error);
+		status = 0;
+		sscanf(error.message, "%d", &status);
+		exit_error_handler(&error);
+		interpreter_free(interp);
+		return status;
+	}
+
+	if (argc > 1 && !strcmp(argv[1], "-c")) {
+		/* With no name, $0 is the shell's and there are no others */
+		char *name_only[] = { argv[0], NULL };
+
+		set_arguments(interp, argv[3] ? argv + 3 : name_only);
+		run_text(interp, argv[2], true);
+		status = interp->last_status;
+	} else if (argc > 1) {
+		set_arguments(interp, argv + 1);
+		status = run_script(interp, argv[1]);
+	} else if (interactive) {
+		set_arguments(interp, argv);
+		status = run_interactive(interp);
+	} else {
+		set_arguments(interp, argv);
+		status = run_batch(interp, STDIN_FILENO);
+	}
+
+	exit_error_handler(&error);
+	interpreter_free(interp);
+	return status;
 }
@@ -0,0 +1,95 @@
+#include <errno.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "error.h"
+
+/*
+ * startup_bench [shell [runs]]
+ *
+ * Measures how long the shell takes to start, run a trivial command and
+ * exit, by timing `shell -c true` from spawn to reaping, over many
+ * runs. This is dominated by exec, dynamic linking and whatever the
+ * shell does before its first command.
+ */
+
+#define DEFAULT_RUNS 1000
+
+extern char **environ;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t run_once(const char *shell)
+{
+	char *const argv[] = { (char *)shell, "-c", "true", NULL };
+	uint64_t start = now_ns();
+	pid_t pid;
+	int status;
+	int rv;
+
+	rv = posix_spawn(&pid, shell, NULL, NULL, argv, environ);
+	if (rv)
+		RAISE(ERROR_INVALID_ARGUMENT, "posix_spawn %s: %s", shell,
+		      strerror(rv));
+	while (waitpid(pid, &status, 0) < 0)
+		CHECK(errno == EINTR);
+	if (!WIFEXITED(status) || WEXITSTATUS(status))
+		RAISE(ERROR_INVALID_ARGUMENT, "%s -c true failed", shell);
+	return now_ns() - start;
+}
+
+static int compare(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void report(const char *label, uint64_t ns)
+{
+	printf("%-8s %8.1f us\n", label, ns / 1000.0);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *shell = argc > 1 ? argv[1] : "build/release/bin/shell";
+	long runs = argc > 2 ? strtol(argv[2], NULL, 10) : DEFAULT_RUNS;
+	uint64_t *times;
+	uint64_t total = 0;
+
+	if (runs <= 0) {
+		fprintf(stderr, "usage: %s [shell [runs]]\n", argv[0]);
+		return 1;
+	}
+
+	times = checked_calloc(sizeof(uint64_t), runs);
+	/* Warm up the page cache before timing anything */
+	run_once(shell);
+	for (long i = 0; i < runs; i++) {
+		times[i] = run_once(shell);
+		total += times[i];
+	}
+	qsort(times, runs, sizeof(uint64_t), compare);
+
+	printf("%s -c true, %ld runs\n", shell, runs);
+	report("mean", total / runs);
+	report("min", times[0]);
+	report("median", times[runs / 2]);
+	report("p99", times[runs * 99 / 100]);
+	report("max", times[runs - 1]);
+	free(times);
+	return 0;
+}
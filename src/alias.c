@@ -1,36 +1,55 @@
-#include <stddef.h>
+#include <stdlib.h>
 
+#include "alias.h"
+#include "commands.h"
 #include "error.h"
 
-struct alias_table {
-	/* You choose what goes here! */
-};
-
-struct alias_table *alias_table_new(void)
+void alias_set(struct command_table *table, const char *name,
+	       const char *replacement)
 {
-	return checked_calloc(sizeof(struct alias_table), 1);
+	struct command *command = command_add(table, name);
+
+	free(command->alias);
+	command->alias = checked_strdup(replacement);
 }
 
-void alias_table_free(struct alias_table *table)
+void alias_unset(struct command_table *table, const char *name)
 {
-	TODO("Free any memory allocated for the table.");
+	struct command *command = command_lookup(table, name);
+
+	if (!command || !command->alias)
+		return;
+	free(command->alias);
+	command->alias = NULL;
+	command_prune(table, command);
 }
 
-void alias_set(struct alias_table *table, const char *name,
-	       const char *replacement)
+const char *alias_get(struct command_table *table, const char *name)
 {
-	TODO("Set an alias.");
+	struct command *command = command_lookup(table, name);
+
+	return command ? command->alias : NULL;
 }
 
-void alias_unset(struct alias_table *table, const char *name)
+struct foreach_alias {
+	void (*func)(const char *name, const char *replacement, void *data);
+	void *data;
+};
+
+static void foreach_alias(struct command *command, void *data)
 {
-	TODO("Unset an entry.");
+	struct foreach_alias *foreach = data;
+
+	if (command->alias)
+		foreach->func(command->name, command->alias, foreach->data);
 }
 
-const char *alias_get(struct alias_table *table, const char *name)
+void alias_foreach(struct command_table *table,
+		   void (*func)(const char *name, const char *replacement,
+				void *data),
+		   void *data)
 {
-	TODO("Get an entry.");
-}
+	struct foreach_alias foreach = { func, data };
 
-/* You'll also need a function which can print all aliases. I'll let
-   you choose your own design on that. */
+	command_table_foreach(table, foreach_alias, &foreach);
+}
@@ -2,30 +2,31 @@
 #include <string.h>
 
 #include "alias.h"
+#include "commands.h"
 #include "error.h"
 #include "unit.h"
 
 DEFTEST("alias.init")
 {
-	struct alias_table *aliases = alias_table_new();
+	struct command_table *aliases = command_table_new();
 	ASSERT_NOT_NULL(aliases);
-	alias_table_free(aliases);
+	command_table_free(aliases);
 }
 
 DEFTEST("alias.simple")
 {
-	struct alias_table *aliases = alias_table_new();
+	struct command_table *aliases = command_table_new();
 	ASSERT_NOT_NULL(aliases);
 
 	alias_set(aliases, "foo", "bar");
 	EXPECT(!strcmp(alias_get(aliases, "foo"), "bar"));
 
-	alias_table_free(aliases);
+	command_table_free(aliases);
 }
 
 DEFTEST("alias.simple_two")
 {
-	struct alias_table *aliases = alias_table_new();
+	struct command_table *aliases = command_table_new();
 	ASSERT_NOT_NULL(aliases);
 
 	alias_set(aliases, "goodies", "candy");
@@ -34,22 +35,22 @@ DEFTEST("alias.simple_two")
 	EXPECT(!strcmp(alias_get(aliases, "goodies"), "candy"));
 	EXPECT(!strcmp(alias_get(aliases, "yummies"), "sugar"));
 
-	alias_table_free(aliases);
+	command_table_free(aliases);
 }
 
 DEFTEST("alias.get_unknown_without_values")
 {
-	struct alias_table *aliases = alias_table_new();
+	struct command_table *aliases = command_table_new();
 	ASSERT_NOT_NULL(aliases);
 
 	EXPECT_NULL(alias_get(aliases, "randomthing"));
 
-	alias_table_free(aliases);
+	command_table_free(aliases);
 }
 
 DEFTEST("alias.get_unknown_with_values")
 {
-	struct alias_table *aliases = alias_table_new();
+	struct command_table *aliases = command_table_new();
 	ASSERT_NOT_NULL(aliases);
 
 	alias_set(aliases, "serpent", "snake");
@@ -57,12 +58,12 @@ DEFTEST("alias.get_unknown_with_values")
 
 	EXPECT_NULL(alias_get(aliases, "iguana"));
 
-	alias_table_free(aliases);
+	command_table_free(aliases);
 }
 
 DEFTEST("alias.different_pointers")
 {
-	struct alias_table *aliases = alias_table_new();
+	struct command_table *aliases = command_table_new();
 	ASSERT_NOT_NULL(aliases);
 
 	const char name[] = "ImaDifferentPointer";
@@ -76,12 +77,12 @@ DEFTEST("alias.different_pointers")
 	EXPECT(!strcmp(alias_get(aliases, name), value));
 	EXPECT(!strcmp(alias_get(aliases, copy), value));
 
-	alias_table_free(aliases);
+	command_table_free(aliases);
 }
 
 DEFTEST("alias.prefix_no_match")
 {
-	struct alias_table *aliases = alias_table_new();
+	struct command_table *aliases = command_table_new();
 	ASSERT_NOT_NULL(aliases);
 
 	const char name1[] = "BlackJack";
@@ -96,12 +97,12 @@ DEFTEST("alias.prefix_no_match")
 	EXPECT(!strcmp(alias_get(aliases, name1), value1));
 	EXPECT(!strcmp(alias_get(aliases, name2), value2));
 
-	alias_table_free(aliases);
+	command_table_free(aliases);
 }
 
 DEFTEST("alias.change_definition")
 {
-	struct alias_table *aliases = alias_table_new();
+	struct command_table *aliases = command_table_new();
 	ASSERT_NOT_NULL(aliases);
 
 	const char name[] = "duck";
@@ -118,12 +119,12 @@ DEFTEST("alias.change_definition")
 	alias_set(aliases, name, value1);
 	EXPECT(!strcmp(alias_get(aliases, name), value1));
 
-	alias_table_free(aliases);
+	command_table_free(aliases);
 }
 
 DEFTEST("alias.mutate_data")
 {
-	struct alias_table *aliases = alias_table_new();
+	struct command_table *aliases = command_table_new();
 	ASSERT_NOT_NULL(aliases);
 
 	const char name[] = "gazebo";
@@ -141,12 +142,12 @@ DEFTEST("alias.mutate_data")
 	valuecpy[4] = 'g';
 	EXPECT(!strcmp(alias_get(aliases, name), value));
 
-	alias_table_free(aliases);
+	command_table_free(aliases);
 }
 
 DEFTEST("alias.complete_get_set")
 {
-	struct alias_table *aliases = alias_table_new();
+	struct command_table *aliases = command_table_new();
 	ASSERT_NOT_NULL(aliases);
 
 	struct {
@@ -185,12 +186,12 @@ DEFTEST("alias.complete_get_set")
 		EXPECT(!strcmp(alias_get(aliases, aliasdefs[i].name),
 			       aliasdefs[i].value));
 
-	alias_table_free(aliases);
+	command_table_free(aliases);
 }
 
 DEFTEST("alias.unset.simple")
 {
-	struct alias_table *aliases = alias_table_new();
+	struct command_table *aliases = command_table_new();
 	ASSERT_NOT_NULL(aliases);
 
 	alias_set(aliases, "flip", "flop");
@@ -198,12 +199,12 @@ DEFTEST("alias.unset.simple")
 	alias_unset(aliases, "flip");
 	EXPECT_NULL(alias_get(aliases, "flip"));
 
-	alias_table_free(aliases);
+	command_table_free(aliases);
 }
 
 DEFTEST("alias.unset.middle")
 {
-	struct alias_table *aliases = alias_table_new();
+	struct command_table *aliases = command_table_new();
 	ASSERT_NOT_NULL(aliases);
 
 	alias_set(aliases, "flip", "flop");
@@ -223,12 +224,12 @@ DEFTEST("alias.unset.middle")
 	EXPECT(!strcmp(alias_get(aliases, "bip"), "bop"));
 	EXPECT(!strcmp(alias_get(aliases, "zip"), "zop"));
 
-	alias_table_free(aliases);
+	command_table_free(aliases);
 }
 
 DEFTEST("alias.unset.nodef")
 {
-	struct alias_table *aliases = alias_table_new();
+	struct command_table *aliases = command_table_new();
 	ASSERT_NOT_NULL(aliases);
 
 	alias_unset(aliases, "flip");
@@ -245,5 +246,5 @@ DEFTEST("alias.unset.nodef")
 	EXPECT(!strcmp(alias_get(aliases, "tick"), "tock"));
 	EXPECT(!strcmp(alias_get(aliases, "zip"), "zop"));
 
-	alias_table_free(aliases);
+	command_table_free(aliases);
 }
@@ -0,0 +1,869 @@
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "arith.h"
+#include "error.h"
+#include "unit.h"
+#include "variables.h"
+
+enum arith_op {
+	/* Followed by an int64_t immediate */
+	ARITH_PUSH,
+	/* Followed by a uint16_t variable slot */
+	ARITH_LOAD,
+
+	ARITH_NEG,
+	ARITH_NOT,
+	ARITH_BITNOT,
+	/* Replace the top of the stack by 0 or 1 */
+	ARITH_BOOL,
+
+	ARITH_MUL,
+	ARITH_DIV,
+	ARITH_MOD,
+	ARITH_POW,
+	ARITH_ADD,
+	ARITH_SUB,
+	ARITH_SHL,
+	ARITH_SHR,
+	ARITH_LT,
+	ARITH_LE,
+	ARITH_GT,
+	ARITH_GE,
+	ARITH_EQ,
+	ARITH_NE,
+	ARITH_BITAND,
+	ARITH_BITXOR,
+	ARITH_BITOR,
+
+	/* Jumps are followed by a uint32_t code offset */
+	/* If the top is zero, leave 0 and jump, otherwise pop */
+	ARITH_AND_JUMP,
+	/* If the top is non-zero, leave 1 and jump, otherwise pop */
+	ARITH_OR_JUMP,
+	/* Pop, and jump if zero */
+	ARITH_JUMP_ZERO,
+	ARITH_JUMP,
+};
+
+struct arith_slot {
+	uint32_t name_offset;
+	uint32_t name_len;
+};
+
+/*
+ * The header is followed by the variable slots, the code, the
+ * variable names the slots refer to, and finally the source text.
+ * Name offsets are relative to the start of the names.
+ */
+struct arith_program {
+	uint32_t size;
+	uint32_t code_size;
+	uint32_t names_size;
+	uint32_t source_size;
+	uint16_t slot_count;
+	uint16_t max_stack;
+	unsigned char data[];
+};
+
+static const struct arith_slot *program_slots(const struct arith_program *prog)
+{
+	return (const struct arith_slot *)prog->data;
+}
+
+static const unsigned char *program_code(const struct arith_program *prog)
+{
+	return prog->data + prog->slot_count * sizeof(struct arith_slot);
+}
+
+static const char *program_names(const struct arith_program *prog)
+{
+	return (const char *)program_code(prog) + prog->code_size;
+}
+
+size_t arith_program_size(const struct arith_program *program)
+{
+	return program->size;
+}
+
+const char *arith_program_source(const struct arith_program *program,
+				 size_t *len)
+{
+	*len = program->source_size;
+	return program_names(program) + program->names_size;
+}
+
+/* By squaring, so a huge exponent takes 63 steps at most */
+static int64_t power(int64_t base, int64_t exponent)
+{
+	uint64_t result = 1;
+	uint64_t factor = base;
+
+	for (; exponent; exponent >>= 1) {
+		if (exponent & 1)
+			result *= factor;
+		factor *= factor;
+	}
+	return result;
+}
+
+/* Whether a binary operator is defined for these operands */
+static bool binary_defined(enum arith_op op, int64_t a, int64_t b)
+{
+	switch (op) {
+	case ARITH_DIV:
+	case ARITH_MOD:
+		return b != 0;
+	case ARITH_POW:
+		return b >= 0;
+	default:
+		return true;
+	}
+}
+
+/* Arithmetic wraps, as the shell's does, instead of being undefined */
+static int64_t apply_binary(enum arith_op op, int64_t a, int64_t b)
+{
+	if (!binary_defined(op, a, b))
+		RAISE(ERROR_INVALID_ARGUMENT, op == ARITH_POW ?
+						      "Exponent less than 0" :
+						      "Division by zero");
+
+	switch (op) {
+	case ARITH_MUL:
+		return (uint64_t)a * (uint64_t)b;
+	case ARITH_DIV:
+		return b == -1 ? -(uint64_t)a : a / b;
+	case ARITH_MOD:
+		return b == -1 ? 0 : a % b;
+	case ARITH_POW:
+		return power(a, b);
+	case ARITH_ADD:
+		return (uint64_t)a + (uint64_t)b;
+	case ARITH_SUB:
+		return (uint64_t)a - (uint64_t)b;
+	case ARITH_SHL:
+		return (uint64_t)a << (b & 63);
+	case ARITH_SHR:
+		return a >> (b & 63);
+	case ARITH_LT:
+		return a < b;
+	case ARITH_LE:
+		return a <= b;
+	case ARITH_GT:
+		return a > b;
+	case ARITH_GE:
+		return a >= b;
+	case ARITH_EQ:
+		return a == b;
+	case ARITH_NE:
+		return a != b;
+	case ARITH_BITAND:
+		return a & b;
+	case ARITH_BITXOR:
+		return a ^ b;
+	case ARITH_BITOR:
+		return a | b;
+	default:
+		RAISE(ERROR_CORRUPTION, "Bad binary arithmetic operator %d",
+		      op);
+	}
+}
+
+static int64_t apply_unary(enum arith_op op, int64_t a)
+{
+	switch (op) {
+	case ARITH_NEG:
+		return -(uint64_t)a;
+	case ARITH_NOT:
+		return !a;
+	case ARITH_BITNOT:
+		return ~a;
+	case ARITH_BOOL:
+		return !!a;
+	default:
+		RAISE(ERROR_CORRUPTION, "Bad unary arithmetic operator %d",
+		      op);
+	}
+}
+
+enum node_type {
+	NODE_NUMBER,
+	NODE_VARIABLE,
+	NODE_UNARY,
+	NODE_BINARY,
+	NODE_AND,
+	NODE_OR,
+	NODE_TERNARY,
+};
+
+struct node {
+	enum node_type type;
+	enum arith_op op;
+	int64_t value;
+	const char *name;
+	size_t name_len;
+	struct node *a;
+	struct node *b;
+	struct node *c;
+};
+
+struct arith_parser {
+	const char *p;
+	const char *end;
+	struct arena *arena;
+};
+
+static struct node *new_node(struct arith_parser *parser, enum node_type type)
+{
+	return arena_calloc(parser->arena, sizeof(struct node), 1);
+}
+
+static struct node *number(struct arith_parser *parser, int64_t value)
+{
+	struct node *node = new_node(parser, NODE_NUMBER);
+
+	node->type = NODE_NUMBER;
+	node->value = value;
+	return node;
+}
+
+/* The make_* functions fold constants as the tree is built */
+static struct node *make_unary(struct arith_parser *parser, enum arith_op op,
+			       struct node *a)
+{
+	struct node *node;
+
+	if (a->type == NODE_NUMBER)
+		return number(parser, apply_unary(op, a->value));
+
+	node = new_node(parser, NODE_UNARY);
+	node->type = NODE_UNARY;
+	node->op = op;
+	node->a = a;
+	return node;
+}
+
+static struct node *make_binary(struct arith_parser *parser, enum arith_op op,
+				struct node *a, struct node *b)
+{
+	struct node *node;
+
+	if (op == ARITH_AND_JUMP || op == ARITH_OR_JUMP) {
+		bool is_and = op == ARITH_AND_JUMP;
+
+		if (a->type == NODE_NUMBER) {
+			/* The right operand decides, or is never run */
+			if (!a->value == is_and)
+				return number(parser, !is_and);
+			return make_unary(parser, ARITH_BOOL, b);
+		}
+		node = new_node(parser, NODE_AND);
+		node->type = is_and ? NODE_AND : NODE_OR;
+	} else if (a->type == NODE_NUMBER && b->type == NODE_NUMBER &&
+		   binary_defined(op, a->value, b->value)) {
+		return number(parser, apply_binary(op, a->value, b->value));
+	} else {
+		node = new_node(parser, NODE_BINARY);
+		node->type = NODE_BINARY;
+	}
+
+	node->op = op;
+	node->a = a;
+	node->b = b;
+	return node;
+}
+
+static void skip_space(struct arith_parser *parser)
+{
+	while (parser->p < parser->end) {
+		if (isspace(*parser->p))
+			parser->p++;
+		else if (*parser->p == '\\' && parser->p + 1 < parser->end &&
+			 parser->p[1] == '\n')
+			parser->p += 2;
+		else
+			break;
+	}
+}
+
+static const char *const operators[] = {
+	/* Longest first, so << is not taken for < */
+	"**", "<<", ">>", "<=", ">=", "==", "!=", "&&", "||",
+	"+",  "-",  "*",  "/",	"%",  "<",  ">",  "&",	"^",
+	"|",  "!",  "~",  "?",	":",  "(",  ")",
+};
+
+static const char *peek_operator(struct arith_parser *parser)
+{
+	skip_space(parser);
+	for (size_t i = 0; i < ARRAY_SIZE(operators); i++) {
+		size_t len = strlen(operators[i]);
+
+		if (parser->end - parser->p >= len &&
+		    !memcmp(parser->p, operators[i], len))
+			return operators[i];
+	}
+	return NULL;
+}
+
+static bool accept(struct arith_parser *parser, const char *op)
+{
+	const char *next = peek_operator(parser);
+
+	if (!next || strcmp(next, op))
+		return false;
+	parser->p += strlen(op);
+	return true;
+}
+
+static void expect(struct arith_parser *parser, const char *op)
+{
+	if (!accept(parser, op))
+		RAISE(ERROR_SYNTAX, "Arithmetic: expected \"%s\"", op);
+}
+
+static const struct binary_operator {
+	const char *token;
+	int precedence;
+	enum arith_op op;
+} binary_operators[] = {
+	{ "||", 1, ARITH_OR_JUMP }, { "&&", 2, ARITH_AND_JUMP },
+	{ "|", 3, ARITH_BITOR },    { "^", 4, ARITH_BITXOR },
+	{ "&", 5, ARITH_BITAND },   { "==", 6, ARITH_EQ },
+	{ "!=", 6, ARITH_NE },	    { "<", 7, ARITH_LT },
+	{ "<=", 7, ARITH_LE },	    { ">", 7, ARITH_GT },
+	{ ">=", 7, ARITH_GE },	    { "<<", 8, ARITH_SHL },
+	{ ">>", 8, ARITH_SHR },	    { "+", 9, ARITH_ADD },
+	{ "-", 9, ARITH_SUB },	    { "*", 10, ARITH_MUL },
+	{ "/", 10, ARITH_DIV },	    { "%", 10, ARITH_MOD },
+	{ "**", 11, ARITH_POW },
+};
+
+static const struct binary_operator *peek_binary(struct arith_parser *parser)
+{
+	const char *op = peek_operator(parser);
+
+	if (!op)
+		return NULL;
+	for (size_t i = 0; i < ARRAY_SIZE(binary_operators); i++) {
+		if (!strcmp(binary_operators[i].token, op))
+			return &binary_operators[i];
+	}
+	return NULL;
+}
+
+static struct node *parse_ternary(struct arith_parser *parser);
+
+static bool is_name_char(char c)
+{
+	return isalnum(c) || c == '_';
+}
+
+static struct node *parse_primary(struct arith_parser *parser)
+{
+	const char *start;
+	struct node *node;
+	bool braced = false;
+	bool dollar = false;
+
+	if (accept(parser, "(")) {
+		node = parse_ternary(parser);
+		expect(parser, ")");
+		return node;
+	}
+
+	skip_space(parser);
+	if (parser->p < parser->end && *parser->p == '$') {
+		parser->p++;
+		dollar = true;
+		if (parser->p < parser->end && *parser->p == '(') {
+			/* A nested $(( )) is just a parenthesized expression */
+			if (parser->end - parser->p < 2 || parser->p[1] != '(')
+				RAISE(ERROR_SYNTAX, "Arithmetic: command "
+						    "substitution is not "
+						    "supported");
+			return parse_primary(parser);
+		}
+		if (parser->p < parser->end && *parser->p == '{') {
+			parser->p++;
+			braced = true;
+		}
+	}
+
+	start = parser->p;
+	if (dollar && parser->p < parser->end &&
+	    (*parser->p == '?' || (!braced && isdigit(*parser->p)))) {
+		/* $? and $1 are one character, as in words; ${10} is not */
+		parser->p++;
+	} else {
+		while (parser->p < parser->end && is_name_char(*parser->p))
+			parser->p++;
+	}
+	if (parser->p == start)
+		RAISE(ERROR_SYNTAX, "Arithmetic: expected an operand");
+
+	if (!dollar && isdigit(*start)) {
+		char *digits = arena_malloc(parser->arena, sizeof(char),
+					    parser->p - start + 1);
+		char *end;
+
+		memcpy(digits, start, parser->p - start);
+		digits[parser->p - start] = '\0';
+		node = number(parser, strtoll(digits, &end, 0));
+		if (*end)
+			RAISE(ERROR_SYNTAX, "Arithmetic: invalid number %s",
+			      digits);
+	} else {
+		node = new_node(parser, NODE_VARIABLE);
+		node->type = NODE_VARIABLE;
+		node->name = start;
+		node->name_len = parser->p - start;
+	}
+
+	if (braced && (parser->p == parser->end || *parser->p++ != '}'))
+		RAISE(ERROR_SYNTAX, "Arithmetic: missing }");
+	return node;
+}
+
+static struct node *parse_unary(struct arith_parser *parser)
+{
+	if (accept(parser, "-"))
+		return make_unary(parser, ARITH_NEG, parse_unary(parser));
+	if (accept(parser, "+"))
+		return parse_unary(parser);
+	if (accept(parser, "!"))
+		return make_unary(parser, ARITH_NOT, parse_unary(parser));
+	if (accept(parser, "~"))
+		return make_unary(parser, ARITH_BITNOT, parse_unary(parser));
+	return parse_primary(parser);
+}
+
+static struct node *parse_binary(struct arith_parser *parser,
+				 int min_precedence)
+{
+	struct node *lhs = parse_unary(parser);
+	const struct binary_operator *bop;
+
+	while ((bop = peek_binary(parser)) &&
+	       bop->precedence >= min_precedence) {
+		/* ** is right associative */
+		int next = bop->op == ARITH_POW ? bop->precedence :
+						  bop->precedence + 1;
+
+		parser->p += strlen(bop->token);
+		lhs = make_binary(parser, bop->op, lhs,
+				  parse_binary(parser, next));
+	}
+	return lhs;
+}
+
+static struct node *parse_ternary(struct arith_parser *parser)
+{
+	struct node *cond = parse_binary(parser, 1);
+	struct node *node;
+
+	if (!accept(parser, "?"))
+		return cond;
+
+	node = new_node(parser, NODE_TERNARY);
+	node->type = NODE_TERNARY;
+	node->a = parse_ternary(parser);
+	expect(parser, ":");
+	node->b = parse_ternary(parser);
+
+	if (cond->type == NODE_NUMBER)
+		return cond->value ? node->a : node->b;
+	node->c = cond;
+	return node;
+}
+
+struct compiler {
+	unsigned char *code;
+	size_t code_size;
+	size_t code_capacity;
+	struct node **slots;
+	size_t slot_count;
+	size_t depth;
+	size_t max_depth;
+};
+
+static void emit(struct compiler *c, const void *buf, size_t len)
+{
+	if (c->code_size + len > c->code_capacity) {
+		c->code_capacity = (c->code_size + len) * 2;
+		c->code = checked_realloc(c->code, sizeof(char),
+					  c->code_capacity);
+	}
+	memcpy(c->code + c->code_size, buf, len);
+	c->code_size += len;
+}
+
+static void emit_op(struct compiler *c, enum arith_op op)
+{
+	unsigned char byte = op;
+
+	emit(c, &byte, 1);
+}
+
+static void adjust_depth(struct compiler *c, int delta)
+{
+	c->depth += delta;
+	if (c->depth > c->max_depth)
+		c->max_depth = c->depth;
+}
+
+/* Emit a jump, returning where its target is to be patched */
+static size_t emit_jump(struct compiler *c, enum arith_op op)
+{
+	uint32_t target = 0;
+
+	emit_op(c, op);
+	emit(c, &target, sizeof(target));
+	return c->code_size - sizeof(target);
+}
+
+static void patch_jump(struct compiler *c, size_t at)
+{
+	uint32_t target = c->code_size;
+
+	memcpy(c->code + at, &target, sizeof(target));
+}
+
+static uint16_t slot_for(struct compiler *c, struct node *var)
+{
+	size_t i;
+
+	for (i = 0; i < c->slot_count; i++) {
+		if (c->slots[i]->name_len == var->name_len &&
+		    !memcmp(c->slots[i]->name, var->name, var->name_len))
+			return i;
+	}
+	if (i > UINT16_MAX)
+		RAISE(ERROR_OVERFLOW, "Arithmetic: too many variables");
+	c->slots = checked_realloc(c->slots, sizeof(struct node *), i + 1);
+	c->slots[c->slot_count++] = var;
+	return i;
+}
+
+static void compile(struct compiler *c, struct node *node)
+{
+	size_t first_jump, second_jump;
+	uint16_t slot;
+
+	switch (node->type) {
+	case NODE_NUMBER:
+		emit_op(c, ARITH_PUSH);
+		emit(c, &node->value, sizeof(node->value));
+		adjust_depth(c, 1);
+		break;
+	case NODE_VARIABLE:
+		slot = slot_for(c, node);
+		emit_op(c, ARITH_LOAD);
+		emit(c, &slot, sizeof(slot));
+		adjust_depth(c, 1);
+		break;
+	case NODE_UNARY:
+		compile(c, node->a);
+		emit_op(c, node->op);
+		break;
+	case NODE_BINARY:
+		compile(c, node->a);
+		compile(c, node->b);
+		emit_op(c, node->op);
+		adjust_depth(c, -1);
+		break;
+	case NODE_AND:
+	case NODE_OR:
+		compile(c, node->a);
+		first_jump = emit_jump(c, node->op);
+		adjust_depth(c, -1);
+		compile(c, node->b);
+		emit_op(c, ARITH_BOOL);
+		patch_jump(c, first_jump);
+		break;
+	case NODE_TERNARY:
+		compile(c, node->c);
+		first_jump = emit_jump(c, ARITH_JUMP_ZERO);
+		adjust_depth(c, -1);
+		compile(c, node->a);
+		second_jump = emit_jump(c, ARITH_JUMP);
+		adjust_depth(c, -1);
+		patch_jump(c, first_jump);
+		compile(c, node->b);
+		patch_jump(c, second_jump);
+		break;
+	}
+}
+
+static struct arith_program *pack(struct compiler *c, const char *text,
+				  size_t len)
+{
+	size_t names_size = 0;
+	size_t size;
+	struct arith_program *prog;
+	struct arith_slot *slots;
+	char *names;
+
+	for (size_t i = 0; i < c->slot_count; i++)
+		names_size += c->slots[i]->name_len;
+	size = sizeof(struct arith_program) +
+	       c->slot_count * sizeof(struct arith_slot) + c->code_size +
+	       names_size + len;
+	if (size > UINT32_MAX || c->max_depth > UINT16_MAX)
+		RAISE(ERROR_OVERFLOW, "Arithmetic: expression too large");
+
+	prog = checked_malloc(size, 1);
+	prog->size = size;
+	prog->code_size = c->code_size;
+	prog->names_size = names_size;
+	prog->source_size = len;
+	prog->slot_count = c->slot_count;
+	prog->max_stack = c->max_depth;
+
+	slots = (struct arith_slot *)prog->data;
+	memcpy((unsigned char *)program_code(prog), c->code, c->code_size);
+	names = (char *)program_names(prog);
+	names_size = 0;
+	for (size_t i = 0; i < c->slot_count; i++) {
+		slots[i].name_offset = names_size;
+		slots[i].name_len = c->slots[i]->name_len;
+		memcpy(names + names_size, c->slots[i]->name,
+		       c->slots[i]->name_len);
+		names_size += c->slots[i]->name_len;
+	}
+	if (len)
+		memcpy(names + names_size, text, len);
+	return prog;
+}
+
+struct arith_program *arith_compile(const char *text, size_t len)
+{
+	struct arena arena = { NULL };
+	struct arith_parser parser = {
+		.p = text,
+		.end = text + len,
+		.arena = &arena,
+	};
+	struct compiler c = { NULL };
+	struct arith_program *prog;
+	struct node *tree;
+	struct error error;
+
+	if (GET_ERROR(&error)) {
+		free(c.code);
+		free(c.slots);
+		arena_free(&arena);
+		reraise(&error);
+	}
+
+	skip_space(&parser);
+	if (parser.p == parser.end) {
+		/* $(( )) is zero */
+		tree = number(&parser, 0);
+	} else {
+		tree = parse_ternary(&parser);
+		skip_space(&parser);
+		if (parser.p != parser.end)
+			RAISE(ERROR_SYNTAX,
+			      "Arithmetic: unexpected \"%.*s\"",
+			      (int)(parser.end - parser.p), parser.p);
+	}
+
+	compile(&c, tree);
+	prog = pack(&c, text, len);
+
+	exit_error_handler(&error);
+	free(c.code);
+	free(c.slots);
+	arena_free(&arena);
+	return prog;
+}
+
+static int64_t load(const struct arith_program *prog, uint16_t slot,
+		    const char *(*lookup)(void *data, const char *name,
+					  size_t len),
+		    void *data)
+{
+	const struct arith_slot *s = &program_slots(prog)[slot];
+	const char *name = program_names(prog) + s->name_offset;
+	const char *value = lookup(data, name, s->name_len);
+	char *end;
+	int64_t result;
+
+	if (!value)
+		return 0;
+	while (isspace(*value))
+		value++;
+	if (!*value)
+		return 0;
+
+	result = strtoll(value, &end, 0);
+	while (isspace(*end))
+		end++;
+	if (*end)
+		RAISE(ERROR_INVALID_ARGUMENT, "%.*s: not a number: %s",
+		      (int)s->name_len, name, value);
+	return result;
+}
+
+int64_t arith_eval(const struct arith_program *program,
+		   const char *(*lookup)(void *data, const char *name,
+					 size_t len),
+		   void *data)
+{
+	int64_t stack[program->max_stack ? program->max_stack : 1];
+	const unsigned char *code = program_code(program);
+	size_t sp = 0;
+	size_t pc = 0;
+
+	while (pc < program->code_size) {
+		enum arith_op op = code[pc++];
+		uint32_t target;
+		uint16_t slot;
+
+		switch (op) {
+		case ARITH_PUSH:
+			memcpy(&stack[sp++], code + pc, sizeof(int64_t));
+			pc += sizeof(int64_t);
+			break;
+		case ARITH_LOAD:
+			memcpy(&slot, code + pc, sizeof(slot));
+			pc += sizeof(slot);
+			stack[sp++] = load(program, slot, lookup, data);
+			break;
+		case ARITH_NEG:
+		case ARITH_NOT:
+		case ARITH_BITNOT:
+		case ARITH_BOOL:
+			stack[sp - 1] = apply_unary(op, stack[sp - 1]);
+			break;
+		case ARITH_AND_JUMP:
+		case ARITH_OR_JUMP:
+		case ARITH_JUMP_ZERO:
+		case ARITH_JUMP:
+			memcpy(&target, code + pc, sizeof(target));
+			pc += sizeof(target);
+			if (op == ARITH_JUMP) {
+				pc = target;
+			} else if (op == ARITH_JUMP_ZERO) {
+				if (!stack[--sp])
+					pc = target;
+			} else if (!stack[sp - 1] == (op == ARITH_AND_JUMP)) {
+				stack[sp - 1] = op == ARITH_OR_JUMP;
+				pc = target;
+			} else {
+				sp--;
+			}
+			break;
+		default:
+			sp--;
+			stack[sp - 1] = apply_binary(op, stack[sp - 1],
+						     stack[sp]);
+			break;
+		}
+	}
+
+	CHECK(sp == 1);
+	return stack[0];
+}
+
+static const char *table_lookup(void *vars, const char *name, size_t len)
+{
+	if (len == 1 && *name == '?')
+		return "3";
+	return variable_sized_get(vars, name, len);
+}
+
+static int64_t eval_text(const char *text, struct variable_table *vars)
+{
+	struct arith_program *prog = arith_compile(text, strlen(text));
+	int64_t result = arith_eval(prog, table_lookup, vars);
+
+	free(prog);
+	return result;
+}
+
+DEFTEST("arith.eval")
+{
+	struct variable_table *vars = variable_table_new();
+
+	variable_set(vars, "x", "41");
+	variable_set(vars, "zero", "0");
+	variable_set(vars, "hex", " 0x10 ");
+
+	EXPECT(eval_text("1 + 2 * 3", vars) == 7);
+	EXPECT(eval_text("(1 + 2) * 3", vars) == 9);
+	EXPECT(eval_text("2 ** 3 ** 2", vars) == 512);
+	/* Huge exponents, folded at compile time, wrap without looping */
+	EXPECT(eval_text("3 ** 4000000000", vars) == -1463247462748512255);
+	EXPECT(eval_text("-1 ** 9223372036854775807", vars) == -1);
+	EXPECT(eval_text("zero ? 3 ** 9223372036854775807 : 2 ** 64", vars) ==
+	       0);
+	EXPECT(eval_text("-7 / 2 + -7 % 3", vars) == -4);
+	EXPECT(eval_text("x + 1", vars) == 42);
+	EXPECT(eval_text("$x + ${x} + unset", vars) == 82);
+	EXPECT(eval_text("hex << 1", vars) == 32);
+	EXPECT(eval_text("x > 40 ? 10 : 20", vars) == 10);
+	EXPECT(eval_text("!x || ~x == -42", vars) == 1);
+	EXPECT(eval_text("1 < 2 && 2 <= 2 && 3 != 4 && 5 >= 6", vars) == 0);
+	EXPECT(eval_text("(6 & 3) | (6 ^ 3)", vars) == 7);
+	EXPECT(eval_text("zero && 1 / zero", vars) == 0);
+	EXPECT(eval_text("x || 1 / zero", vars) == 1);
+	EXPECT(eval_text("$((x)) - 1", vars) == 40);
+	EXPECT(eval_text("  ", vars) == 0);
+
+	/* Positional and special parameters are looked up, not numbers */
+	variable_set(vars, "1", "5");
+	variable_set(vars, "10", "7");
+	EXPECT(eval_text("$1 + 1", vars) == 6);
+	EXPECT(eval_text("${10} + ${1}", vars) == 12);
+	EXPECT(eval_text("$? * 2 + ${?}", vars) == 9);
+	EXPECT(eval_text("1 + $2", vars) == 1);
+
+	EXPECT_RAISES(ERROR_INVALID_ARGUMENT, eval_text("x / zero", vars));
+	variable_set(vars, "bad", "12abc");
+	EXPECT_RAISES(ERROR_INVALID_ARGUMENT, eval_text("bad + 1", vars));
+	variable_table_free(vars);
+}
+
+DEFTEST("arith.syntax")
+{
+	EXPECT_RAISES(ERROR_SYNTAX, free(arith_compile("1 +", 3)));
+	EXPECT_RAISES(ERROR_SYNTAX, free(arith_compile("(1", 2)));
+	EXPECT_RAISES(ERROR_SYNTAX, free(arith_compile("1 2", 3)));
+	EXPECT_RAISES(ERROR_SYNTAX, free(arith_compile("09", 2)));
+	EXPECT_RAISES(ERROR_SYNTAX, free(arith_compile("$(ls)", 5)));
+}
+
+DEFTEST("arith.fold")
+{
+	struct arith_program *prog;
+	size_t len;
+
+	/* Constants fold to a single push */
+	prog = arith_compile("(1 + 2) * 3 << 1", 16);
+	EXPECT(prog->code_size == 1 + sizeof(int64_t));
+	EXPECT(arith_eval(prog, NULL, NULL) == 18);
+	EXPECT(!memcmp(arith_program_source(prog, &len), "(1 + 2) * 3", 11));
+	EXPECT(len == 16);
+	free(prog);
+
+	prog = arith_compile("0 && y", 6);
+	EXPECT(prog->slot_count == 0);
+	free(prog);
+
+	/* Division by zero is left for run time */
+	prog = arith_compile("1 / 0", 5);
+	EXPECT(prog->code_size > 1 + sizeof(int64_t));
+	free(prog);
+
+	/* Repeated variables share a slot */
+	prog = arith_compile("i * i + i", 9);
+	EXPECT(prog->slot_count == 1);
+	free(prog);
+}
@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alias.h"
+#include "arena.h"
+#include "error.h"
+#include "interpreter.h"
+#include "shell_builtins.h"
+#include "string_builder.h"
+#include "unit.h"
+
+struct alias_listing {
+	const char **names;
+	size_t count;
+	size_t capacity;
+};
+
+static void collect_alias(const char *name, const char *replacement,
+			  void *data)
+{
+	struct alias_listing *listing = data;
+
+	if (listing->count == listing->capacity) {
+		listing->capacity =
+			listing->capacity ? listing->capacity * 2 : 16;
+		listing->names = checked_realloc(listing->names,
+						 sizeof(const char *),
+						 listing->capacity);
+	}
+	listing->names[listing->count++] = name;
+}
+
+static int compare_names(const void *a, const void *b)
+{
+	return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+/* Append name='replacement', quoted so it can be read back in */
+static void append_definition(struct string_builder *sb, const char *name,
+			      const char *replacement)
+{
+	string_builder_append(sb, "alias ");
+	string_builder_append(sb, name);
+	string_builder_append(sb, "='");
+	for (const char *p = replacement; *p;) {
+		size_t len = strcspn(p, "'");
+
+		string_builder_sized_append(sb, p, len);
+		p += len;
+		if (*p) {
+			string_builder_append(sb, "'\\''");
+			p++;
+		}
+	}
+	string_builder_append(sb, "'\n");
+}
+
+static int alias_builtin(struct interpreter_state *state,
+			 const char *const *argv, int input_fd, int output_fd,
+			 int error_fd)
+{
+	struct arena arena = { NULL };
+	struct string_builder *sb;
+	int status = 0;
+
+	if (!state->aliases_enabled) {
+		dprintf(error_fd, "%s: aliases are disabled\n", argv[0]);
+		return 1;
+	}
+
+	sb = string_builder_new(&arena);
+	if (!argv[1]) {
+		struct alias_listing listing = { NULL };
+
+		alias_foreach(state->commands, collect_alias, &listing);
+		if (listing.count)
+			qsort(listing.names, listing.count,
+			      sizeof(const char *), compare_names);
+		for (size_t i = 0; i < listing.count; i++)
+			append_definition(sb, listing.names[i],
+					  alias_get(state->commands,
+						    listing.names[i]));
+		free(listing.names);
+	}
+
+	for (size_t i = 1; argv[i]; i++) {
+		const char *eq = strchr(argv[i], '=');
+		const char *replacement;
+
+		if (eq) {
+			char *name = arena_malloc(&arena, sizeof(char),
+						  eq - argv[i] + 1);
+
+			memcpy(name, argv[i], eq - argv[i]);
+			name[eq - argv[i]] = '\0';
+			alias_set(state->commands, name, eq + 1);
+			continue;
+		}
+
+		replacement = alias_get(state->commands, argv[i]);
+		if (replacement) {
+			append_definition(sb, argv[i], replacement);
+		} else {
+			dprintf(error_fd, "%s: %s: not found\n", argv[0],
+				argv[i]);
+			status = 1;
+		}
+	}
+
+	builtin_write(state, output_fd, string_builder_finalize(sb),
+		      string_builder_length(sb));
+	arena_free(&arena);
+	return status;
+}
+DEFINE_BUILTIN_COMMAND_FLAGS("alias", alias_builtin,
+			     BUILTIN_PURE_WITHOUT_ARGS);
+
+static int unalias_builtin(struct interpreter_state *state,
+			   const char *const *argv, int input_fd, int output_fd,
+			   int error_fd)
+{
+	if (!state->aliases_enabled) {
+		dprintf(error_fd, "%s: aliases are disabled\n", argv[0]);
+		return 1;
+	}
+	if (!argv[1]) {
+		dprintf(error_fd, "%s: usage: %s name [name ...]\n", argv[0],
+			argv[0]);
+		return 1;
+	}
+
+	for (size_t i = 1; argv[i]; i++)
+		alias_unset(state->commands, argv[i]);
+	return 0;
+}
+DEFINE_BUILTIN_COMMAND("unalias", unalias_builtin);
+
+DEFTEST("builtins.alias.list")
+{
+	struct interpreter_state *state = interpreter_new(true);
+	struct arena arena = { NULL };
+	const char *const set[] = { "alias", "ll=ls -l", "q=it's", NULL };
+	const char *const list[] = { "alias", NULL };
+
+	EXPECT(alias_builtin(state, set, 0, 1, 2) == 0);
+	state->capture = string_builder_new(&arena);
+	EXPECT(alias_builtin(state, list, 0, BUILTIN_CAPTURE_FD, 2) == 0);
+	EXPECT(!strcmp(string_builder_finalize(state->capture),
+		       "alias ll='ls -l'\nalias q='it'\\''s'\n"));
+	arena_free(&arena);
+	interpreter_free(state);
+}
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "cwd.h"
+#include "interpreter.h"
+#include "prompt.h"
+#include "shell_builtins.h"
+#include "variables.h"
+
+/* Set $PWD and $OLDPWD after the working directory has changed */
+static void update_pwd(struct interpreter_state *state, const char *old)
+{
+	const char *cwd = cwd_path(state->cwd);
+
+	variable_set(state->variables, "OLDPWD", old);
+	variable_set(state->variables, "PWD", cwd);
+	if (state->prompt)
+		prompt_set_cwd(state->prompt, cwd);
+}
+
+static void print_stack(struct interpreter_state *state, int output_fd)
+{
+	struct cwd *cwd = state->cwd;
+
+	builtin_printf(state, output_fd, "%s", cwd_path(cwd));
+	for (size_t i = 0; i < cwd_stack_count(cwd); i++)
+		builtin_printf(state, output_fd, " %s", cwd_stack_path(cwd, i));
+	builtin_printf(state, output_fd, "\n");
+}
+
+static int cd_builtin(struct interpreter_state *state,
+		      const char *const *argv, int input_fd, int output_fd,
+		      int error_fd)
+{
+	const char *target = argv[1];
+	char old[strlen(cwd_path(state->cwd)) + 1];
+
+	if (argv[1] && argv[2]) {
+		dprintf(error_fd, "%s: too many arguments\n", argv[0]);
+		return 1;
+	}
+
+	if (!target) {
+		target = variable_get(state->variables, "HOME");
+		if (!target) {
+			dprintf(error_fd, "%s: HOME not set\n", argv[0]);
+			return 1;
+		}
+	} else if (!strcmp(target, "-")) {
+		target = variable_get(state->variables, "OLDPWD");
+		if (!target) {
+			dprintf(error_fd, "%s: OLDPWD not set\n", argv[0]);
+			return 1;
+		}
+		builtin_printf(state, output_fd, "%s\n", target);
+	}
+
+	strcpy(old, cwd_path(state->cwd));
+	if (!cwd_change(state->cwd, target)) {
+		dprintf(error_fd, "%s: %s: %m\n", argv[0], target);
+		return 1;
+	}
+	update_pwd(state, old);
+	return 0;
+}
+DEFINE_BUILTIN_COMMAND("cd", cd_builtin);
+
+static int pushd_builtin(struct interpreter_state *state,
+			 const char *const *argv, int input_fd, int output_fd,
+			 int error_fd)
+{
+	char old[strlen(cwd_path(state->cwd)) + 1];
+	bool ok;
+
+	if (argv[1] && argv[2]) {
+		dprintf(error_fd, "%s: too many arguments\n", argv[0]);
+		return 1;
+	}
+	if (!argv[1] && !cwd_stack_count(state->cwd)) {
+		dprintf(error_fd, "%s: no other directory\n", argv[0]);
+		return 1;
+	}
+
+	strcpy(old, cwd_path(state->cwd));
+	/* With no arguments, exchange the top two directories */
+	ok = argv[1] ? cwd_push(state->cwd, argv[1]) :
+		       cwd_pop(state->cwd, true);
+	if (!ok) {
+		dprintf(error_fd, "%s: %s: %m\n", argv[0],
+			argv[1] ? argv[1] : cwd_stack_path(state->cwd, 0));
+		return 1;
+	}
+	update_pwd(state, old);
+	print_stack(state, output_fd);
+	return 0;
+}
+DEFINE_BUILTIN_COMMAND("pushd", pushd_builtin);
+
+static int popd_builtin(struct interpreter_state *state,
+			const char *const *argv, int input_fd, int output_fd,
+			int error_fd)
+{
+	char old[strlen(cwd_path(state->cwd)) + 1];
+
+	if (argv[1]) {
+		dprintf(error_fd, "%s: too many arguments\n", argv[0]);
+		return 1;
+	}
+	if (!cwd_stack_count(state->cwd)) {
+		dprintf(error_fd, "%s: directory stack empty\n", argv[0]);
+		return 1;
+	}
+
+	strcpy(old, cwd_path(state->cwd));
+	if (!cwd_pop(state->cwd, false)) {
+		dprintf(error_fd, "%s: %s: %m\n", argv[0],
+			cwd_stack_path(state->cwd, 0));
+		return 1;
+	}
+	update_pwd(state, old);
+	print_stack(state, output_fd);
+	return 0;
+}
+DEFINE_BUILTIN_COMMAND("popd", popd_builtin);
+
+static int dirs_builtin(struct interpreter_state *state,
+			const char *const *argv, int input_fd, int output_fd,
+			int error_fd)
+{
+	if (argv[1]) {
+		dprintf(error_fd, "%s: too many arguments\n", argv[0]);
+		return 1;
+	}
+	print_stack(state, output_fd);
+	return 0;
+}
+DEFINE_BUILTIN_COMMAND_FLAGS("dirs", dirs_builtin, BUILTIN_PURE);
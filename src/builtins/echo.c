@@ -0,0 +1,46 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "arena.h"
+#include "error.h"
+#include "interpreter.h"
+#include "shell_builtins.h"
+#include "string_builder.h"
+#include "unit.h"
+
+static int echo_builtin(struct interpreter_state *state,
+			const char *const *argv, int input_fd, int output_fd,
+			int error_fd)
+{
+	struct arena arena = { NULL };
+	struct string_builder *sb = string_builder_new(&arena);
+	bool newline = true;
+	size_t i = 1;
+
+	if (argv[1] && !strcmp(argv[1], "-n")) {
+		newline = false;
+		i++;
+	}
+
+	for (; argv[i]; i++) {
+		string_builder_append(sb, argv[i]);
+		if (argv[i + 1])
+			string_builder_append(sb, " ");
+	}
+	if (newline)
+		string_builder_append(sb, "\n");
+
+	/* A single write, so output into a pipe is not interleaved */
+	builtin_write(state, output_fd, string_builder_finalize(sb),
+		      string_builder_length(sb));
+	arena_free(&arena);
+	return 0;
+}
+DEFINE_BUILTIN_COMMAND_FLAGS("echo", echo_builtin, BUILTIN_PURE);
+
+DEFTEST("builtins.echo.registered")
+{
+	struct builtin_command *command = builtin_command_get("echo");
+	ASSERT_NOT_NULL(command);
+	EXPECT(command->function == echo_builtin);
+}
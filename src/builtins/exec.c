@@ -0,0 +1,23 @@
+#include "interpreter.h"
+#include "shell_builtins.h"
+
+/*
+ * exec replaces the shell by the command given, which inherits the
+ * shell's process. With no command, there is nothing to do: redirections
+ * are not kept for the rest of the shell's life.
+ */
+static int exec_builtin(struct interpreter_state *state,
+			const char *const *argv, int input_fd, int output_fd,
+			int error_fd)
+{
+	const struct io_fds fds = {
+		.input_fd = input_fd,
+		.output_fd = output_fd,
+		.error_fd = error_fd,
+	};
+
+	if (!argv[1])
+		return 0;
+	return interpreter_exec(state, (char **)argv + 1, &fds);
+}
+DEFINE_BUILTIN_COMMAND("exec", exec_builtin);
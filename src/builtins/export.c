@@ -0,0 +1,77 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "interpreter.h"
+#include "shell_builtins.h"
+#include "variables.h"
+
+static bool is_name(const char *name, size_t len)
+{
+	if (!len || (name[0] >= '0' && name[0] <= '9'))
+		return false;
+	for (size_t i = 0; i < len; i++) {
+		char c = name[i];
+
+		if (!(c == '_' || (c >= 'a' && c <= 'z') ||
+		      (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')))
+			return false;
+	}
+	return true;
+}
+
+/*
+ * export NAME=value sets and exports NAME. export NAME exports it with
+ * whatever value it has, or marks it to be exported once it is set.
+ */
+static int export_builtin(struct interpreter_state *state,
+			  const char *const *argv, int input_fd, int output_fd,
+			  int error_fd)
+{
+	int status = 0;
+
+	for (size_t i = 1; argv[i]; i++) {
+		const char *eq = strchr(argv[i], '=');
+		size_t len = eq ? (size_t)(eq - argv[i]) : strlen(argv[i]);
+		char *name;
+
+		if (!is_name(argv[i], len)) {
+			dprintf(error_fd, "%s: %s: not a valid identifier\n",
+				argv[0], argv[i]);
+			status = 1;
+			continue;
+		}
+		name = checked_strdup(argv[i]);
+		name[len] = '\0';
+		if (eq)
+			variable_set(state->variables, name, eq + 1);
+		variable_export(state->variables, name);
+		free(name);
+	}
+	return status;
+}
+DEFINE_BUILTIN_COMMAND("export", export_builtin);
+
+static int unset_builtin(struct interpreter_state *state,
+			 const char *const *argv, int input_fd, int output_fd,
+			 int error_fd)
+{
+	int status = 0;
+	size_t i = 1;
+
+	if (argv[i] && !strcmp(argv[i], "-v"))
+		i++;
+	for (; argv[i]; i++) {
+		if (!is_name(argv[i], strlen(argv[i]))) {
+			dprintf(error_fd, "%s: %s: not a valid identifier\n",
+				argv[0], argv[i]);
+			status = 1;
+			continue;
+		}
+		variable_unset(state->variables, argv[i]);
+	}
+	return status;
+}
+DEFINE_BUILTIN_COMMAND("unset", unset_builtin);
@@ -0,0 +1,40 @@
+#include <stdio.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "error.h"
+#include "history_log.h"
+#include "interpreter.h"
+#include "shell_builtins.h"
+#include "string_builder.h"
+
+static int history_builtin(struct interpreter_state *state,
+			   const char *const *argv, int input_fd, int output_fd,
+			   int error_fd)
+{
+	struct history_log *log = state->history;
+	struct arena arena = { NULL };
+	struct string_builder *sb;
+
+	if (argv[1]) {
+		dprintf(error_fd, "%s: too many arguments\n", argv[0]);
+		return 1;
+	}
+	if (!log)
+		return 0;
+
+	sb = string_builder_new(&arena);
+	for (size_t i = 0; i < history_log_count(log); i++) {
+		char *number = arena_malloc(&arena, sizeof(char), 32);
+
+		snprintf(number, 32, "%5zu  ", i + 1);
+		string_builder_append(sb, number);
+		string_builder_append(sb, history_log_get(log, i));
+		string_builder_append(sb, "\n");
+	}
+	builtin_write(state, output_fd, string_builder_finalize(sb),
+		      string_builder_length(sb));
+	arena_free(&arena);
+	return 0;
+}
+DEFINE_BUILTIN_COMMAND_FLAGS("history", history_builtin, BUILTIN_PURE);
@@ -0,0 +1,146 @@
+#include <signal.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "interpreter.h"
+#include "jobs.h"
+#include "shell_builtins.h"
+
+static int jobs_builtin(struct interpreter_state *state,
+			const char *const *argv, int input_fd, int output_fd,
+			int error_fd)
+{
+	struct job_table *table = state->jobs;
+	char buf[1024];
+
+	if (argv[1]) {
+		dprintf(error_fd, "%s: too many arguments\n", argv[0]);
+		return 1;
+	}
+
+	jobs_reap(table);
+	for (size_t i = 0; i < table->count;) {
+		struct job *job = table->jobs[i];
+
+		builtin_printf(state, output_fd, "%s\n",
+			       job_describe(table, job, buf, sizeof(buf)));
+		/* Finished jobs are reported once */
+		if (job->state == JOB_DONE)
+			job_remove(table, job);
+		else
+			i++;
+	}
+	return 0;
+}
+DEFINE_BUILTIN_COMMAND("jobs", jobs_builtin);
+
+static int wait_builtin(struct interpreter_state *state,
+			const char *const *argv, int input_fd, int output_fd,
+			int error_fd)
+{
+	struct job_table *table = state->jobs;
+	int status = 0;
+
+	if (!argv[1]) {
+		while (table->count) {
+			job_wait(table, table->jobs[0], false);
+			job_remove(table, table->jobs[0]);
+		}
+		return 0;
+	}
+
+	for (size_t i = 1; argv[i]; i++) {
+		struct job *job = job_find(table, argv[i]);
+
+		if (!job) {
+			dprintf(error_fd, "%s: %s: no such job\n", argv[0],
+				argv[i]);
+			status = 127;
+			continue;
+		}
+		status = job_wait(table, job, false);
+		job_remove(table, job);
+	}
+	return status;
+}
+DEFINE_BUILTIN_COMMAND("wait", wait_builtin);
+
+static struct job *job_argument(struct interpreter_state *state,
+				const char *const *argv, int error_fd)
+{
+	struct job *job;
+
+	if (argv[1] && argv[2]) {
+		dprintf(error_fd, "%s: too many arguments\n", argv[0]);
+		return NULL;
+	}
+
+	jobs_reap(state->jobs);
+	job = argv[1] ? job_find(state->jobs, argv[1]) :
+			job_current(state->jobs);
+	if (!job)
+		dprintf(error_fd, "%s: %s: no such job\n", argv[0],
+			argv[1] ? argv[1] : "current");
+	return job;
+}
+
+/* Make pgid the foreground process group of the terminal on fd */
+static void set_foreground(int fd, pid_t pgid)
+{
+	sigset_t ttou, saved;
+
+	/* The shell may not be in the foreground when taking it back */
+	sigemptyset(&ttou);
+	sigaddset(&ttou, SIGTTOU);
+	sigprocmask(SIG_BLOCK, &ttou, &saved);
+	tcsetpgrp(fd, pgid);
+	sigprocmask(SIG_SETMASK, &saved, NULL);
+}
+
+static int fg_builtin(struct interpreter_state *state,
+		      const char *const *argv, int input_fd, int output_fd,
+		      int error_fd)
+{
+	struct job *job = job_argument(state, argv, error_fd);
+	bool terminal = isatty(input_fd);
+	int status;
+
+	if (!job)
+		return 1;
+
+	builtin_printf(state, output_fd, "%s\n", job->command);
+	if (terminal)
+		set_foreground(input_fd, job->pgid);
+	kill(-job->pgid, SIGCONT);
+	job->state = job->live ? JOB_RUNNING : JOB_DONE;
+
+	status = job_wait(state->jobs, job, true);
+	if (terminal)
+		set_foreground(input_fd, getpgrp());
+
+	if (job->state == JOB_DONE)
+		job_remove(state->jobs, job);
+	return status;
+}
+DEFINE_BUILTIN_COMMAND("fg", fg_builtin);
+
+static int bg_builtin(struct interpreter_state *state,
+		      const char *const *argv, int input_fd, int output_fd,
+		      int error_fd)
+{
+	struct job *job = job_argument(state, argv, error_fd);
+
+	if (!job)
+		return 1;
+	if (job->state != JOB_STOPPED) {
+		dprintf(error_fd, "%s: job %d is not stopped\n", argv[0],
+			job->id);
+		return 1;
+	}
+
+	kill(-job->pgid, SIGCONT);
+	job->state = JOB_RUNNING;
+	builtin_printf(state, output_fd, "[%d] %s &\n", job->id, job->command);
+	return 0;
+}
+DEFINE_BUILTIN_COMMAND("bg", bg_builtin);
@@ -0,0 +1,301 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/pidfd.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "capture.h"
+#include "error.h"
+#include "interpreter.h"
+#include "shell_builtins.h"
+#include "string_builder.h"
+
+/* The exit status reports at most this many failed jobs */
+#define PARALLEL_MAX_FAILED 101
+
+/*
+ * parallel [-j N] [-g] command [args...] ::: arg...
+ *
+ * Runs the command once per argument after :::, with at most N (by
+ * default, the number of online CPUs) running at once. Each {} in the
+ * command is replaced by the argument; if there is none, the argument
+ * is appended. With -g, the output of each job is buffered and
+ * written in one piece when it finishes, so that the output of
+ * different jobs is not interleaved.
+ *
+ * Children are watched through pidfds in an epoll set, along with
+ * their output pipes when grouping, so one epoll_wait() covers every
+ * running job. The exit status is the number of jobs which failed, up
+ * to PARALLEL_MAX_FAILED.
+ */
+
+struct parallel_slot {
+	bool in_use;
+	bool exited;
+	pid_t pid;
+	int pidfd;
+	/* The read end of the output pipe when grouping, or -1 */
+	int output_fd;
+	/* Holds the argv and buffered output of the job */
+	struct arena arena;
+	struct capture output;
+};
+
+struct parallel {
+	struct interpreter_state *interp;
+	const struct io_fds *fds;
+	bool group;
+	int epoll_fd;
+	struct parallel_slot *slots;
+	size_t slot_count;
+	size_t running;
+	size_t failed;
+};
+
+/* epoll data is the slot index, and whether the event is for output */
+#define EVENT_DATA(INDEX, OUTPUT) ((uint64_t)(INDEX) << 1 | (OUTPUT))
+
+static char *substitute(struct arena *arena, const char *word, const char *arg)
+{
+	struct string_builder *sb = string_builder_new(arena);
+	const char *braces;
+
+	while ((braces = strstr(word, "{}"))) {
+		string_builder_sized_append(sb, word, braces - word);
+		string_builder_append(sb, arg);
+		word = braces + 2;
+	}
+	string_builder_append(sb, word);
+	return string_builder_finalize(sb);
+}
+
+static char **job_argv(struct arena *arena, const char *const *command,
+		       size_t count, const char *arg)
+{
+	char **argv = arena_malloc(arena, sizeof(char *), count + 2);
+	bool substituted = false;
+
+	for (size_t i = 0; i < count; i++) {
+		substituted = substituted || strstr(command[i], "{}");
+		argv[i] = substitute(arena, command[i], arg);
+	}
+	argv[count] = substituted ? NULL : arena_strdup(arena, arg);
+	argv[count + 1] = NULL;
+	return argv;
+}
+
+static void watch(struct parallel *par, int fd, size_t index, bool output)
+{
+	struct epoll_event event = {
+		.events = EPOLLIN,
+		.data.u64 = EVENT_DATA(index, output),
+	};
+
+	CHECKP(epoll_ctl(par->epoll_fd, EPOLL_CTL_ADD, fd, &event));
+}
+
+/*
+ * Closing an fd is not enough to remove it from the epoll set while a
+ * child which has not yet exec'd still holds a copy of it.
+ */
+static void unwatch(struct parallel *par, int fd)
+{
+	CHECKP(epoll_ctl(par->epoll_fd, EPOLL_CTL_DEL, fd, NULL));
+	checked_close(fd);
+}
+
+static void start(struct parallel *par, size_t index,
+		  const char *const *command, size_t count, const char *arg)
+{
+	struct parallel_slot *slot = &par->slots[index];
+	struct io_fds fds = *par->fds;
+	char **argv;
+	int pipefd[2];
+
+	memset(slot, 0, sizeof(*slot));
+	slot->output.arena = &slot->arena;
+	slot->pidfd = -1;
+	slot->output_fd = -1;
+	argv = job_argv(&slot->arena, command, count, arg);
+
+	if (par->group) {
+		capture_pipe(pipefd);
+		fds.output_fd = pipefd[1];
+	}
+
+	slot->pid = interpreter_spawn(par->interp, argv, &fds);
+	slot->in_use = true;
+	par->running++;
+
+	if (par->group) {
+		checked_close(pipefd[1]);
+		slot->output_fd = pipefd[0];
+		CHECKP(fcntl(slot->output_fd, F_SETFL, O_NONBLOCK));
+		watch(par, slot->output_fd, index, true);
+	}
+	slot->pidfd = pidfd_open(slot->pid, 0);
+	CHECKP(slot->pidfd);
+	watch(par, slot->pidfd, index, false);
+}
+
+/* Write the output of a finished job and free its slot */
+static void finish(struct parallel *par, struct parallel_slot *slot)
+{
+	for (size_t i = 0; i < slot->output.count; i++)
+		builtin_write(par->interp, par->fds->output_fd,
+			      slot->output.chunks[i].data,
+			      slot->output.chunks[i].len);
+	arena_free(&slot->arena);
+	slot->in_use = false;
+	par->running--;
+}
+
+static void handle_event(struct parallel *par, uint64_t data)
+{
+	struct parallel_slot *slot = &par->slots[data >> 1];
+
+	if (data & 1) {
+		if (capture_read_available(&slot->output, slot->output_fd))
+			return;
+		unwatch(par, slot->output_fd);
+		slot->output_fd = -1;
+	} else {
+		unwatch(par, slot->pidfd);
+		slot->pidfd = -1;
+		if (interpreter_wait(par->interp, slot->pid))
+			par->failed++;
+		slot->exited = true;
+	}
+
+	if (slot->exited && slot->output_fd < 0)
+		finish(par, slot);
+}
+
+/* Kill and reap whatever is still running, after an error */
+static void abandon(struct parallel *par)
+{
+	for (size_t i = 0; i < par->slot_count; i++) {
+		struct parallel_slot *slot = &par->slots[i];
+
+		if (!slot->in_use)
+			continue;
+		if (!slot->exited) {
+			kill(slot->pid, SIGTERM);
+			interpreter_wait(par->interp, slot->pid);
+		}
+		if (slot->pidfd >= 0)
+			close(slot->pidfd);
+		if (slot->output_fd >= 0)
+			close(slot->output_fd);
+		arena_free(&slot->arena);
+	}
+}
+
+static void run(struct parallel *par, const char *const *command,
+		size_t count, const char *const *args)
+{
+	struct epoll_event events[64];
+
+	while (*args || par->running) {
+		int n;
+
+		for (size_t i = 0; *args && i < par->slot_count; i++) {
+			if (!par->slots[i].in_use)
+				start(par, i, command, count, *args++);
+		}
+
+		n = epoll_wait(par->epoll_fd, events, ARRAY_SIZE(events), -1);
+		if (n < 0 && errno == EINTR)
+			continue;
+		CHECKP(n);
+		for (int i = 0; i < n; i++)
+			handle_event(par, events[i].data.u64);
+	}
+}
+
+static int parse_jobs(const char *arg, int error_fd)
+{
+	char *end;
+	long jobs;
+
+	errno = 0;
+	jobs = strtol(arg, &end, 10);
+	if (!*arg || *end || errno || jobs <= 0 || jobs > 4096) {
+		dprintf(error_fd, "parallel: invalid job count: %s\n", arg);
+		return -1;
+	}
+	return jobs;
+}
+
+static int parallel_builtin(struct interpreter_state *state,
+			    const char *const *argv, int input_fd,
+			    int output_fd, int error_fd)
+{
+	const struct io_fds fds = { input_fd, output_fd, error_fd };
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	struct parallel par = {
+		.interp = state,
+		.fds = &fds,
+		/* -1 when the count is unknown */
+		.slot_count = cpus > 0 ? cpus : 1,
+	};
+	const char *const *command;
+	size_t count = 0;
+	struct error error;
+	int jobs;
+
+	for (argv++; *argv && (*argv)[0] == '-'; argv++) {
+		if (!strcmp(*argv, "-g")) {
+			par.group = true;
+		} else if (!strcmp(*argv, "-j") && argv[1]) {
+			if ((jobs = parse_jobs(*++argv, error_fd)) < 0)
+				return 2;
+			par.slot_count = jobs;
+		} else if (!strncmp(*argv, "-j", 2) && (*argv)[2]) {
+			if ((jobs = parse_jobs(*argv + 2, error_fd)) < 0)
+				return 2;
+			par.slot_count = jobs;
+		} else {
+			break;
+		}
+	}
+
+	command = argv;
+	while (command[count] && strcmp(command[count], ":::"))
+		count++;
+	if (!count || !command[count]) {
+		dprintf(error_fd, "usage: parallel [-j N] [-g] command "
+				  "[args...] ::: arg...\n");
+		return 2;
+	}
+	if (par.slot_count < 1)
+		par.slot_count = 1;
+
+	par.slots = checked_calloc(sizeof(struct parallel_slot),
+				   par.slot_count);
+	par.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+	if (GET_ERROR(&error)) {
+		abandon(&par);
+		if (par.epoll_fd >= 0)
+			close(par.epoll_fd);
+		free(par.slots);
+		reraise(&error);
+	}
+
+	CHECKP(par.epoll_fd);
+	run(&par, command, count, command + count + 1);
+
+	exit_error_handler(&error);
+	checked_close(par.epoll_fd);
+	free(par.slots);
+	return par.failed < PARALLEL_MAX_FAILED ? par.failed :
+						  PARALLEL_MAX_FAILED;
+}
+DEFINE_BUILTIN_COMMAND("parallel", parallel_builtin);
@@ -0,0 +1,12 @@
+#include "cwd.h"
+#include "interpreter.h"
+#include "shell_builtins.h"
+
+static int pwd_builtin(struct interpreter_state *state,
+		       const char *const *argv, int input_fd, int output_fd,
+		       int error_fd)
+{
+	builtin_printf(state, output_fd, "%s\n", cwd_path(state->cwd));
+	return 0;
+}
+DEFINE_BUILTIN_COMMAND_FLAGS("pwd", pwd_builtin, BUILTIN_PURE);
@@ -0,0 +1,190 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "error.h"
+#include "expand.h"
+#include "interpreter.h"
+#include "shell_builtins.h"
+#include "string_builder.h"
+#include "unit.h"
+#include "variables.h"
+
+static bool is_ifs(char c)
+{
+	return c && strchr(EXPAND_IFS, c);
+}
+
+/*
+ * Read up to the next newline, which is consumed but not kept. Without
+ * -r, a backslash before the newline continues the line, and other
+ * backslashes are kept for assign_fields() to act on.
+ *
+ * Only what belongs to the line may be taken from the file, so the rest
+ * is there for the next command. A file which can seek is read a block
+ * at a time and seeked back to just past the newline; anything else,
+ * such as a pipe, is read a byte at a time. Reads go straight into the
+ * arena, as the string builder keeps pointers to what it is given.
+ *
+ * Return: Whether the line ended with a newline rather than the end of
+ *         the file.
+ */
+static bool read_line(int fd, struct arena *arena, struct string_builder *sb,
+		      bool raw)
+{
+	size_t size = lseek(fd, 0, SEEK_CUR) == -1 ? 1 : 4096;
+	bool escaped = false;
+	size_t count;
+	char *buf;
+
+	for (;;) {
+		buf = arena_malloc(arena, sizeof(char), size);
+		count = checked_read(fd, buf, size);
+		if (!count)
+			break;
+
+		for (size_t i = 0; i < count; i++) {
+			if (buf[i] == '\n' && escaped) {
+				escaped = false;
+				continue;
+			}
+			if (escaped)
+				string_builder_append(sb, "\\");
+			escaped = false;
+
+			if (buf[i] == '\n') {
+				if (i + 1 < count)
+					lseek(fd, (off_t)(i + 1) - count,
+					      SEEK_CUR);
+				return true;
+			}
+			if (!raw && buf[i] == '\\')
+				escaped = true;
+			else
+				string_builder_sized_append(sb, &buf[i], 1);
+		}
+	}
+	if (escaped)
+		string_builder_append(sb, "\\");
+	return false;
+}
+
+/* Find the end of the field starting at line, which is not on IFS */
+static const char *field_end(const char *line, bool raw)
+{
+	for (; *line && !is_ifs(*line); line++) {
+		if (!raw && *line == '\\' && line[1])
+			line++;
+	}
+	return line;
+}
+
+/* Copy a field, with the character after each backslash taken as is */
+static char *unescape(struct arena *arena, const char *field, size_t size,
+		      bool raw)
+{
+	char *copy = arena_malloc(arena, sizeof(char), size + 1);
+	char *out = copy;
+
+	for (size_t i = 0; i < size; i++) {
+		if (!raw && field[i] == '\\' && i + 1 < size)
+			i++;
+		*out++ = field[i];
+	}
+	*out = '\0';
+	return copy;
+}
+
+/*
+ * Split the line into fields on IFS, one for each name but the last,
+ * which is given the rest of the line. Names left over are set empty.
+ */
+static void assign_fields(struct interpreter_state *state,
+			  struct arena *arena, const char *line,
+			  const char *const *names, bool raw)
+{
+	const char *end;
+
+	for (; *names; names++) {
+		while (is_ifs(*line))
+			line++;
+
+		if (names[1]) {
+			end = field_end(line, raw);
+		} else {
+			end = line + strlen(line);
+			while (end > line && is_ifs(end[-1]) &&
+			       (raw || end - 1 == line || end[-2] != '\\'))
+				end--;
+		}
+		variable_set(state->variables, *names,
+			     unescape(arena, line, end - line, raw));
+		line = end;
+	}
+}
+
+static int read_builtin(struct interpreter_state *state,
+			const char *const *argv, int input_fd, int output_fd,
+			int error_fd)
+{
+	static const char *const reply[] = { "REPLY", NULL };
+	struct arena arena = { NULL };
+	struct string_builder *sb = string_builder_new(&arena);
+	const char *const *names = argv + 1;
+	bool raw = false;
+	struct error error;
+	bool complete;
+
+	if (*names && !strcmp(*names, "-r")) {
+		raw = true;
+		names++;
+	}
+	if (*names && **names == '-') {
+		dprintf(error_fd, "%s: %s: invalid option\n", argv[0], *names);
+		return 2;
+	}
+	if (!*names)
+		names = reply;
+
+	if (GET_ERROR(&error)) {
+		arena_free(&arena);
+		reraise(&error);
+	}
+	complete = read_line(input_fd, &arena, sb, raw);
+	assign_fields(state, &arena, string_builder_finalize(sb), names, raw);
+	exit_error_handler(&error);
+
+	arena_free(&arena);
+	return complete ? 0 : 1;
+}
+DEFINE_BUILTIN_COMMAND("read", read_builtin);
+
+DEFTEST("builtins.read.fields")
+{
+	struct interpreter_state *state = interpreter_new(true);
+	const char *const split[] = { "read", "a", "b", NULL };
+	const char *const whole[] = { "read", "-r", NULL };
+	const char input[] = "  one\\ two  three \\\n four  \nc:\\x\nend";
+	int pipefd[2];
+
+	checked_pipe(pipefd);
+	checked_write(pipefd[1], input, sizeof(input) - 1);
+	checked_close(pipefd[1]);
+
+	EXPECT(read_builtin(state, split, pipefd[0], 1, 2) == 0);
+	EXPECT(!strcmp(variable_get(state->variables, "a"), "one two"));
+	EXPECT(!strcmp(variable_get(state->variables, "b"), "three  four"));
+
+	/* Only the first line was taken from the pipe */
+	EXPECT(read_builtin(state, whole, pipefd[0], 1, 2) == 0);
+	EXPECT(!strcmp(variable_get(state->variables, "REPLY"), "c:\\x"));
+
+	EXPECT(read_builtin(state, split, pipefd[0], 1, 2) == 1);
+	EXPECT(!strcmp(variable_get(state->variables, "a"), "end"));
+	EXPECT(!strcmp(variable_get(state->variables, "b"), ""));
+
+	checked_close(pipefd[0]);
+	interpreter_free(state);
+}
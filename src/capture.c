@@ -0,0 +1,349 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "alias.h"
+#include "arena.h"
+#include "capture.h"
+#include "commands.h"
+#include "error.h"
+#include "expand.h"
+#include "interpreter.h"
+#include "parser.h"
+#include "shell_builtins.h"
+#include "string_builder.h"
+#include "unit.h"
+
+void capture_pipe(int pipefd[2])
+{
+	CHECKP(pipe2(pipefd, O_CLOEXEC));
+
+	/*
+	 * A larger pipe means fewer context switches between the
+	 * writer and us. This is only a hint: unprivileged processes
+	 * are limited by /proc/sys/fs/pipe-max-size.
+	 */
+	fcntl(pipefd[1], F_SETPIPE_SZ, CAPTURE_PIPE_SIZE);
+}
+
+static struct capture_chunk *add_chunk(struct capture *cap)
+{
+	if (cap->count == cap->capacity) {
+		struct capture_chunk *chunks;
+
+		cap->capacity = cap->capacity ? cap->capacity * 2 : 8;
+		chunks = arena_malloc(cap->arena, sizeof(struct capture_chunk),
+				      cap->capacity);
+		if (cap->count)
+			memcpy(chunks, cap->chunks,
+			       cap->count * sizeof(struct capture_chunk));
+		cap->chunks = chunks;
+	}
+	return &cap->chunks[cap->count++];
+}
+
+static struct capture_chunk *new_chunk(struct capture *cap, size_t size)
+{
+	struct capture_chunk *chunk = add_chunk(cap);
+
+	/* One spare byte for a NUL terminator */
+	chunk->data = arena_malloc(cap->arena, sizeof(char), size + 1);
+	chunk->len = 0;
+	return chunk;
+}
+
+void capture_read(struct capture *cap, int fd)
+{
+	size_t chunk_size = CAPTURE_INITIAL_CHUNK;
+	struct capture_chunk *chunk = NULL;
+	size_t space = 0;
+
+	for (;;) {
+		ssize_t rv;
+
+		if (!space) {
+			if (chunk && chunk_size < CAPTURE_MAX_CHUNK)
+				chunk_size *= 2;
+			chunk = new_chunk(cap, chunk_size);
+			space = chunk_size;
+		}
+
+		rv = read(fd, chunk->data + chunk->len, space);
+		if (rv < 0 && errno == EINTR)
+			continue;
+		if (rv < 0)
+			RAISE(ERROR_DEVICE, "read: %s", strerror(errno));
+		if (!rv)
+			break;
+		chunk->len += rv;
+		cap->total += rv;
+		space -= rv;
+	}
+
+	chunk->data[chunk->len] = '\0';
+}
+
+bool capture_read_available(struct capture *cap, int fd)
+{
+	struct capture_chunk *chunk;
+	int available = 0;
+	ssize_t rv;
+	int saved;
+
+	/* Nothing available when readable means end of file */
+	if (ioctl(fd, FIONREAD, &available) < 0 || available <= 0)
+		available = 1;
+
+	chunk = new_chunk(cap, available);
+	do
+		rv = read(fd, chunk->data, available);
+	while (rv < 0 && errno == EINTR);
+	saved = errno;
+
+	if (rv <= 0) {
+		cap->count--;
+		if (rv < 0 && saved == EAGAIN)
+			return true;
+		if (rv < 0)
+			RAISE(ERROR_DEVICE, "read: %s", strerror(saved));
+		return false;
+	}
+
+	chunk->len = rv;
+	chunk->data[rv] = '\0';
+	cap->total += rv;
+	return true;
+}
+
+void capture_trim_newlines(struct capture *cap)
+{
+	while (cap->count) {
+		struct capture_chunk *chunk = &cap->chunks[cap->count - 1];
+
+		while (chunk->len && chunk->data[chunk->len - 1] == '\n') {
+			chunk->len--;
+			cap->total--;
+		}
+		chunk->data[chunk->len] = '\0';
+		if (chunk->len)
+			return;
+		cap->count--;
+	}
+}
+
+/*
+ * The builtin a statement runs, if it may be evaluated in-process: a
+ * lone foreground command with no assignments or redirections, whose
+ * name is a literal naming a pure builtin which is not aliased.
+ */
+static struct builtin_command *pure_builtin(struct interpreter_state *interp,
+					    struct ast_statement *statement)
+{
+	struct ast_command *cmd;
+	struct ast_argument_part_list *name;
+	struct builtin_command *builtin;
+	struct command *command;
+
+	if (statement->background || statement->and_or->rest ||
+	    statement->and_or->timed || statement->and_or->pipeline->rest)
+		return NULL;
+	cmd = statement->and_or->pipeline->first;
+	if (cmd->assignments || cmd->input_file || cmd->output_file ||
+	    cmd->append_file || !cmd->arglist)
+		return NULL;
+
+	name = cmd->arglist->first->parts;
+	if (name->rest || !name->first->string)
+		return NULL;
+	command = command_sized_lookup(interp->commands,
+				       name->first->string->data,
+				       name->first->string->size);
+	/* An alias or function of the same name runs instead */
+	if (!command || !command->builtin || command->alias ||
+	    command->function)
+		return NULL;
+	builtin = command->builtin;
+
+	if (builtin->flags & BUILTIN_PURE)
+		return builtin;
+	if ((builtin->flags & BUILTIN_PURE_WITHOUT_ARGS) &&
+	    !cmd->arglist->rest)
+		return builtin;
+	return NULL;
+}
+
+static bool in_process(struct interpreter_state *interp,
+		       struct ast_statement_list *list)
+{
+	for (; list; list = list->rest) {
+		if (list->first && !pure_builtin(interp, list->first))
+			return false;
+	}
+	return true;
+}
+
+static void capture_builtins(struct interpreter_state *interp,
+			     struct ast_statement_list *list,
+			     struct capture *cap)
+{
+	struct string_builder *saved = interp->capture;
+	struct capture_chunk *chunk;
+	struct error error;
+
+	if (GET_ERROR(&error)) {
+		interp->capture = saved;
+		reraise(&error);
+	}
+
+	interp->capture = string_builder_new(cap->arena);
+	for (; list; list = list->rest) {
+		struct builtin_command *builtin;
+		struct ast_command *cmd;
+		char **argv;
+
+		if (!list->first)
+			continue;
+		cmd = list->first->and_or->pipeline->first;
+		argv = expand_command(interp, cmd, cap->arena);
+		builtin = command_lookup(interp->commands, argv[0])->builtin;
+		interp->last_status = builtin->function(
+			interp, (const char *const *)argv, STDIN_FILENO,
+			BUILTIN_CAPTURE_FD, STDERR_FILENO);
+	}
+
+	/* The output becomes a single chunk, as if it had been read */
+	chunk = add_chunk(cap);
+	chunk->len = string_builder_length(interp->capture);
+	chunk->data = string_builder_finalize(interp->capture);
+	cap->total = chunk->len;
+
+	interp->capture = saved;
+	exit_error_handler(&error);
+}
+
+struct capture *capture_statement_list(struct interpreter_state *interp,
+				       struct ast_statement_list *list,
+				       struct arena *arena)
+{
+	struct capture *cap = arena_calloc(arena, sizeof(struct capture), 1);
+	int pipefd[2];
+	struct io_fds fds = {
+		.input_fd = STDIN_FILENO,
+		.error_fd = STDERR_FILENO,
+	};
+	pid_t pid;
+
+	cap->arena = arena;
+	if (in_process(interp, list)) {
+		capture_builtins(interp, list, cap);
+		capture_trim_newlines(cap);
+		return cap;
+	}
+
+	capture_pipe(pipefd);
+	fds.output_fd = pipefd[1];
+	pid = interpreter_subshell(interp, list, &fds);
+	checked_close(pipefd[1]);
+
+	capture_read(cap, pipefd[0]);
+	checked_close(pipefd[0]);
+	interp->last_status = interpreter_wait(interp, pid);
+
+	capture_trim_newlines(cap);
+	return cap;
+}
+
+DEFTEST("capture.read.large")
+{
+	struct arena arena = { NULL };
+	struct capture cap = { .arena = &arena };
+	const size_t size = 3 * CAPTURE_INITIAL_CHUNK + 17;
+	int pipefd[2];
+	pid_t pid;
+	size_t total = 0;
+
+	capture_pipe(pipefd);
+	pid = checked_fork();
+	if (pid == 0) {
+		char block[4096];
+
+		memset(block, 'x', sizeof(block));
+		for (size_t left = size; left;) {
+			size_t n = left < sizeof(block) ? left : sizeof(block);
+
+			if (write(pipefd[1], block, n) != n)
+				_exit(1);
+			left -= n;
+		}
+		_exit(0);
+	}
+	checked_close(pipefd[1]);
+	capture_read(&cap, pipefd[0]);
+	checked_close(pipefd[0]);
+	interpreter_wait(NULL, pid);
+
+	EXPECT(cap.total == size);
+	for (size_t i = 0; i < cap.count; i++)
+		total += cap.chunks[i].len;
+	EXPECT(total == size);
+	arena_free(&arena);
+}
+
+DEFTEST("capture.trim")
+{
+	struct arena arena = { NULL };
+	struct capture cap = { .arena = &arena };
+	struct capture_chunk *chunk;
+
+	chunk = new_chunk(&cap, 8);
+	memcpy(chunk->data, "abc\n", 4);
+	chunk->len = 4;
+	chunk = new_chunk(&cap, 8);
+	memcpy(chunk->data, "\n\n", 2);
+	chunk->len = 2;
+	cap.total = 6;
+
+	capture_trim_newlines(&cap);
+	EXPECT(cap.count == 1);
+	EXPECT(cap.total == 3);
+	EXPECT(!strcmp(cap.chunks[0].data, "abc"));
+	arena_free(&arena);
+}
+
+DEFTEST("capture.in_process")
+{
+	struct interpreter_state *interp = interpreter_new(true);
+	struct ast_statement_list *list;
+	struct {
+		const char *input;
+		bool expected;
+	} cases[] = {
+		{ "pwd", true },
+		{ "echo $X; echo `pwd`", true },
+		{ "alias", true },
+		{ "alias x=y", false },
+		{ "cd /", false },
+		{ "echo hi > file", false },
+		{ "echo hi | cat", false },
+		{ "X=1 echo $X", false },
+		{ "$CMD", false },
+		{ "ls", false },
+	};
+
+	for (size_t i = 0; i < ARRAY_SIZE(cases); i++) {
+		list = parse_input(cases[i].input);
+		EXPECT(in_process(interp, list) == cases[i].expected);
+		ast_statement_list_free(list);
+	}
+
+	/* An aliased builtin may no longer be what it seems */
+	alias_set(interp->commands, "pwd", "ls");
+	list = parse_input("pwd");
+	EXPECT(!in_process(interp, list));
+	ast_statement_list_free(list);
+	interpreter_free(interp);
+}
@@ -0,0 +1,182 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "commands.h"
+#include "error.h"
+#include "functions.h"
+#include "hash.h"
+#include "shell_builtins.h"
+#include "unit.h"
+
+#define COMMAND_TABLE_INITIAL_BUCKETS 32
+
+/* A chained hash table, as for variables */
+struct command_table {
+	struct command **buckets;
+	size_t bucket_count;
+	size_t count;
+};
+
+static struct command **find_slot(struct command_table *table,
+				  const char *name, size_t name_len,
+				  uint32_t hash)
+{
+	struct command **slot =
+		&table->buckets[hash & (table->bucket_count - 1)];
+
+	for (; *slot; slot = &(*slot)->next) {
+		if ((*slot)->hash == hash &&
+		    !strncmp((*slot)->name, name, name_len) &&
+		    !(*slot)->name[name_len])
+			break;
+	}
+	return slot;
+}
+
+static void grow(struct command_table *table)
+{
+	size_t new_count = table->bucket_count * 2;
+	struct command **new_buckets =
+		checked_calloc(sizeof(struct command *), new_count);
+
+	for (size_t i = 0; i < table->bucket_count; i++) {
+		struct command *command = table->buckets[i];
+
+		while (command) {
+			struct command *next = command->next;
+			struct command **slot =
+				&new_buckets[command->hash & (new_count - 1)];
+
+			command->next = *slot;
+			*slot = command;
+			command = next;
+		}
+	}
+	free(table->buckets);
+	table->buckets = new_buckets;
+	table->bucket_count = new_count;
+}
+
+struct command *command_add(struct command_table *table, const char *name)
+{
+	size_t name_len = strlen(name);
+	uint32_t hash = hash_bytes(name, name_len);
+	struct command **slot = find_slot(table, name, name_len, hash);
+	struct command *command = *slot;
+
+	if (command)
+		return command;
+
+	if (table->count >= table->bucket_count) {
+		grow(table);
+		slot = find_slot(table, name, name_len, hash);
+	}
+
+	command = checked_calloc(sizeof(struct command), 1);
+	command->name = checked_strdup(name);
+	command->hash = hash;
+	*slot = command;
+	table->count++;
+	return command;
+}
+
+struct command_table *command_table_new(void)
+{
+	struct command_table *table =
+		checked_calloc(sizeof(struct command_table), 1);
+
+	table->bucket_count = COMMAND_TABLE_INITIAL_BUCKETS;
+	table->buckets =
+		checked_calloc(sizeof(struct command *), table->bucket_count);
+
+	for (struct builtin_command_list *p = builtin_command_list; p;
+	     p = p->rest)
+		command_add(table, p->first->name)->builtin = p->first;
+	return table;
+}
+
+static void command_free(struct command *command)
+{
+	if (command->function)
+		function_unref(command->function);
+	free(command->alias);
+	free(command->name);
+	free(command);
+}
+
+void command_table_free(struct command_table *table)
+{
+	for (size_t i = 0; i < table->bucket_count; i++) {
+		struct command *command = table->buckets[i];
+
+		while (command) {
+			struct command *next = command->next;
+
+			command_free(command);
+			command = next;
+		}
+	}
+	free(table->buckets);
+	free(table);
+}
+
+struct command *command_sized_lookup(struct command_table *table,
+				     const char *name, size_t name_len)
+{
+	return *find_slot(table, name, name_len, hash_bytes(name, name_len));
+}
+
+struct command *command_lookup(struct command_table *table, const char *name)
+{
+	return command_sized_lookup(table, name, strlen(name));
+}
+
+void command_prune(struct command_table *table, struct command *command)
+{
+	struct command **slot;
+
+	if (command->alias || command->function || command->builtin)
+		return;
+
+	slot = find_slot(table, command->name, strlen(command->name),
+			 command->hash);
+	CHECK(*slot == command);
+	*slot = command->next;
+	table->count--;
+	command_free(command);
+}
+
+void command_table_foreach(struct command_table *table,
+			   void (*func)(struct command *command, void *data),
+			   void *data)
+{
+	for (size_t i = 0; i < table->bucket_count; i++) {
+		for (struct command *command = table->buckets[i]; command;
+		     command = command->next)
+			func(command, data);
+	}
+}
+
+DEFTEST("commands.lookup")
+{
+	struct command_table *table = command_table_new();
+	struct command *echo = command_lookup(table, "echo");
+	struct command *added;
+
+	ASSERT_NOT_NULL(echo);
+	EXPECT(echo->builtin == builtin_command_get("echo"));
+	EXPECT(command_sized_lookup(table, "echoes", 4) == echo);
+	EXPECT_NULL(command_lookup(table, "no-such-command"));
+
+	/* Pruning only removes entries which stand for nothing */
+	added = command_add(table, "ll");
+	EXPECT(command_lookup(table, "ll") == added);
+	command_prune(table, echo);
+	command_prune(table, added);
+	EXPECT(command_lookup(table, "echo") == echo);
+	EXPECT_NULL(command_lookup(table, "ll"));
+	command_table_free(table);
+}
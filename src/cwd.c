@@ -0,0 +1,300 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "cwd.h"
+#include "error.h"
+#include "unit.h"
+
+#define DIR_FLAGS (O_PATH | O_DIRECTORY | O_CLOEXEC)
+
+struct cwd_dir {
+	char *path;
+	/* O_PATH, or AT_FDCWD if the directory could not be opened */
+	int fd;
+};
+
+struct cwd {
+	struct cwd_dir current;
+	/* The pushd stack, with the top last */
+	struct cwd_dir *stack;
+	size_t count;
+	size_t capacity;
+};
+
+static void dir_close(struct cwd_dir *dir)
+{
+	if (dir->fd >= 0)
+		close(dir->fd);
+	free(dir->path);
+}
+
+char *cwd_logical_path(const char *base, const char *target)
+{
+	char *result = checked_malloc(sizeof(char),
+				      strlen(base) + strlen(target) + 3);
+	const char *parts[] = { target[0] == '/' ? "" : base, target };
+	size_t len = 0;
+
+	for (size_t i = 0; i < ARRAY_SIZE(parts); i++) {
+		const char *p = parts[i];
+
+		while (*p) {
+			size_t n = strcspn(p, "/");
+
+			if (n == 2 && !strncmp(p, "..", 2)) {
+				while (len && result[len - 1] != '/')
+					len--;
+				if (len)
+					len--;
+			} else if (n && !(n == 1 && *p == '.')) {
+				result[len++] = '/';
+				memcpy(result + len, p, n);
+				len += n;
+			}
+			p += n;
+			p += strspn(p, "/");
+		}
+	}
+
+	if (!len)
+		result[len++] = '/';
+	result[len] = '\0';
+	return result;
+}
+
+/* Whether the working directory is the directory at path */
+static bool is_cwd(int fd, const char *path)
+{
+	struct stat cwd_stat, path_stat;
+
+	return !fstat(fd, &cwd_stat) && !stat(path, &path_stat) &&
+	       cwd_stat.st_dev == path_stat.st_dev &&
+	       cwd_stat.st_ino == path_stat.st_ino;
+}
+
+struct cwd *cwd_new(void)
+{
+	struct cwd *cwd = checked_calloc(sizeof(struct cwd), 1);
+	const char *pwd = getenv("PWD");
+	char *path;
+
+	cwd->current.fd = open(".", DIR_FLAGS);
+	if (cwd->current.fd < 0)
+		cwd->current.fd = AT_FDCWD;
+
+	if (pwd && pwd[0] == '/' && is_cwd(cwd->current.fd, pwd)) {
+		cwd->current.path = cwd_logical_path(pwd, "");
+	} else {
+		path = getcwd(NULL, 0);
+		cwd->current.path = checked_strdup(path ? path : "/");
+		free(path);
+	}
+	return cwd;
+}
+
+void cwd_free(struct cwd *cwd)
+{
+	dir_close(&cwd->current);
+	for (size_t i = 0; i < cwd->count; i++)
+		dir_close(&cwd->stack[i]);
+	free(cwd->stack);
+	free(cwd);
+}
+
+const char *cwd_path(const struct cwd *cwd)
+{
+	return cwd->current.path;
+}
+
+int cwd_fd(const struct cwd *cwd)
+{
+	return cwd->current.fd;
+}
+
+static bool has_dotdot(const char *path)
+{
+	while (*path) {
+		size_t n = strcspn(path, "/");
+
+		if (n == 2 && !strncmp(path, "..", 2))
+			return true;
+		path += n;
+		path += strspn(path, "/");
+	}
+	return false;
+}
+
+/*
+ * Open a directory and change to it. A relative path without ".." is
+ * the same logically and physically, so it is opened from the current
+ * directory; anything else is opened by its logical path, so that ".."
+ * goes back through the symbolic link used to get here.
+ */
+static bool enter(struct cwd *cwd, const char *target, struct cwd_dir *dir)
+{
+	int saved_errno;
+
+	dir->path = cwd_logical_path(cwd->current.path, target);
+	if (target[0] != '/' && !has_dotdot(target))
+		dir->fd = openat(cwd->current.fd, target, DIR_FLAGS);
+	else
+		dir->fd = open(dir->path, DIR_FLAGS);
+
+	if (dir->fd >= 0 && !fchdir(dir->fd))
+		return true;
+
+	saved_errno = errno;
+	dir_close(dir);
+	errno = saved_errno;
+	return false;
+}
+
+bool cwd_change(struct cwd *cwd, const char *target)
+{
+	struct cwd_dir dir;
+
+	if (!enter(cwd, target, &dir))
+		return false;
+	dir_close(&cwd->current);
+	cwd->current = dir;
+	return true;
+}
+
+bool cwd_push(struct cwd *cwd, const char *target)
+{
+	struct cwd_dir dir;
+
+	if (!enter(cwd, target, &dir))
+		return false;
+
+	if (cwd->count == cwd->capacity) {
+		cwd->capacity = cwd->capacity ? cwd->capacity * 2 : 8;
+		cwd->stack = checked_realloc(cwd->stack,
+					     sizeof(struct cwd_dir),
+					     cwd->capacity);
+	}
+	cwd->stack[cwd->count++] = cwd->current;
+	cwd->current = dir;
+	return true;
+}
+
+bool cwd_pop(struct cwd *cwd, bool swap)
+{
+	struct cwd_dir top;
+
+	if (!cwd->count) {
+		errno = ENOENT;
+		return false;
+	}
+
+	top = cwd->stack[cwd->count - 1];
+	if (top.fd >= 0 ? fchdir(top.fd) : chdir(top.path))
+		return false;
+
+	if (swap) {
+		cwd->stack[cwd->count - 1] = cwd->current;
+	} else {
+		dir_close(&cwd->current);
+		cwd->count--;
+	}
+	cwd->current = top;
+	return true;
+}
+
+size_t cwd_stack_count(const struct cwd *cwd)
+{
+	return cwd->count;
+}
+
+const char *cwd_stack_path(const struct cwd *cwd, size_t index)
+{
+	return cwd->stack[cwd->count - 1 - index].path;
+}
+
+DEFTEST("cwd.logical")
+{
+	struct {
+		const char *base;
+		const char *target;
+		const char *expected;
+	} cases[] = {
+		{ "/a/b", "c", "/a/b/c" },
+		{ "/a/b", "../c", "/a/c" },
+		{ "/a/b", "/x//y/./", "/x/y" },
+		{ "/a/b", "../../..", "/" },
+		{ "/", ".", "/" },
+		{ "/a", "", "/a" },
+		{ "/a/b", "./c/../d/..", "/a/b" },
+		{ "/a", "..b/.c", "/a/..b/.c" },
+	};
+
+	for (size_t i = 0; i < ARRAY_SIZE(cases); i++) {
+		char *path = cwd_logical_path(cases[i].base, cases[i].target);
+
+		EXPECT(!strcmp(path, cases[i].expected));
+		free(path);
+	}
+}
+
+DEFTEST("cwd.stack")
+{
+	char root[] = "/tmp/cwd_test_XXXXXX";
+	char path[64];
+	struct cwd *cwd;
+	char *physical;
+
+	ASSERT(mkdtemp(root));
+	snprintf(path, sizeof(path), "%s/a", root);
+	ASSERT(!mkdir(path, 0700));
+	snprintf(path, sizeof(path), "%s/a/b", root);
+	ASSERT(!mkdir(path, 0700));
+	snprintf(path, sizeof(path), "%s/link", root);
+	ASSERT(!symlink("a/b", path));
+
+	ASSERT(!chdir(root));
+	cwd = cwd_new();
+	EXPECT(cwd_change(cwd, "link"));
+	EXPECT(!strcmp(cwd_path(cwd), path));
+	physical = getcwd(NULL, 0);
+	EXPECT(strstr(physical, "/a/b"));
+	free(physical);
+
+	/* .. goes back through the link, not to a */
+	EXPECT(cwd_push(cwd, ".."));
+	EXPECT(!strcmp(cwd_path(cwd), root));
+	EXPECT(cwd_stack_count(cwd) == 1);
+	EXPECT(!strcmp(cwd_stack_path(cwd, 0), path));
+	EXPECT(!cwd_change(cwd, "missing") && errno == ENOENT);
+	EXPECT(!strcmp(cwd_path(cwd), root));
+
+	EXPECT(cwd_pop(cwd, true));
+	EXPECT(!strcmp(cwd_path(cwd), path));
+	EXPECT(!strcmp(cwd_stack_path(cwd, 0), root));
+	EXPECT(cwd_pop(cwd, false));
+	EXPECT(!strcmp(cwd_path(cwd), root));
+	EXPECT(!cwd_pop(cwd, false));
+
+	/* Redirections open files relative to cwd_fd() */
+	EXPECT(cwd_change(cwd, "a"));
+	close(checked_openat(cwd_fd(cwd), "file", O_WRONLY | O_CREAT, 0600));
+	snprintf(path, sizeof(path), "%s/a/file", root);
+	EXPECT(!access(path, F_OK));
+
+	cwd_free(cwd);
+	unlink(path);
+	snprintf(path, sizeof(path), "%s/link", root);
+	unlink(path);
+	snprintf(path, sizeof(path), "%s/a/b", root);
+	rmdir(path);
+	snprintf(path, sizeof(path), "%s/a", root);
+	rmdir(path);
+	rmdir(root);
+}
@@ -0,0 +1,426 @@
+#include <glob.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "arena.h"
+#include "arith.h"
+#include "ast.h"
+#include "capture.h"
+#include "error.h"
+#include "expand.h"
+#include "interpreter.h"
+#include "string_builder.h"
+#include "unit.h"
+#include "variables.h"
+
+struct expansion {
+	struct interpreter_state *interp;
+	struct arena *arena;
+	/* Split unquoted expansions into fields */
+	bool split;
+	/* The current argument contains a glob */
+	bool globbing;
+
+	char **words;
+	size_t count;
+	size_t capacity;
+
+	/* The word being built */
+	struct string_builder *text;
+	/* The same word as an escaped glob pattern, when globbing */
+	struct string_builder *pattern;
+	bool in_word;
+	bool has_glob;
+	/*
+	 * Set when the word so far is a single NUL-terminated string
+	 * which can be used without copying.
+	 */
+	char *in_place;
+};
+
+static bool is_ifs(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n';
+}
+
+static void push_word(struct expansion *exp, char *word)
+{
+	if (exp->count + 1 >= exp->capacity) {
+		char **words;
+
+		exp->capacity = exp->capacity ? exp->capacity * 2 : 8;
+		words = arena_malloc(exp->arena, sizeof(char *), exp->capacity);
+		if (exp->count)
+			memcpy(words, exp->words, exp->count * sizeof(char *));
+		exp->words = words;
+	}
+	exp->words[exp->count++] = word;
+}
+
+static void start_word(struct expansion *exp)
+{
+	exp->text = string_builder_new(exp->arena);
+	exp->pattern = exp->globbing ? string_builder_new(exp->arena) : NULL;
+	exp->in_word = false;
+	exp->has_glob = false;
+	exp->in_place = NULL;
+}
+
+static void glob_word(struct expansion *exp)
+{
+	glob_t results;
+	char *pattern = string_builder_finalize(exp->pattern);
+
+	if (!glob(pattern, 0, NULL, &results)) {
+		for (size_t i = 0; i < results.gl_pathc; i++) {
+			char *path = results.gl_pathv[i];
+
+			push_word(exp, arena_strdup(exp->arena, path));
+		}
+	} else {
+		/* No matches: the word is used literally */
+		push_word(exp, string_builder_finalize(exp->text));
+	}
+	globfree(&results);
+}
+
+static void end_word(struct expansion *exp)
+{
+	if (!exp->in_word)
+		return;
+
+	if (exp->has_glob)
+		glob_word(exp);
+	else if (exp->in_place)
+		push_word(exp, exp->in_place);
+	else
+		push_word(exp, string_builder_finalize(exp->text));
+	start_word(exp);
+}
+
+static void append_escaped(struct string_builder *sb, const char *str,
+			   size_t len)
+{
+	size_t start = 0;
+
+	for (size_t i = 0; i < len; i++) {
+		if (!strchr("*?[\\", str[i]))
+			continue;
+		string_builder_sized_append(sb, str + start, i - start);
+		string_builder_append(sb, "\\");
+		start = i;
+	}
+	string_builder_sized_append(sb, str + start, len - start);
+}
+
+static void append_text(struct expansion *exp, const char *str, size_t len)
+{
+	exp->in_word = true;
+	if (len)
+		exp->in_place = NULL;
+	string_builder_sized_append(exp->text, str, len);
+	if (exp->pattern)
+		append_escaped(exp->pattern, str, len);
+}
+
+/* Append a string which is NUL-terminated at str[len] */
+static void append_in_place(struct expansion *exp, char *str, size_t len)
+{
+	bool empty = !string_builder_length(exp->text);
+
+	append_text(exp, str, len);
+	if (empty)
+		exp->in_place = str;
+}
+
+static void append_glob(struct expansion *exp, struct ast_glob *glob)
+{
+	struct string_builder *form = string_builder_new(exp->arena);
+
+	switch (glob->type) {
+	case GLOB_STAR:
+		string_builder_append(form, "*");
+		break;
+	case GLOB_ONE:
+		string_builder_append(form, "?");
+		break;
+	case GLOB_CHARSET:
+		string_builder_append(form, "[");
+		string_builder_sized_append(form, glob->charset->data,
+					    glob->charset->size);
+		string_builder_append(form, "]");
+		break;
+	}
+
+	exp->in_word = true;
+	exp->in_place = NULL;
+	string_builder_append(exp->text, string_builder_finalize(form));
+	if (exp->pattern) {
+		string_builder_append(exp->pattern,
+				      string_builder_finalize(form));
+		exp->has_glob = true;
+	}
+}
+
+/*
+ * Split str into fields, joining the first to the current word. When
+ * str is writable, words are NUL-terminated in place by overwriting
+ * the separator after them; terminated says str[len] may be written
+ * too.
+ */
+static void append_fields(struct expansion *exp, char *str, size_t len,
+			  bool writable, bool terminated)
+{
+	size_t i = 0;
+
+	while (i < len) {
+		size_t start;
+
+		if (is_ifs(str[i])) {
+			end_word(exp);
+			i++;
+			continue;
+		}
+
+		start = i;
+		while (i < len && !is_ifs(str[i]))
+			i++;
+
+		if (writable && (i < len || terminated)) {
+			bool separator = i < len;
+
+			str[i] = '\0';
+			append_in_place(exp, str + start, i - start);
+			if (separator) {
+				end_word(exp);
+				i++;
+			}
+		} else {
+			append_text(exp, str + start, i - start);
+		}
+	}
+}
+
+/*
+ * The value of a parameter, for words and arithmetic alike: the last
+ * status for ?, a function's own arguments inside it, and otherwise a
+ * variable, which is "" if unset.
+ */
+static const char *parameter_value(struct expansion *exp, const char *name,
+				   size_t len)
+{
+	struct call_frame *frame = exp->interp->frame;
+	const char *value;
+
+	if (len == 1 && name[0] == '?') {
+		char *status = arena_malloc(exp->arena, sizeof(char), 12);
+
+		snprintf(status, 12, "%d", exp->interp->last_status);
+		return status;
+	}
+
+	/* Inside a function, $1 to $9 are its arguments */
+	if (frame && len == 1 && name[0] >= '1' && name[0] <= '9') {
+		size_t i = name[0] - '0';
+
+		return i < frame->argc ? frame->argv[i] : "";
+	}
+
+	value = variable_sized_get(exp->interp->variables, name, len);
+	return value ? value : "";
+}
+
+/* Look up a parameter named in an arithmetic expression */
+static const char *arith_parameter(void *data, const char *name, size_t len)
+{
+	return parameter_value(data, name, len);
+}
+
+static void expand_substitution(struct expansion *exp,
+				struct ast_argument_part *part)
+{
+	struct capture *cap = capture_statement_list(
+		exp->interp, part->substitution, exp->arena);
+
+	if (!exp->split || part->quoted) {
+		exp->in_word = true;
+		for (size_t i = 0; i < cap->count; i++) {
+			if (cap->count == 1)
+				append_in_place(exp, cap->chunks[i].data,
+						cap->chunks[i].len);
+			else
+				append_text(exp, cap->chunks[i].data,
+					    cap->chunks[i].len);
+		}
+		return;
+	}
+
+	for (size_t i = 0; i < cap->count; i++)
+		append_fields(exp, cap->chunks[i].data, cap->chunks[i].len,
+			      true, i + 1 == cap->count);
+}
+
+static void expand_part(struct expansion *exp, struct ast_argument_part *part)
+{
+	if (part->string) {
+		append_text(exp, part->string->data, part->string->size);
+	} else if (part->parameter) {
+		const char *value = parameter_value(
+			exp, part->parameter->data, part->parameter->size);
+
+		if (!exp->split || part->quoted)
+			append_text(exp, value, strlen(value));
+		else
+			append_fields(exp, (char *)value, strlen(value), false,
+				      false);
+	} else if (part->glob) {
+		append_glob(exp, part->glob);
+	} else if (part->substitution) {
+		expand_substitution(exp, part);
+	} else if (part->arith) {
+		char *value = arena_malloc(exp->arena, sizeof(char), 21);
+		int len = snprintf(value, 21, "%" PRId64,
+				   arith_eval(part->arith->program,
+					      arith_parameter, exp));
+
+		append_text(exp, value, len);
+	} else {
+		/* An empty substitution, such as $() */
+		exp->in_word = exp->in_word || part->quoted;
+	}
+}
+
+static bool has_glob(struct ast_argument *arg)
+{
+	for (struct ast_argument_part_list *parts = arg->parts; parts;
+	     parts = parts->rest) {
+		if (parts->first->glob)
+			return true;
+	}
+	return false;
+}
+
+static void expand_fields(struct expansion *exp, struct ast_argument *arg)
+{
+	exp->globbing = has_glob(arg);
+	start_word(exp);
+	for (struct ast_argument_part_list *parts = arg->parts; parts;
+	     parts = parts->rest)
+		expand_part(exp, parts->first);
+	end_word(exp);
+}
+
+char **expand_arguments(struct interpreter_state *interp,
+			struct ast_argument_list *args, struct arena *arena)
+{
+	struct expansion exp = {
+		.interp = interp,
+		.arena = arena,
+		.split = true,
+	};
+
+	for (; args; args = args->rest)
+		expand_fields(&exp, args->first);
+
+	push_word(&exp, NULL);
+	return exp.words;
+}
+
+char **expand_argument(struct interpreter_state *interp,
+		       struct ast_argument *arg, struct arena *arena)
+{
+	struct expansion exp = {
+		.interp = interp,
+		.arena = arena,
+		.split = true,
+	};
+
+	expand_fields(&exp, arg);
+	push_word(&exp, NULL);
+	return exp.words;
+}
+
+char **expand_command(struct interpreter_state *interp,
+		      struct ast_command *cmd, struct arena *arena)
+{
+	if (cmd->argv)
+		return cmd->argv;
+	return expand_arguments(interp, cmd->arglist, arena);
+}
+
+char *expand_word(struct interpreter_state *interp, struct ast_argument *arg,
+		  struct arena *arena)
+{
+	struct expansion exp = {
+		.interp = interp,
+		.arena = arena,
+	};
+
+	start_word(&exp);
+	if (arg) {
+		for (struct ast_argument_part_list *parts = arg->parts; parts;
+		     parts = parts->rest)
+			expand_part(&exp, parts->first);
+	}
+
+	if (exp.in_place)
+		return exp.in_place;
+	return string_builder_finalize(exp.text);
+}
+
+char **expand_alias(char **argv, const char *replacement,
+		    struct arena *arena)
+{
+	struct expansion exp = { .arena = arena };
+
+	start_word(&exp);
+	append_fields(&exp, (char *)replacement, strlen(replacement), false,
+		      false);
+	end_word(&exp);
+	for (size_t i = 1; argv[i]; i++)
+		push_word(&exp, argv[i]);
+	push_word(&exp, NULL);
+	return exp.words;
+}
+
+DEFTEST("expand.fields.in_place")
+{
+	struct arena arena = { NULL };
+	struct expansion exp = { .arena = &arena, .split = true };
+	char buf[] = "  one two\tthree\n";
+
+	start_word(&exp);
+	append_fields(&exp, buf, strlen(buf), true, true);
+	end_word(&exp);
+
+	ASSERT(exp.count == 3);
+	EXPECT(!strcmp(exp.words[0], "one"));
+	EXPECT(!strcmp(exp.words[1], "two"));
+	EXPECT(!strcmp(exp.words[2], "three"));
+	/* The words were not copied out of the buffer */
+	EXPECT(exp.words[0] == buf + 2);
+	EXPECT(exp.words[2] == buf + 10);
+	arena_free(&arena);
+}
+
+DEFTEST("expand.fields.joined")
+{
+	struct arena arena = { NULL };
+	struct expansion exp = { .arena = &arena, .split = true };
+	char first[] = "a b";
+	char second[] = "c d";
+
+	start_word(&exp);
+	append_text(&exp, "x", 1);
+	append_fields(&exp, first, 3, true, false);
+	append_fields(&exp, second, 3, true, true);
+	end_word(&exp);
+
+	ASSERT(exp.count == 3);
+	EXPECT(!strcmp(exp.words[0], "xa"));
+	EXPECT(!strcmp(exp.words[1], "bc"));
+	EXPECT(!strcmp(exp.words[2], "d"));
+	arena_free(&arena);
+}
@@ -0,0 +1,141 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "error.h"
+#include "fd_cache.h"
+#include "unit.h"
+
+struct fd_cache_entry {
+	char *key;
+	int flags;
+	int fd;
+	dev_t dev;
+	ino_t ino;
+};
+
+struct fd_cache {
+	/* In the order they were opened, so the oldest is first */
+	struct fd_cache_entry entries[FD_CACHE_MAX];
+	size_t count;
+};
+
+struct fd_cache *fd_cache_new(void)
+{
+	return checked_calloc(sizeof(struct fd_cache), 1);
+}
+
+static void evict(struct fd_cache *cache, size_t i)
+{
+	close(cache->entries[i].fd);
+	free(cache->entries[i].key);
+	memmove(&cache->entries[i], &cache->entries[i + 1],
+		(cache->count - i - 1) * sizeof(struct fd_cache_entry));
+	cache->count--;
+}
+
+void fd_cache_free(struct fd_cache *cache)
+{
+	while (cache->count)
+		evict(cache, cache->count - 1);
+	free(cache);
+}
+
+static struct fd_cache_entry *lookup(struct fd_cache *cache, int dirfd,
+				     const char *key, const char *path,
+				     int flags)
+{
+	struct stat st;
+
+	for (size_t i = 0; i < cache->count; i++) {
+		struct fd_cache_entry *entry = &cache->entries[i];
+
+		if (entry->flags != flags || strcmp(entry->key, key))
+			continue;
+		if (!fstatat(dirfd, path, &st, 0) && st.st_dev == entry->dev &&
+		    st.st_ino == entry->ino)
+			return entry;
+		/* Renamed or removed since it was opened */
+		evict(cache, i);
+		return NULL;
+	}
+	return NULL;
+}
+
+int fd_cache_open(struct fd_cache *cache, int dirfd, const char *key,
+		  const char *path, int flags)
+{
+	struct fd_cache_entry *entry = lookup(cache, dirfd, key, path, flags);
+	struct stat st;
+	int fd;
+
+	if (entry)
+		return entry->fd;
+
+	fd = checked_openat(dirfd, path, flags | O_CLOEXEC, 0666);
+	if (fstat(fd, &st)) {
+		close(fd);
+		CHECKP(-1);
+	}
+	if (cache->count == FD_CACHE_MAX)
+		evict(cache, 0);
+
+	cache->entries[cache->count++] = (struct fd_cache_entry){
+		.key = checked_strdup(key),
+		.flags = flags,
+		.fd = fd,
+		.dev = st.st_dev,
+		.ino = st.st_ino,
+	};
+	return fd;
+}
+
+size_t fd_cache_count(const struct fd_cache *cache)
+{
+	return cache->count;
+}
+
+DEFTEST("fd_cache.reuse")
+{
+	const int flags = O_WRONLY | O_CREAT | O_APPEND;
+	char path[] = "/tmp/fd_cache_test_XXXXXX";
+	char renamed[sizeof(path) + 4];
+	struct fd_cache *cache = fd_cache_new();
+	int fd = mkstemp(path);
+	int first;
+	char buf[8];
+
+	ASSERT(fd >= 0);
+	close(fd);
+	snprintf(renamed, sizeof(renamed), "%s.old", path);
+
+	first = fd_cache_open(cache, AT_FDCWD, path, path, flags);
+	EXPECT(fd_cache_open(cache, AT_FDCWD, path, path, flags) == first);
+	EXPECT(fd_cache_count(cache) == 1);
+	EXPECT(write(first, "a", 1) == 1);
+
+	/* Other flags are another entry */
+	fd = fd_cache_open(cache, AT_FDCWD, path, path, O_RDONLY);
+	EXPECT(fd != first);
+	EXPECT(fd_cache_count(cache) == 2);
+
+	/* Once the file is renamed, the path is opened again */
+	ASSERT(!rename(path, renamed));
+	fd = fd_cache_open(cache, AT_FDCWD, path, path, flags);
+	EXPECT(write(fd, "b", 1) == 1);
+	EXPECT(fd_cache_count(cache) == 2);
+
+	fd = open(renamed, O_RDONLY);
+	EXPECT(read(fd, buf, sizeof(buf)) == 1 && buf[0] == 'a');
+	close(fd);
+	fd = open(path, O_RDONLY);
+	EXPECT(read(fd, buf, sizeof(buf)) == 1 && buf[0] == 'b');
+	close(fd);
+
+	fd_cache_free(cache);
+	unlink(path);
+	unlink(renamed);
+}
@@ -0,0 +1,88 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "commands.h"
+#include "error.h"
+#include "functions.h"
+#include "parser.h"
+#include "unit.h"
+#include "vm.h"
+
+void function_define(struct command_table *table,
+		     const struct ast_function *definition)
+{
+	struct shell_function *function =
+		checked_calloc(sizeof(struct shell_function), 1);
+	char name[definition->name->size + 1];
+	struct command *command;
+	struct error error;
+
+	function->refs = 1;
+	if (GET_ERROR(&error)) {
+		function_unref(function);
+		reraise(&error);
+	}
+	function->body = ast_statement_list_copy(definition->body);
+	function->program = vm_compile(function->body);
+	exit_error_handler(&error);
+
+	memcpy(name, definition->name->data, definition->name->size);
+	name[definition->name->size] = '\0';
+	command = command_add(table, name);
+	if (command->function)
+		function_unref(command->function);
+	command->function = function;
+}
+
+struct shell_function *function_ref(struct shell_function *function)
+{
+	function->refs++;
+	return function;
+}
+
+void function_unref(struct shell_function *function)
+{
+	if (--function->refs)
+		return;
+	if (function->program)
+		vm_program_free(function->program);
+	ast_statement_list_free(function->body);
+	free(function);
+}
+
+DEFTEST("functions.define")
+{
+	struct command_table *table = command_table_new();
+	char *input = strdup("echo() { echo $1 two; }");
+	struct ast_statement_list *list = parse_input_view(input);
+	struct ast_function *definition =
+		list->first->and_or->pipeline->first->function;
+	struct shell_function *function;
+	struct ast_string *word;
+
+	function_define(table, definition);
+	function = command_lookup(table, "echo")->function;
+	ASSERT_NOT_NULL(function);
+	EXPECT(command_lookup(table, "echo")->builtin);
+
+	/* The body no longer depends on the input it was parsed from */
+	ast_statement_list_free(list);
+	memset(input, 'x', strlen(input));
+	free(input);
+	word = function->body->first->and_or->pipeline->first->arglist->rest
+		       ->rest->first->parts->first->string;
+	EXPECT(!word->priv.borrowed && word->size == 3 &&
+	       !strncmp(word->data, "two", 3));
+	EXPECT(function->program->count > 0);
+
+	/* A call in progress keeps the old body alive */
+	function_ref(function);
+	list = parse_input("echo() { :; }");
+	function_define(table, list->first->and_or->pipeline->first->function);
+	EXPECT(command_lookup(table, "echo")->function != function);
+	EXPECT(function->refs == 1);
+	function_unref(function);
+	ast_statement_list_free(list);
+	command_table_free(table);
+}
@@ -0,0 +1,372 @@
+#include <ctype.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "error.h"
+#include "history_expand.h"
+#include "history_log.h"
+#include "string_builder.h"
+#include "unit.h"
+
+struct expansion {
+	struct history_log *log;
+	struct arena *arena;
+	struct string_builder *sb;
+	const char *p;
+	bool print_only;
+};
+
+static char *sized_strdup(struct arena *arena, const char *str, size_t len)
+{
+	char *buf = arena_malloc(arena, sizeof(char), len + 1);
+
+	memcpy(buf, str, len);
+	buf[len] = '\0';
+	return buf;
+}
+
+static const char *event_at(struct history_log *log, size_t index,
+			    const char *spec, size_t spec_len)
+{
+	const char *event = history_log_get(log, index);
+
+	if (!event)
+		RAISE(ERROR_KEY_NOT_FOUND, "!%.*s: event not found",
+		      (int)spec_len, spec);
+	return event;
+}
+
+static const char *find_prefix(struct history_log *log, const char *prefix,
+			       size_t len)
+{
+	ssize_t index = history_log_search_prefix(log, prefix, len);
+
+	if (index < 0)
+		RAISE(ERROR_KEY_NOT_FOUND, "!%.*s: event not found", (int)len,
+		      prefix);
+	return history_log_get(log, index);
+}
+
+static const char *find_substring(struct history_log *log, const char *search)
+{
+	ssize_t index = history_log_search(log, search, history_log_count(log));
+
+	if (index < 0)
+		RAISE(ERROR_KEY_NOT_FOUND, "!?%s: event not found", search);
+	return history_log_get(log, index);
+}
+
+static size_t parse_number(struct expansion *exp)
+{
+	size_t n = 0;
+
+	while (isdigit(*exp->p)) {
+		n = n * 10 + (*exp->p - '0');
+		exp->p++;
+	}
+	return n;
+}
+
+static const char *parse_event(struct expansion *exp)
+{
+	struct history_log *log = exp->log;
+	size_t count = history_log_count(log);
+	const char *spec = exp->p;
+	size_t n;
+
+	switch (*exp->p) {
+	case '!':
+		exp->p++;
+		if (!count)
+			RAISE(ERROR_KEY_NOT_FOUND, "!!: event not found");
+		return event_at(log, count - 1, spec, 1);
+	case '#':
+		exp->p++;
+		return string_builder_finalize(exp->sb);
+	case '-':
+		exp->p++;
+		if (!isdigit(*exp->p))
+			RAISE(ERROR_SYNTAX, "!-: bad event specification");
+		n = parse_number(exp);
+		if (!n || n > count)
+			RAISE(ERROR_KEY_NOT_FOUND, "!%.*s: event not found",
+			      (int)(exp->p - spec), spec);
+		return event_at(log, count - n, spec, exp->p - spec);
+	case '?': {
+		const char *start = ++exp->p;
+		size_t len = strcspn(start, "?\n");
+
+		exp->p += len;
+		if (*exp->p == '?')
+			exp->p++;
+		if (!len)
+			RAISE(ERROR_SYNTAX, "!?: no previous search string");
+		return find_substring(log, sized_strdup(exp->arena, start, len));
+	}
+	default:
+		if (isdigit(*exp->p)) {
+			n = parse_number(exp);
+			if (!n)
+				RAISE(ERROR_KEY_NOT_FOUND, "!0: event not found");
+			return event_at(log, n - 1, spec, exp->p - spec);
+		}
+		n = strcspn(exp->p, " \t\n:;&|<>()\"'`");
+		exp->p += n;
+		return find_prefix(log, spec, n);
+	}
+}
+
+/*
+ * Split a history event into words for the :n, :^ and :$ modifiers,
+ * keeping quoted strings together.
+ */
+static size_t split_words(const char *text, const char **starts, size_t *lens,
+			  size_t max_words)
+{
+	size_t count = 0;
+	const char *p = text;
+
+	for (;;) {
+		char quote = 0;
+		const char *start;
+
+		while (isspace(*p))
+			p++;
+		if (!*p || count == max_words)
+			return count;
+
+		start = p;
+		while (*p && (quote || !isspace(*p))) {
+			if (quote && *p == quote)
+				quote = 0;
+			else if (!quote && (*p == '\'' || *p == '"'))
+				quote = *p;
+			else if (*p == '\\' && p[1])
+				p++;
+			p++;
+		}
+		starts[count] = start;
+		lens[count] = p - start;
+		count++;
+	}
+}
+
+static const char *select_word(struct expansion *exp, const char *text,
+			       long n)
+{
+	size_t max_words = strlen(text) / 2 + 1;
+	const char **starts = arena_malloc(exp->arena, sizeof(char *), max_words);
+	size_t *lens = arena_malloc(exp->arena, sizeof(size_t), max_words);
+	size_t count = split_words(text, starts, lens, max_words);
+
+	if (n < 0)
+		n = count - 1;
+	if (!count || n >= count)
+		RAISE(ERROR_INDEX_OUT_OF_RANGE, ":%ld: bad word specifier", n);
+	return sized_strdup(exp->arena, starts[n], lens[n]);
+}
+
+static const char *read_delimited(struct expansion *exp, char delim)
+{
+	const char *start = exp->p;
+	const char *end = strchr(start, delim);
+
+	if (!end)
+		end = start + strlen(start);
+	exp->p = *end ? end + 1 : end;
+	return sized_strdup(exp->arena, start, end - start);
+}
+
+static const char *substitute(struct expansion *exp, const char *text,
+			      bool global)
+{
+	struct string_builder *sb = string_builder_same_arena(exp->sb);
+	const char *find;
+	const char *replace;
+	size_t find_len;
+	char delim = *exp->p;
+
+	if (!delim)
+		RAISE(ERROR_SYNTAX, ":s: missing delimiter");
+	exp->p++;
+	find = read_delimited(exp, delim);
+	replace = read_delimited(exp, delim);
+	find_len = strlen(find);
+	if (!find_len)
+		RAISE(ERROR_SYNTAX, ":s: empty search string");
+
+	for (;;) {
+		const char *match = strstr(text, find);
+
+		if (!match)
+			break;
+		string_builder_sized_append(sb, text, match - text);
+		string_builder_append(sb, replace);
+		text = match + find_len;
+		if (!global)
+			break;
+	}
+	string_builder_append(sb, text);
+	return string_builder_finalize(sb);
+}
+
+static const char *apply_modifiers(struct expansion *exp, const char *text)
+{
+	while (*exp->p == ':') {
+		exp->p++;
+		switch (*exp->p) {
+		case '$':
+			exp->p++;
+			text = select_word(exp, text, -1);
+			break;
+		case '^':
+			exp->p++;
+			text = select_word(exp, text, 1);
+			break;
+		case 'p':
+			exp->p++;
+			exp->print_only = true;
+			break;
+		case 's':
+			exp->p++;
+			text = substitute(exp, text, false);
+			break;
+		case 'g':
+			exp->p++;
+			if (*exp->p != 's')
+				RAISE(ERROR_SYNTAX, ":g: expected s after g");
+			exp->p++;
+			text = substitute(exp, text, true);
+			break;
+		default:
+			if (!isdigit(*exp->p))
+				RAISE(ERROR_SYNTAX, ":%c: unrecognized modifier",
+				      *exp->p);
+			text = select_word(exp, text, parse_number(exp));
+		}
+	}
+	return text;
+}
+
+static bool starts_expansion(const char *p)
+{
+	return p[0] == '!' && p[1] && !isspace(p[1]) && p[1] != '=' &&
+	       p[1] != '(';
+}
+
+enum history_expansion history_expand(struct history_log *log,
+				      const char *line, struct arena *arena,
+				      char **result)
+{
+	struct expansion exp = {
+		.log = log,
+		.arena = arena,
+		.sb = string_builder_new(arena),
+		.p = line,
+	};
+	bool expanded = false;
+	bool in_quote = false;
+
+	while (*exp.p) {
+		const char *start = exp.p;
+
+		while (*exp.p && (in_quote || !starts_expansion(exp.p))) {
+			if (*exp.p == '\'')
+				in_quote = !in_quote;
+			else if (!in_quote && *exp.p == '\\' && exp.p[1])
+				exp.p++;
+			exp.p++;
+		}
+		string_builder_sized_append(exp.sb, start, exp.p - start);
+		if (!*exp.p)
+			break;
+
+		exp.p++;
+		string_builder_append(exp.sb,
+				      apply_modifiers(&exp, parse_event(&exp)));
+		expanded = true;
+	}
+
+	if (!expanded)
+		return HISTORY_EXPANSION_NONE;
+
+	*result = string_builder_finalize(exp.sb);
+	if (exp.print_only)
+		return HISTORY_EXPANSION_PRINT_ONLY;
+	return HISTORY_EXPANSION_EXPANDED;
+}
+
+static struct history_log *test_log(void)
+{
+	struct history_log *log = history_log_new_memory();
+
+	history_log_append(log, "echo hello world");
+	history_log_append(log, "ls -l /tmp");
+	history_log_append(log, "cat 'a file' other");
+	history_log_append(log, "grep foo bar.txt");
+	return log;
+}
+
+static bool expands_to(struct history_log *log, const char *line,
+		       enum history_expansion expect, const char *expected)
+{
+	struct arena arena = { NULL };
+	char *result = NULL;
+	bool ok = history_expand(log, line, &arena, &result) == expect &&
+		  (!expected || !strcmp(result, expected));
+
+	arena_free(&arena);
+	return ok;
+}
+
+DEFTEST("history.expand.events")
+{
+	struct history_log *log = test_log();
+	struct arena arena = { NULL };
+	char *result;
+
+	EXPECT(expands_to(log, "echo no expansion", HISTORY_EXPANSION_NONE,
+			  NULL));
+	EXPECT(expands_to(log, "!!", HISTORY_EXPANSION_EXPANDED,
+			  "grep foo bar.txt"));
+	EXPECT(expands_to(log, "!1", HISTORY_EXPANSION_EXPANDED,
+			  "echo hello world"));
+	EXPECT(expands_to(log, "!-3 x", HISTORY_EXPANSION_EXPANDED,
+			  "ls -l /tmp x"));
+	EXPECT(expands_to(log, "!ec", HISTORY_EXPANSION_EXPANDED,
+			  "echo hello world"));
+	EXPECT(expands_to(log, "!?a file?", HISTORY_EXPANSION_EXPANDED,
+			  "cat 'a file' other"));
+	EXPECT(expands_to(log, "echo a !#", HISTORY_EXPANSION_EXPANDED,
+			  "echo a echo a "));
+	EXPECT(expands_to(log, "echo '!!' x!", HISTORY_EXPANSION_NONE, NULL));
+	EXPECT_RAISES(ERROR_KEY_NOT_FOUND,
+		      history_expand(log, "!99", &arena, &result));
+	EXPECT_RAISES(ERROR_KEY_NOT_FOUND,
+		      history_expand(log, "!nope", &arena, &result));
+
+	arena_free(&arena);
+	history_log_close(log);
+}
+
+DEFTEST("history.expand.modifiers")
+{
+	struct history_log *log = test_log();
+
+	EXPECT(expands_to(log, "echo !!:$", HISTORY_EXPANSION_EXPANDED,
+			  "echo bar.txt"));
+	EXPECT(expands_to(log, "echo !3:^", HISTORY_EXPANSION_EXPANDED,
+			  "echo 'a file'"));
+	EXPECT(expands_to(log, "!2:0", HISTORY_EXPANSION_EXPANDED, "ls"));
+	EXPECT(expands_to(log, "!1:s/l/L/", HISTORY_EXPANSION_EXPANDED,
+			  "echo heLlo world"));
+	EXPECT(expands_to(log, "!1:gs/l/L", HISTORY_EXPANSION_EXPANDED,
+			  "echo heLLo worLd"));
+	EXPECT(expands_to(log, "!ls:p", HISTORY_EXPANSION_PRINT_ONLY,
+			  "ls -l /tmp"));
+
+	history_log_close(log);
+}
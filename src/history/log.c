@@ -0,0 +1,518 @@
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "error.h"
+#include "history_index.h"
+#include "history_log.h"
+#include "unit.h"
+
+#define SCAN_BUFFER_SIZE (1 << 16)
+
+struct history_log {
+	int log_fd;
+	int index_fd;
+
+	/* Entries which were on disk when the log was opened */
+	const char *log_map;
+	size_t log_map_size;
+	const uint64_t *index_map;
+	size_t mapped_count;
+
+	/* Entries appended since the log was opened */
+	const char **appended;
+	size_t appended_count;
+	size_t appended_capacity;
+	struct arena strings;
+
+	unsigned pending_sync;
+
+	/* Built on first use, then maintained by history_log_append */
+	struct trigram_index *trigrams;
+	struct prefix_index *prefixes;
+};
+
+struct history_log *history_log_new_memory(void)
+{
+	struct history_log *log = checked_calloc(sizeof(struct history_log), 1);
+
+	log->log_fd = -1;
+	log->index_fd = -1;
+	return log;
+}
+
+static off_t file_size(int fd)
+{
+	struct stat st;
+
+	CHECKZ(fstat(fd, &st));
+	return st.st_size;
+}
+
+/*
+ * Scan the log for complete records starting at offset, and append
+ * the offset of each to the index. Return the offset just past the
+ * last complete record.
+ */
+static off_t index_records(struct history_log *log, off_t offset, off_t size)
+{
+	char *buf = checked_malloc(sizeof(char), SCAN_BUFFER_SIZE);
+	uint64_t record_start = offset;
+	off_t end = offset;
+
+	while (offset < size) {
+		ssize_t rv = pread(log->log_fd, buf, SCAN_BUFFER_SIZE, offset);
+
+		CHECKP(rv);
+		if (!rv)
+			break;
+		for (ssize_t i = 0; i < rv; i++) {
+			if (buf[i])
+				continue;
+			checked_write_all(log->index_fd, &record_start,
+					  sizeof(record_start));
+			record_start = offset + i + 1;
+			end = record_start;
+		}
+		offset += rv;
+	}
+
+	free(buf);
+	return end;
+}
+
+/*
+ * Find the end of the record starting at offset, or return -1 if the
+ * record is not terminated (a partial write).
+ */
+static off_t record_end(struct history_log *log, off_t offset, off_t size)
+{
+	char buf[4096];
+
+	while (offset < size) {
+		ssize_t rv = pread(log->log_fd, buf, sizeof(buf), offset);
+		char *nul;
+
+		CHECKP(rv);
+		if (!rv)
+			break;
+		nul = memchr(buf, '\0', rv);
+		if (nul)
+			return offset + (nul - buf) + 1;
+		offset += rv;
+	}
+	return -1;
+}
+
+/*
+ * Bring the index up to date with the log after a crash or a
+ * concurrent writer. In the common case, this is a single pread of
+ * the last index entry and the end of its record.
+ */
+static void recover(struct history_log *log)
+{
+	off_t log_size = file_size(log->log_fd);
+	off_t index_size = file_size(log->index_fd);
+	size_t entries = index_size / sizeof(uint64_t);
+	off_t indexed_end = 0;
+
+	if (index_size % sizeof(uint64_t))
+		CHECKZ(ftruncate(log->index_fd, entries * sizeof(uint64_t)));
+
+	while (entries) {
+		uint64_t last;
+
+		if (pread(log->index_fd, &last, sizeof(last),
+			  (entries - 1) * sizeof(last)) != sizeof(last))
+			RAISE(ERROR_CORRUPTION, "Short read from history index");
+
+		if (last < log_size) {
+			indexed_end = record_end(log, last, log_size);
+			if (indexed_end >= 0)
+				break;
+		}
+
+		/* The last entry is bad, drop it and try again */
+		entries--;
+		indexed_end = 0;
+		CHECKZ(ftruncate(log->index_fd, entries * sizeof(uint64_t)));
+	}
+
+	if (indexed_end < log_size) {
+		indexed_end = index_records(log, indexed_end, log_size);
+		if (indexed_end < log_size)
+			CHECKZ(ftruncate(log->log_fd, indexed_end));
+	}
+}
+
+static void map_files(struct history_log *log)
+{
+	size_t index_size;
+
+	log->log_map_size = file_size(log->log_fd);
+	index_size = file_size(log->index_fd);
+	log->mapped_count = index_size / sizeof(uint64_t);
+
+	if (log->log_map_size) {
+		log->log_map = mmap(NULL, log->log_map_size, PROT_READ,
+				    MAP_SHARED, log->log_fd, 0);
+		CHECK(log->log_map != MAP_FAILED);
+	}
+	if (log->mapped_count) {
+		log->index_map = mmap(NULL, index_size, PROT_READ, MAP_SHARED,
+				      log->index_fd, 0);
+		CHECK(log->index_map != MAP_FAILED);
+	}
+}
+
+struct history_log *history_log_open(const char *path)
+{
+	struct history_log *log = history_log_new_memory();
+	const int flags = O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC;
+	size_t path_len = strlen(path);
+	char *index_path = checked_malloc(sizeof(char), path_len + 5);
+
+	memcpy(index_path, path, path_len);
+	memcpy(index_path + path_len, ".idx", 5);
+
+	log->log_fd = checked_open(path, flags, 0600);
+	log->index_fd = checked_open(index_path, flags, 0600);
+	free(index_path);
+
+	CHECKZ(flock(log->log_fd, LOCK_EX));
+	recover(log);
+	map_files(log);
+	CHECKZ(flock(log->log_fd, LOCK_UN));
+
+	return log;
+}
+
+void history_log_close(struct history_log *log)
+{
+	if (log->log_fd >= 0) {
+		history_log_sync(log);
+		if (log->log_map)
+			munmap((void *)log->log_map, log->log_map_size);
+		if (log->index_map)
+			munmap((void *)log->index_map,
+			       log->mapped_count * sizeof(uint64_t));
+		checked_close(log->log_fd);
+		checked_close(log->index_fd);
+	}
+	if (log->trigrams)
+		trigram_index_free(log->trigrams);
+	if (log->prefixes)
+		prefix_index_free(log->prefixes);
+	free(log->appended);
+	arena_free(&log->strings);
+	free(log);
+}
+
+size_t history_log_count(struct history_log *log)
+{
+	return log->mapped_count + log->appended_count;
+}
+
+const char *history_log_get(struct history_log *log, size_t index)
+{
+	if (index < log->mapped_count) {
+		uint64_t offset = log->index_map[index];
+
+		if (offset >= log->log_map_size)
+			return NULL;
+		return log->log_map + offset;
+	}
+
+	index -= log->mapped_count;
+	if (index < log->appended_count)
+		return log->appended[index];
+	return NULL;
+}
+
+void history_log_append(struct history_log *log, const char *line)
+{
+	size_t size = strlen(line) + 1;
+	char *copy = arena_malloc(&log->strings, sizeof(char), size);
+
+	memcpy(copy, line, size);
+	if (log->appended_count == log->appended_capacity) {
+		log->appended_capacity = log->appended_capacity * 2 + 64;
+		log->appended = checked_realloc(log->appended, sizeof(char *),
+						log->appended_capacity);
+	}
+	log->appended[log->appended_count++] = copy;
+	if (log->trigrams)
+		trigram_index_add(log->trigrams, history_log_count(log) - 1,
+				  copy);
+	if (log->prefixes)
+		prefix_index_add(log->prefixes, history_log_count(log) - 1,
+				 copy);
+
+	if (log->log_fd < 0)
+		return;
+
+	/*
+	 * The lock makes the offset we record match where O_APPEND
+	 * places the line, even with other shells appending too.
+	 */
+	CHECKZ(flock(log->log_fd, LOCK_EX));
+	uint64_t offset = file_size(log->log_fd);
+	checked_write_all(log->log_fd, line, size);
+	checked_write_all(log->index_fd, &offset, sizeof(offset));
+	CHECKZ(flock(log->log_fd, LOCK_UN));
+
+	if (++log->pending_sync >= HISTORY_LOG_SYNC_BATCH)
+		history_log_sync(log);
+}
+
+/* Whether a line contains needle; a line lost from the log does not */
+static bool line_contains(struct history_log *log, size_t index,
+			  const char *needle)
+{
+	const char *line = history_log_get(log, index);
+
+	return line && strstr(line, needle);
+}
+
+static ssize_t linear_search(struct history_log *log, const char *needle,
+			     size_t before)
+{
+	for (size_t i = before; i > 0; i--) {
+		if (line_contains(log, i - 1, needle))
+			return i - 1;
+	}
+	return -1;
+}
+
+ssize_t history_log_search(struct history_log *log, const char *needle,
+			   size_t before)
+{
+	const unsigned *ids;
+	size_t count, lo, hi;
+
+	if (before > history_log_count(log))
+		before = history_log_count(log);
+
+	/* Too short to have a trigram, but also matches quickly */
+	if (strlen(needle) < 3)
+		return linear_search(log, needle, before);
+
+	if (!log->trigrams) {
+		log->trigrams = trigram_index_new();
+		for (size_t i = 0; i < history_log_count(log); i++) {
+			const char *line = history_log_get(log, i);
+
+			if (line)
+				trigram_index_add(log->trigrams, i, line);
+		}
+	}
+
+	trigram_index_candidates(log->trigrams, needle, &ids, &count);
+
+	/* Skip candidates which are not before the requested index */
+	lo = 0;
+	hi = count;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (ids[mid] < before)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	while (lo > 0) {
+		size_t id = ids[--lo];
+
+		if (line_contains(log, id, needle))
+			return id;
+	}
+	return -1;
+}
+
+static struct prefix_index *prefixes(struct history_log *log)
+{
+	if (!log->prefixes) {
+		log->prefixes = prefix_index_new();
+		for (size_t i = 0; i < history_log_count(log); i++) {
+			const char *line = history_log_get(log, i);
+
+			if (line)
+				prefix_index_add(log->prefixes, i, line);
+		}
+	}
+	return log->prefixes;
+}
+
+ssize_t history_log_search_prefix(struct history_log *log, const char *prefix,
+				  size_t prefix_len)
+{
+	return prefix_index_latest(prefixes(log), prefix, prefix_len);
+}
+
+void history_log_complete(struct history_log *log, const char *prefix,
+			  void (*func)(const char *word, size_t len,
+				       void *data),
+			  void *data)
+{
+	prefix_index_complete(prefixes(log), prefix, strlen(prefix), func,
+			      data);
+}
+
+void history_log_sync(struct history_log *log)
+{
+	if (log->log_fd < 0 || !log->pending_sync)
+		return;
+	CHECKZ(fdatasync(log->log_fd));
+	CHECKZ(fdatasync(log->index_fd));
+	log->pending_sync = 0;
+}
+
+static char *make_temp_path(void)
+{
+	char *path = checked_strdup("/tmp/history_log_test_XXXXXX");
+	int fd = CHECKP(mkstemp(path));
+
+	checked_close(fd);
+	return path;
+}
+
+static void remove_temp_path(char *path)
+{
+	char index_path[64];
+
+	snprintf(index_path, sizeof(index_path), "%s.idx", path);
+	unlink(index_path);
+	unlink(path);
+	free(path);
+}
+
+DEFTEST("history.log.memory")
+{
+	struct history_log *log = history_log_new_memory();
+
+	EXPECT(history_log_count(log) == 0);
+	EXPECT_NULL(history_log_get(log, 0));
+	history_log_append(log, "echo hi");
+	history_log_append(log, "ls");
+	EXPECT(history_log_count(log) == 2);
+	EXPECT(!strcmp(history_log_get(log, 0), "echo hi"));
+	EXPECT(!strcmp(history_log_get(log, 1), "ls"));
+	history_log_close(log);
+}
+
+DEFTEST("history.log.reopen")
+{
+	char *path = make_temp_path();
+	struct history_log *log = history_log_open(path);
+	char line[32];
+
+	for (int i = 0; i < 100; i++) {
+		snprintf(line, sizeof(line), "echo %d", i);
+		history_log_append(log, line);
+	}
+	history_log_close(log);
+
+	log = history_log_open(path);
+	EXPECT(history_log_count(log) == 100);
+	EXPECT(!strcmp(history_log_get(log, 42), "echo 42"));
+	history_log_append(log, "pwd");
+	EXPECT(!strcmp(history_log_get(log, 100), "pwd"));
+	history_log_close(log);
+
+	log = history_log_open(path);
+	EXPECT(history_log_count(log) == 101);
+	EXPECT(!strcmp(history_log_get(log, 100), "pwd"));
+	history_log_close(log);
+	remove_temp_path(path);
+}
+
+DEFTEST("history.log.search")
+{
+	struct history_log *log = history_log_new_memory();
+
+	history_log_append(log, "make all");
+	history_log_append(log, "git commit -m fix");
+	history_log_append(log, "make clean");
+	EXPECT(history_log_search(log, "make", 3) == 2);
+	EXPECT(history_log_search(log, "make", 2) == 0);
+	EXPECT(history_log_search(log, "commit", 3) == 1);
+	EXPECT(history_log_search(log, "nothing", 3) == -1);
+	EXPECT(history_log_search(log, "ll", 3) == 0);
+
+	/* The index is maintained after it is built */
+	history_log_append(log, "git commit --amend");
+	EXPECT(history_log_search(log, "commit", 4) == 3);
+	EXPECT(history_log_search(log, "amend", 100) == 3);
+
+	EXPECT(history_log_search_prefix(log, "mak", 3) == 2);
+	EXPECT(history_log_search_prefix(log, "git", 3) == 3);
+	history_log_append(log, "make install");
+	EXPECT(history_log_search_prefix(log, "mak", 3) == 4);
+	history_log_close(log);
+}
+
+DEFTEST("history.log.recover")
+{
+	char *path = make_temp_path();
+	struct history_log *log = history_log_open(path);
+	int fd;
+
+	history_log_append(log, "first");
+	history_log_append(log, "second");
+	history_log_close(log);
+
+	/* Simulate a crash: an unindexed line, then a partial one */
+	fd = checked_open(path, O_WRONLY | O_APPEND, 0);
+	checked_write_all(fd, "third\0fourt", 11);
+	checked_close(fd);
+
+	log = history_log_open(path);
+	EXPECT(history_log_count(log) == 3);
+	EXPECT(!strcmp(history_log_get(log, 2), "third"));
+	history_log_append(log, "fourth");
+	history_log_close(log);
+
+	log = history_log_open(path);
+	EXPECT(history_log_count(log) == 4);
+	EXPECT(!strcmp(history_log_get(log, 3), "fourth"));
+	history_log_close(log);
+	remove_temp_path(path);
+}
+
+DEFTEST("history.log.search_lost")
+{
+	char *path = make_temp_path();
+	struct history_log *log = history_log_open(path);
+	char index_path[64];
+	uint64_t lost = UINT64_MAX;
+	int fd;
+
+	history_log_append(log, "echo one");
+	history_log_append(log, "echo two");
+	history_log_append(log, "echo three");
+	history_log_close(log);
+
+	/* Point the middle entry past the end of the log */
+	snprintf(index_path, sizeof(index_path), "%s.idx", path);
+	fd = checked_open(index_path, O_WRONLY, 0);
+	CHECK(pwrite(fd, &lost, sizeof(lost), sizeof(lost)) == sizeof(lost));
+	checked_close(fd);
+
+	log = history_log_open(path);
+	EXPECT_NULL(history_log_get(log, 1));
+	EXPECT(history_log_search(log, "ec", 2) == 0);
+	EXPECT(history_log_search(log, "echo", 2) == 0);
+	EXPECT(history_log_search(log, "two", 3) == -1);
+	history_log_close(log);
+	remove_temp_path(path);
+}
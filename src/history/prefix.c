@@ -0,0 +1,285 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "arena.h"
+#include "error.h"
+#include "history_index.h"
+#include "string_builder.h"
+#include "unit.h"
+
+struct prefix_node {
+	char *label;
+	size_t label_len;
+	/* Most recent line with a first word in this subtree */
+	size_t latest;
+	/* A first word ends at this node */
+	bool terminal;
+	struct prefix_node **children;
+	size_t child_count;
+};
+
+struct prefix_index {
+	struct prefix_node root;
+	bool empty;
+};
+
+struct prefix_index *prefix_index_new(void)
+{
+	struct prefix_index *index =
+		checked_calloc(sizeof(struct prefix_index), 1);
+
+	index->empty = true;
+	return index;
+}
+
+static void node_free_children(struct prefix_node *node)
+{
+	for (size_t i = 0; i < node->child_count; i++) {
+		node_free_children(node->children[i]);
+		free(node->children[i]->label);
+		free(node->children[i]);
+	}
+	free(node->children);
+}
+
+void prefix_index_free(struct prefix_index *index)
+{
+	node_free_children(&index->root);
+	free(index);
+}
+
+static struct prefix_node **find_child(struct prefix_node *node, char c)
+{
+	for (size_t i = 0; i < node->child_count; i++) {
+		if (node->children[i]->label[0] == c)
+			return &node->children[i];
+	}
+	return NULL;
+}
+
+static struct prefix_node *new_node(const char *label, size_t label_len,
+				    size_t latest)
+{
+	struct prefix_node *node = checked_calloc(sizeof(struct prefix_node), 1);
+
+	node->label = checked_malloc(sizeof(char), label_len);
+	memcpy(node->label, label, label_len);
+	node->label_len = label_len;
+	node->latest = latest;
+	return node;
+}
+
+static void add_child(struct prefix_node *node, struct prefix_node *child)
+{
+	node->children = checked_realloc(node->children,
+					 sizeof(struct prefix_node *),
+					 node->child_count + 1);
+	node->children[node->child_count++] = child;
+}
+
+static size_t common_prefix(const char *a, size_t a_len, const char *b,
+			    size_t b_len)
+{
+	size_t i = 0;
+
+	while (i < a_len && i < b_len && a[i] == b[i])
+		i++;
+	return i;
+}
+
+/*
+ * Split a node so its label is only the first len bytes, with the
+ * remainder of the label moving to a new child.
+ */
+static void split(struct prefix_node *node, size_t len)
+{
+	struct prefix_node *rest = new_node(node->label + len,
+					    node->label_len - len, node->latest);
+
+	rest->terminal = node->terminal;
+	rest->children = node->children;
+	rest->child_count = node->child_count;
+
+	node->label_len = len;
+	node->terminal = false;
+	node->children = NULL;
+	node->child_count = 0;
+	add_child(node, rest);
+}
+
+void prefix_index_add(struct prefix_index *index, size_t id, const char *line)
+{
+	struct prefix_node *node = &index->root;
+	const char *word = line;
+	size_t len = strcspn(line, " \t\n");
+
+	index->empty = false;
+	node->latest = id;
+	while (len) {
+		struct prefix_node **child = find_child(node, *word);
+		size_t common;
+
+		if (!child) {
+			struct prefix_node *leaf = new_node(word, len, id);
+
+			add_child(node, leaf);
+			node = leaf;
+			break;
+		}
+
+		common = common_prefix((*child)->label, (*child)->label_len,
+				       word, len);
+		if (common < (*child)->label_len)
+			split(*child, common);
+		node = *child;
+		node->latest = id;
+		word += common;
+		len -= common;
+	}
+	node->terminal = true;
+}
+
+static struct prefix_node *find_prefix(struct prefix_index *index,
+				       const char *prefix, size_t prefix_len,
+				       struct string_builder *path)
+{
+	struct prefix_node *node = &index->root;
+
+	while (prefix_len) {
+		struct prefix_node **child = find_child(node, *prefix);
+		size_t common;
+
+		if (!child)
+			return NULL;
+		common = common_prefix((*child)->label, (*child)->label_len,
+				       prefix, prefix_len);
+		if (common < prefix_len && common < (*child)->label_len)
+			return NULL;
+		node = *child;
+		if (path)
+			string_builder_sized_append(path, node->label,
+						    node->label_len);
+		prefix += common;
+		prefix_len -= common;
+	}
+	return node;
+}
+
+ssize_t prefix_index_latest(struct prefix_index *index, const char *prefix,
+			    size_t prefix_len)
+{
+	struct prefix_node *node;
+
+	if (index->empty)
+		return -1;
+	node = find_prefix(index, prefix, prefix_len, NULL);
+	if (!node)
+		return -1;
+	return node->latest;
+}
+
+struct completion {
+	char *word;
+	size_t len;
+	size_t capacity;
+	void (*func)(const char *word, size_t len, void *data);
+	void *data;
+};
+
+static void complete_node(struct prefix_node *node, struct completion *comp)
+{
+	size_t saved_len = comp->len;
+
+	if (comp->len + node->label_len > comp->capacity) {
+		comp->capacity = (comp->len + node->label_len) * 2;
+		comp->word = checked_realloc(comp->word, sizeof(char),
+					     comp->capacity);
+	}
+	memcpy(comp->word + comp->len, node->label, node->label_len);
+	comp->len += node->label_len;
+
+	if (node->terminal)
+		comp->func(comp->word, comp->len, comp->data);
+	for (size_t i = 0; i < node->child_count; i++)
+		complete_node(node->children[i], comp);
+
+	comp->len = saved_len;
+}
+
+void prefix_index_complete(struct prefix_index *index, const char *prefix,
+			   size_t prefix_len,
+			   void (*func)(const char *word, size_t len,
+					void *data),
+			   void *data)
+{
+	struct arena arena = { NULL };
+	struct string_builder *path = string_builder_new(&arena);
+	struct prefix_node *node = find_prefix(index, prefix, prefix_len, path);
+	struct completion comp = { .func = func, .data = data };
+
+	if (node && node != &index->root) {
+		/* The path to the node, without the node's own label */
+		comp.len = string_builder_length(path) - node->label_len;
+		comp.capacity = comp.len + 64;
+		comp.word = checked_malloc(sizeof(char), comp.capacity);
+		memcpy(comp.word, string_builder_finalize(path), comp.len);
+		complete_node(node, &comp);
+		free(comp.word);
+	}
+	arena_free(&arena);
+}
+
+static void count_words(const char *word, size_t len, void *data)
+{
+	(*(size_t *)data)++;
+}
+
+DEFTEST("history.prefix.latest")
+{
+	struct prefix_index *index = prefix_index_new();
+
+	EXPECT(prefix_index_latest(index, "ls", 2) == -1);
+	prefix_index_add(index, 0, "ls -l");
+	prefix_index_add(index, 1, "lsblk");
+	prefix_index_add(index, 2, "make all");
+	prefix_index_add(index, 3, "ls");
+	prefix_index_add(index, 4, "git status");
+	prefix_index_add(index, 5, "git");
+
+	EXPECT(prefix_index_latest(index, "ls", 2) == 3);
+	EXPECT(prefix_index_latest(index, "lsb", 3) == 1);
+	EXPECT(prefix_index_latest(index, "l", 1) == 3);
+	EXPECT(prefix_index_latest(index, "m", 1) == 2);
+	EXPECT(prefix_index_latest(index, "gi", 2) == 5);
+	EXPECT(prefix_index_latest(index, "lsz", 3) == -1);
+	EXPECT(prefix_index_latest(index, "mk", 2) == -1);
+	EXPECT(prefix_index_latest(index, "make all", 8) == -1);
+
+	prefix_index_free(index);
+}
+
+DEFTEST("history.prefix.complete")
+{
+	struct prefix_index *index = prefix_index_new();
+	size_t count = 0;
+
+	prefix_index_add(index, 0, "git status");
+	prefix_index_add(index, 1, "gitk");
+	prefix_index_add(index, 2, "gcc -O2");
+	prefix_index_add(index, 3, "git log");
+	prefix_index_add(index, 4, "grep x");
+
+	prefix_index_complete(index, "gi", 2, count_words, &count);
+	EXPECT(count == 2);
+	count = 0;
+	prefix_index_complete(index, "g", 1, count_words, &count);
+	EXPECT(count == 4);
+	count = 0;
+	prefix_index_complete(index, "x", 1, count_words, &count);
+	EXPECT(count == 0);
+
+	prefix_index_free(index);
+}
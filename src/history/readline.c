@@ -0,0 +1,159 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <readline/readline.h>
+
+#include "error.h"
+#include "history_log.h"
+#include "history_readline.h"
+#include "shell_builtins.h"
+
+#define SEARCH_QUERY_MAX 256
+
+static struct history_log *readline_history;
+
+static void show_search(const char *query, ssize_t match, bool failed)
+{
+	const char *line = "";
+	const char *found;
+
+	if (match >= 0)
+		line = history_log_get(readline_history, match);
+	if (!line)
+		line = "";
+	rl_message("(%sreverse-i-search)`%s': ", failed ? "failed " : "",
+		   query);
+	rl_replace_line(line, 0);
+	rl_point = 0;
+	/* After a failure, the last match need not contain the query */
+	if (!failed && *query) {
+		found = strstr(line, query);
+		if (found)
+			rl_point = found - line;
+	}
+	rl_redisplay();
+}
+
+/*
+ * A replacement for readline's reverse-search-history. Each
+ * keystroke is answered by the log's trigram index, so this stays
+ * fast even for very large histories.
+ */
+static int reverse_search(int count, int key)
+{
+	char query[SEARCH_QUERY_MAX] = "";
+	size_t query_len = 0;
+	size_t count_all = history_log_count(readline_history);
+	ssize_t match = -1;
+	bool failed = false;
+	char *saved_line = checked_strdup(rl_line_buffer);
+	int saved_point = rl_point;
+
+	rl_save_prompt();
+	show_search(query, match, failed);
+
+	for (;;) {
+		int c = rl_read_key();
+		ssize_t found;
+
+		if (c == CTRL('r')) {
+			if (!query_len)
+				continue;
+			found = history_log_search(readline_history, query,
+						   match >= 0 ? match :
+								count_all);
+		} else if (c == CTRL('g')) {
+			rl_replace_line(saved_line, 0);
+			rl_point = saved_point;
+			break;
+		} else if (c == 127 || c == CTRL('h')) {
+			if (query_len)
+				query[--query_len] = '\0';
+			found = query_len ? history_log_search(readline_history,
+							       query, count_all) :
+					    -1;
+		} else if (c >= ' ' && c < 127 &&
+			   query_len + 1 < SEARCH_QUERY_MAX) {
+			query[query_len++] = c;
+			query[query_len] = '\0';
+
+			/* The current match may still contain the query */
+			found = history_log_search(readline_history, query,
+						   match >= 0 ? match + 1 :
+								count_all);
+		} else {
+			/* Accept the match, and let readline handle the key */
+			rl_execute_next(c);
+			break;
+		}
+
+		failed = found < 0;
+		if (!failed)
+			match = found;
+		show_search(query, match, failed);
+	}
+
+	rl_restore_prompt();
+	rl_clear_message();
+	free(saved_line);
+	return 0;
+}
+
+static char **command_matches;
+static size_t command_match_count;
+static size_t command_match_next;
+
+static void add_command_match(const char *word, size_t len, void *data)
+{
+	command_matches = checked_realloc(command_matches, sizeof(char *),
+					  command_match_count + 1);
+	command_matches[command_match_count++] = checked_strndup(word, len);
+}
+
+/*
+ * Generate command names for completion: builtins, and every command
+ * name previously used, straight from the log's prefix index.
+ */
+static char *command_generator(const char *text, int state)
+{
+	if (!state) {
+		size_t text_len = strlen(text);
+
+		while (command_match_next < command_match_count)
+			free(command_matches[command_match_next++]);
+		command_match_count = 0;
+		command_match_next = 0;
+
+		for (struct builtin_command_list *p = builtin_command_list; p;
+		     p = p->rest) {
+			if (!strncmp(p->first->name, text, text_len))
+				add_command_match(p->first->name,
+						  strlen(p->first->name), NULL);
+		}
+		history_log_complete(readline_history, text, add_command_match,
+				     NULL);
+	}
+
+	if (command_match_next < command_match_count)
+		return command_matches[command_match_next++];
+	return NULL;
+}
+
+static char **attempt_completion(const char *text, int start, int end)
+{
+	/* Only the command name is completed from history */
+	for (int i = 0; i < start; i++) {
+		if (rl_line_buffer[i] != ' ' && rl_line_buffer[i] != '\t')
+			return NULL;
+	}
+	return rl_completion_matches(text, command_generator);
+}
+
+void history_readline_init(struct history_log *log)
+{
+	readline_history = log;
+	rl_bind_keyseq("\\C-r", reverse_search);
+	rl_attempted_completion_function = attempt_completion;
+}
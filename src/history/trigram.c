@@ -0,0 +1,188 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "history_index.h"
+#include "unit.h"
+
+#define TRIGRAM_INDEX_INITIAL_SLOTS 4096
+
+struct posting_list {
+	uint32_t trigram;
+	uint32_t count;
+	uint32_t capacity;
+	unsigned *ids;
+};
+
+/*
+ * An open addressing hash table of posting lists. A slot is empty
+ * when its ids pointer is NULL.
+ */
+struct trigram_index {
+	struct posting_list *slots;
+	size_t slot_count;
+	size_t used;
+};
+
+struct trigram_index *trigram_index_new(void)
+{
+	struct trigram_index *index =
+		checked_calloc(sizeof(struct trigram_index), 1);
+
+	index->slot_count = TRIGRAM_INDEX_INITIAL_SLOTS;
+	index->slots = checked_calloc(sizeof(struct posting_list),
+				      index->slot_count);
+	return index;
+}
+
+void trigram_index_free(struct trigram_index *index)
+{
+	for (size_t i = 0; i < index->slot_count; i++)
+		free(index->slots[i].ids);
+	free(index->slots);
+	free(index);
+}
+
+static uint32_t trigram_at(const char *p)
+{
+	const unsigned char *u = (const unsigned char *)p;
+
+	return (u[0] << 16) | (u[1] << 8) | u[2];
+}
+
+static size_t slot_for(struct trigram_index *index, uint32_t trigram)
+{
+	/* Knuth's multiplicative hash spreads the packed bytes */
+	size_t slot = (trigram * 2654435761u) & (index->slot_count - 1);
+
+	while (index->slots[slot].ids &&
+	       index->slots[slot].trigram != trigram)
+		slot = (slot + 1) & (index->slot_count - 1);
+	return slot;
+}
+
+static void grow(struct trigram_index *index)
+{
+	struct posting_list *old_slots = index->slots;
+	size_t old_count = index->slot_count;
+
+	index->slot_count *= 2;
+	index->slots = checked_calloc(sizeof(struct posting_list),
+				      index->slot_count);
+	for (size_t i = 0; i < old_count; i++) {
+		if (old_slots[i].ids)
+			index->slots[slot_for(index, old_slots[i].trigram)] =
+				old_slots[i];
+	}
+	free(old_slots);
+}
+
+static void posting_add(struct trigram_index *index, uint32_t trigram,
+			unsigned id)
+{
+	size_t slot = slot_for(index, trigram);
+	struct posting_list *list = &index->slots[slot];
+
+	if (!list->ids) {
+		if ((index->used + 1) * 4 > index->slot_count * 3) {
+			grow(index);
+			slot = slot_for(index, trigram);
+			list = &index->slots[slot];
+		}
+		index->used++;
+		list->trigram = trigram;
+		list->capacity = 4;
+		list->ids = checked_malloc(sizeof(unsigned), list->capacity);
+	} else if (list->ids[list->count - 1] == id) {
+		/* Already recorded for this line */
+		return;
+	} else if (list->count == list->capacity) {
+		list->capacity *= 2;
+		list->ids = checked_realloc(list->ids, sizeof(unsigned),
+					    list->capacity);
+	}
+	list->ids[list->count++] = id;
+}
+
+void trigram_index_add(struct trigram_index *index, size_t id,
+		       const char *line)
+{
+	size_t len = strlen(line);
+
+	for (size_t i = 0; i + 3 <= len; i++)
+		posting_add(index, trigram_at(line + i), id);
+}
+
+void trigram_index_candidates(struct trigram_index *index, const char *needle,
+			      const unsigned **ids, size_t *count)
+{
+	size_t len = strlen(needle);
+
+	CHECK(len >= 3);
+	*ids = NULL;
+	*count = 0;
+	for (size_t i = 0; i + 3 <= len; i++) {
+		struct posting_list *list =
+			&index->slots[slot_for(index, trigram_at(needle + i))];
+
+		if (!list->ids) {
+			*ids = NULL;
+			*count = 0;
+			return;
+		}
+		if (!*ids || list->count < *count) {
+			*ids = list->ids;
+			*count = list->count;
+		}
+	}
+}
+
+DEFTEST("history.trigram.candidates")
+{
+	struct trigram_index *index = trigram_index_new();
+	const unsigned *ids;
+	size_t count;
+
+	trigram_index_add(index, 0, "make all");
+	trigram_index_add(index, 1, "git commit");
+	trigram_index_add(index, 2, "make clean all");
+	trigram_index_add(index, 3, "aaaaaa");
+
+	trigram_index_candidates(index, "make", &ids, &count);
+	ASSERT(count == 2);
+	EXPECT(ids[0] == 0 && ids[1] == 2);
+
+	trigram_index_candidates(index, "clean", &ids, &count);
+	ASSERT(count == 1);
+	EXPECT(ids[0] == 2);
+
+	trigram_index_candidates(index, "aaaa", &ids, &count);
+	ASSERT(count == 1);
+	EXPECT(ids[0] == 3);
+
+	trigram_index_candidates(index, "zzz", &ids, &count);
+	EXPECT(count == 0);
+
+	trigram_index_free(index);
+}
+
+DEFTEST("history.trigram.grow")
+{
+	struct trigram_index *index = trigram_index_new();
+	char line[4] = { 0 };
+	const unsigned *ids;
+	size_t count;
+
+	for (unsigned i = 0; i < 26 * 26 * 26; i++) {
+		line[0] = 'a' + i % 26;
+		line[1] = 'a' + (i / 26) % 26;
+		line[2] = 'a' + (i / 676) % 26;
+		trigram_index_add(index, i, line);
+	}
+	trigram_index_candidates(index, "bcd", &ids, &count);
+	EXPECT(count == 1);
+	trigram_index_free(index);
+}
@@ -1,31 +1,1333 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
-#include "alias.h"
+#include "arena.h"
+#include "arith.h"
+#include "commands.h"
+#include "cwd.h"
 #include "error.h"
+#include "expand.h"
+#include "fd_cache.h"
+#include "functions.h"
+#include "history_log.h"
 #include "interpreter.h"
+#include "jobs.h"
+#include "prompt.h"
+#include "redirect.h"
+#include "shell_builtins.h"
+#include "string_builder.h"
+#include "trace.h"
+#include "variables.h"
+#include "vm.h"
 
-/* Here is where I implemented my core interpreter logic (running
-   commands, keeping track of variables), etc. Feel free to replace
-   with your own design ;) */
+extern char **environ;
+
+/* Deeper than this, a function calling itself has surely run away */
+#define FUNCTION_DEPTH_MAX 1000
+
+static const struct io_fds standard_fds = {
+	.input_fd = STDIN_FILENO,
+	.output_fd = STDOUT_FILENO,
+	.error_fd = STDERR_FILENO,
+};
 
 struct interpreter_state *interpreter_new(bool aliases_enabled)
 {
 	struct interpreter_state *interp =
 		checked_calloc(sizeof(struct interpreter_state), 1);
 
-	if (aliases_enabled)
-		interp->aliases = alias_table_new();
+	interp->commands = command_table_new();
+	interp->aliases_enabled = aliases_enabled;
 
-	/* Do any other initialization you need */
+	interp->variables = variable_table_new();
+	variable_table_import(interp->variables, environ);
+	interp->jobs = job_table_new();
+	interp->cwd = cwd_new();
+	interp->probe_fd = -1;
 
 	return interp;
 }
 
 void interpreter_free(struct interpreter_state *interp)
 {
-	if (interp->aliases)
-		alias_table_free(interp->aliases);
+	command_table_free(interp->commands);
+	variable_table_free(interp->variables);
+	job_table_free(interp->jobs);
+	cwd_free(interp->cwd);
+	if (interp->fd_cache)
+		fd_cache_free(interp->fd_cache);
+	if (interp->trace)
+		trace_close(interp->trace);
+	trace_launches_free(&interp->launches);
+	if (interp->history)
+		history_log_close(interp->history);
+	if (interp->prompt)
+		prompt_free(interp->prompt);
 	free(interp);
 }
 
-/* Probably want a lot of other additional functionality... */
+static void print_error(struct error *error)
+{
+	if (error->message)
+		dprintf(STDERR_FILENO, "shell: %s\n", error->message);
+	else
+		dprintf(STDERR_FILENO, "shell: %s\n",
+			error_type_as_string[error->type]);
+}
+
+/* The status a child process exits with after an error */
+static int error_status(struct error *error)
+{
+	int status = 1;
+
+	if (error->type == ERROR_SYSTEM_EXIT)
+		sscanf(error->message, "%d", &status);
+	else
+		print_error(error);
+	return status;
+}
+
+static __attribute__((noreturn)) void child_exit(int status)
+{
+	fflush(NULL);
+	_exit(status);
+}
+
+/*
+ * Fork a child. If probe is set and the shell is tracing or timing,
+ * the child is given a probe, and its launch is recorded when it is
+ * waited for.
+ */
+static pid_t fork_child(struct interpreter_state *interp, bool probe)
+{
+	int probe_fds[2] = { -1, -1 };
+	uint64_t start = 0;
+	pid_t pid;
+
+	probe = probe && (interp->trace || interp->timing);
+	if (probe) {
+		CHECKP(pipe2(probe_fds, O_CLOEXEC | O_NONBLOCK));
+		start = trace_now();
+	}
+
+	/* Otherwise buffered output would be written by both processes */
+	fflush(NULL);
+	pid = checked_fork();
+
+	if (pid == 0) {
+		/* Only the process which opened a trace may write to it */
+		interp->trace = NULL;
+		interp->timing = NULL;
+		interp->launches.count = 0;
+		interp->probe_fd = probe_fds[1];
+		if (probe)
+			close(probe_fds[0]);
+		return 0;
+	}
+
+	if (probe) {
+		checked_close(probe_fds[1]);
+		trace_launch_add(&interp->launches, pid, probe_fds[0], start);
+	}
+	return pid;
+}
+
+/* In a child, report that the command is about to start */
+static void probe(struct interpreter_state *interp, const char *name)
+{
+	if (interp->probe_fd >= 0)
+		trace_probe(interp->probe_fd, name);
+}
+
+int interpreter_wait(struct interpreter_state *interp, pid_t pid)
+{
+	struct trace_record record;
+	struct rusage usage;
+	int status;
+
+	while (wait4(pid, &status, 0, &usage) < 0) {
+		if (errno != EINTR)
+			RAISE(ERROR_INVALID_ARGUMENT, "waitpid(%d): %s",
+			      (int)pid, strerror(errno));
+	}
+
+	if (WIFSIGNALED(status))
+		status = 128 + WTERMSIG(status);
+	else
+		status = WEXITSTATUS(status);
+
+	if (interp && trace_launch_finish(&interp->launches, pid, status,
+					  &usage, &record)) {
+		if (interp->trace)
+			trace_push(interp->trace, &record);
+		if (interp->timing)
+			trace_totals_add(interp->timing, &record);
+	}
+	return status;
+}
+
+static void assign(struct interpreter_state *interp,
+		   struct ast_assignment_list *assignments, bool export,
+		   struct arena *arena)
+{
+	for (; assignments; assignments = assignments->rest) {
+		struct ast_assignment *assignment = assignments->first;
+		char *name = arena_malloc(arena, sizeof(char),
+					  assignment->name->size + 1);
+
+		memcpy(name, assignment->name->data, assignment->name->size);
+		name[assignment->name->size] = '\0';
+		variable_set(interp->variables, name,
+			     expand_word(interp, assignment->value, arena));
+		if (export)
+			variable_export(interp->variables, name);
+	}
+}
+
+#define APPEND_FLAGS (O_WRONLY | O_CREAT | O_APPEND)
+
+static void open_target(struct interpreter_state *interp,
+			struct redirect_plan *plan, int target_fd,
+			struct ast_argument *target, int flags,
+			struct arena *arena)
+{
+	const char *path = expand_word(interp, target, arena);
+	char *key;
+	int fd;
+
+	if (!interp->fd_cache || flags != APPEND_FLAGS) {
+		redirect_plan_open(plan, target_fd, cwd_fd(interp->cwd), path,
+				   flags);
+		return;
+	}
+
+	key = cwd_logical_path(cwd_path(interp->cwd), path);
+	fd = fd_cache_open(interp->fd_cache, cwd_fd(interp->cwd), key, path,
+			   flags);
+	free(key);
+	redirect_plan_use(plan, target_fd, fd);
+}
+
+static void open_redirections(struct interpreter_state *interp,
+			      struct ast_command *cmd,
+			      struct redirect_plan *plan, struct arena *arena)
+{
+	if (cmd->input_file)
+		open_target(interp, plan, STDIN_FILENO, cmd->input_file,
+			    O_RDONLY, arena);
+	if (cmd->output_file)
+		open_target(interp, plan, STDOUT_FILENO, cmd->output_file,
+			    O_WRONLY | O_CREAT | O_TRUNC, arena);
+	if (cmd->append_file)
+		open_target(interp, plan, STDOUT_FILENO, cmd->append_file,
+			    APPEND_FLAGS, arena);
+}
+
+/*
+ * Find the file to run for an external command through the shell's
+ * $PATH, as execvp() would.
+ *
+ * Return: The path, or NULL if there is no such command.
+ */
+static const char *find_command(struct interpreter_state *interp,
+				const char *name, struct arena *arena)
+{
+	const char *dirs = variable_get(interp->variables, "PATH");
+	const char *found = NULL;
+	struct stat st;
+
+	if (strchr(name, '/'))
+		return name;
+	if (!dirs)
+		dirs = "/bin:/usr/bin";
+
+	while (!found) {
+		size_t len = strcspn(dirs, ":");
+		char *path = arena_malloc(arena, sizeof(char),
+					  len + strlen(name) + 3);
+
+		if (len)
+			sprintf(path, "%.*s/%s", (int)len, dirs, name);
+		else
+			sprintf(path, "./%s", name);
+		if (!stat(path, &st) && S_ISREG(st.st_mode)) {
+			/* Something not executable still gives EACCES */
+			if (!access(path, X_OK))
+				return path;
+			found = found ? found : path;
+		}
+		if (!dirs[len])
+			break;
+		dirs += len + 1;
+	}
+	return found;
+}
+
+/*
+ * Runs in a child process, or in the shell when it is to be replaced:
+ * apply the assignments of cmd, if any, to the environment and exec it.
+ * When there are no assignments, envp is the environment computed by
+ * the parent, so a cached one is reused. The file run is path if that
+ * has been found already, or else argv[0] looked up through $PATH once
+ * the assignments, which may change it, are made.
+ */
+static __attribute__((noreturn)) void
+exec_external(struct interpreter_state *interp, struct ast_command *cmd,
+	      char **argv, char *const *envp, struct redirect_plan *plan,
+	      const char *path, struct arena *arena)
+{
+	struct arena scratch = { NULL };
+	struct error error;
+
+	if (GET_ERROR(&error))
+		child_exit(error_status(&error));
+
+	/* The process is replaced or exits, so nothing here is freed */
+	if (!arena)
+		arena = &scratch;
+	if (cmd && cmd->assignments) {
+		assign(interp, cmd->assignments, true, arena);
+		envp = variable_table_envp(interp->variables);
+	}
+	if (!path)
+		path = find_command(interp, argv[0], arena);
+	redirect_plan_apply(plan);
+	jobs_child_init(interp->jobs);
+	probe(interp, argv[0]);
+
+	if (path)
+		execve(path, argv, envp);
+	if (!path || errno == ENOENT) {
+		dprintf(STDERR_FILENO, "shell: %s: command not found\n",
+			argv[0]);
+		child_exit(127);
+	}
+	dprintf(STDERR_FILENO, "shell: %s: %s\n", argv[0], strerror(errno));
+	child_exit(126);
+}
+
+static int run_builtin(struct interpreter_state *interp,
+		       struct builtin_command *builtin, char **argv,
+		       const struct io_fds *fds)
+{
+	return builtin->function(interp, (const char *const *)argv,
+				 fds->input_fd, fds->output_fd, fds->error_fd);
+}
+
+/*
+ * Find what the name in argv stands for, with a single lookup in the
+ * command table, and replace it by its alias first if it is one.
+ */
+static struct command *resolve_command(struct interpreter_state *interp,
+				       char ***argv, struct arena *arena)
+{
+	struct command *command;
+
+	if (!(*argv)[0])
+		return NULL;
+	command = command_lookup(interp->commands, (*argv)[0]);
+	if (!command || !command->alias)
+		return command;
+
+	*argv = expand_alias(*argv, command->alias, arena);
+	if (!(*argv)[0])
+		return NULL;
+	return command_lookup(interp->commands, (*argv)[0]);
+}
+
+/*
+ * Run a function with its arguments as the positional parameters. The
+ * body was compiled when the function was defined, so it runs straight
+ * from its program.
+ */
+static int run_function(struct interpreter_state *interp,
+			struct shell_function *function, char **argv,
+			const struct io_fds *fds)
+{
+	struct call_frame frame = {
+		.argv = argv,
+		.parent = interp->frame,
+		.depth = interp->frame ? interp->frame->depth + 1 : 1,
+	};
+	struct error error;
+	int status;
+
+	if (frame.depth > FUNCTION_DEPTH_MAX)
+		RAISE(ERROR_OVERFLOW, "%s: functions nested too deeply",
+		      argv[0]);
+	while (argv[frame.argc])
+		frame.argc++;
+
+	function_ref(function);
+	interp->frame = &frame;
+	if (GET_ERROR(&error)) {
+		interp->frame = frame.parent;
+		function_unref(function);
+		reraise(&error);
+	}
+	status = interpreter_run_program(interp, function->program, fds);
+	exit_error_handler(&error);
+
+	interp->frame = frame.parent;
+	function_unref(function);
+	return status;
+}
+
+/* Run a command as a process of its own, as in a pipeline */
+static __attribute__((noreturn)) void
+run_command_child(struct interpreter_state *interp, struct ast_command *cmd,
+		  const struct io_fds *fds, struct arena *arena)
+{
+	struct error error;
+	struct redirect_plan plan;
+	struct command *command;
+	char **argv;
+
+	if (GET_ERROR(&error))
+		child_exit(error_status(&error));
+
+	if (cmd->loop)
+		child_exit(interpreter_run_program(
+			interp, vm_compile_command(cmd), fds));
+	if (cmd->function) {
+		/* For all the good it does, in a child which then exits */
+		function_define(interp->commands, cmd->function);
+		child_exit(0);
+	}
+
+	argv = expand_command(interp, cmd, arena);
+	command = resolve_command(interp, &argv, arena);
+	redirect_plan_init(&plan, fds);
+	open_redirections(interp, cmd, &plan, arena);
+
+	if (!argv[0]) {
+		assign(interp, cmd->assignments, false, arena);
+		child_exit(0);
+	}
+
+	if (command && command->function) {
+		assign(interp, cmd->assignments, false, arena);
+		child_exit(run_function(interp, command->function, argv,
+					&plan.layout));
+	}
+	if (command && command->builtin) {
+		assign(interp, cmd->assignments, false, arena);
+		probe(interp, argv[0]);
+		child_exit(run_builtin(interp, command->builtin, argv,
+				       &plan.layout));
+	}
+
+	exec_external(interp, cmd, argv, variable_table_envp(interp->variables),
+		      &plan, NULL, arena);
+}
+
+pid_t interpreter_spawn(struct interpreter_state *interp, char **argv,
+			const struct io_fds *fds)
+{
+	struct command *command = command_lookup(interp->commands, argv[0]);
+	char *const *envp = variable_table_envp(interp->variables);
+	pid_t pid = fork_child(interp, true);
+
+	if (pid == 0) {
+		struct redirect_plan plan;
+		struct error error;
+
+		if (GET_ERROR(&error))
+			child_exit(error_status(&error));
+		if (command && command->function)
+			child_exit(run_function(interp, command->function,
+						argv, fds));
+		if (command && command->builtin) {
+			probe(interp, argv[0]);
+			child_exit(run_builtin(interp, command->builtin, argv,
+					       fds));
+		}
+		redirect_plan_init(&plan, fds);
+		exec_external(interp, NULL, argv, envp, &plan, NULL, NULL);
+	}
+	return pid;
+}
+
+int interpreter_exec(struct interpreter_state *interp, char **argv,
+		     const struct io_fds *fds)
+{
+	struct arena arena = { NULL };
+	struct redirect_plan plan;
+	const char *path = find_command(interp, argv[0], &arena);
+
+	if (!path) {
+		dprintf(fds->error_fd, "shell: %s: command not found\n",
+			argv[0]);
+		arena_free(&arena);
+		return 127;
+	}
+
+	redirect_plan_init(&plan, fds);
+	fflush(NULL);
+	exec_external(interp, NULL, argv,
+		      variable_table_envp(interp->variables), &plan, path,
+		      &arena);
+}
+
+/*
+ * Start an external command with posix_spawn(), putting the planned
+ * descriptors in place as its file actions. Unlike fork(), this does
+ * not copy the shell's address space, and the shell's own descriptors
+ * are never moved.
+ *
+ * Return: The pid of the child, or -1 if it could not be started, in
+ *         which case the error has been reported and *status set.
+ */
+static pid_t spawn_external(struct interpreter_state *interp, char **argv,
+			    struct redirect_plan *plan, struct arena *arena,
+			    int *status)
+{
+	char *const *envp = variable_table_envp(interp->variables);
+	const char *path = find_command(interp, argv[0], arena);
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attr;
+	uint64_t start = 0;
+	pid_t pid;
+	int rv;
+
+	if (!path) {
+		dprintf(plan->layout.error_fd, "shell: %s: command not found\n",
+			argv[0]);
+		*status = 127;
+		return -1;
+	}
+
+	CHECK(!posix_spawn_file_actions_init(&actions));
+	CHECK(!posix_spawnattr_init(&attr));
+	redirect_plan_file_actions(plan, &actions);
+	/* SIGCHLD is blocked in the shell, see jobs.h */
+	posix_spawnattr_setsigmask(&attr, &interp->jobs->saved_mask);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+	if (interp->trace || interp->timing)
+		start = trace_now();
+	/* Write out anything buffered before the command's output */
+	fflush(NULL);
+	rv = posix_spawn(&pid, path, &actions, &attr, argv, envp);
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+
+	if (rv) {
+		dprintf(plan->layout.error_fd, "shell: %s: %s\n", argv[0],
+			strerror(rv));
+		*status = rv == ENOENT ? 127 : 126;
+		return -1;
+	}
+	if (start)
+		trace_launch_spawned(&interp->launches, pid, start, argv[0]);
+	return pid;
+}
+
+/* The value a prefix assignment replaced, NULL if it was unset */
+struct saved_variable {
+	char *name;
+	char *value;
+};
+
+/*
+ * Record the current values of the variables assigned by a command, so
+ * that assignments which prefix a builtin or function last only as long
+ * as the command. The array ends with a NULL name.
+ */
+static struct saved_variable *
+save_variables(struct interpreter_state *interp,
+	       struct ast_assignment_list *assignments, struct arena *arena)
+{
+	struct saved_variable *saved;
+	size_t count = 0;
+
+	for (struct ast_assignment_list *a = assignments; a; a = a->rest)
+		count++;
+	saved = arena_malloc(arena, sizeof(struct saved_variable), count + 1);
+
+	for (size_t i = 0; i < count; i++, assignments = assignments->rest) {
+		struct ast_string *name = assignments->first->name;
+		const char *value;
+
+		saved[i].name = arena_malloc(arena, sizeof(char),
+					     name->size + 1);
+		memcpy(saved[i].name, name->data, name->size);
+		saved[i].name[name->size] = '\0';
+		value = variable_get(interp->variables, saved[i].name);
+		saved[i].value = value ? arena_strdup(arena, value) : NULL;
+	}
+	saved[count].name = NULL;
+	return saved;
+}
+
+static void restore_variables(struct interpreter_state *interp,
+			      const struct saved_variable *saved)
+{
+	for (; saved->name; saved++) {
+		if (saved->value)
+			variable_set(interp->variables, saved->name,
+				     saved->value);
+		else
+			variable_unset(interp->variables, saved->name);
+	}
+}
+
+/*
+ * Run a command from the shell process, forking only if it is external.
+ * Its words have already been expanded into argv.
+ */
+static int run_command(struct interpreter_state *interp,
+		       struct ast_command *cmd, char **argv,
+		       const struct io_fds *fds, struct arena *arena)
+{
+	struct saved_variable *saved = NULL;
+	struct redirect_plan plan;
+	struct command *command;
+	struct error error;
+	pid_t pid;
+	int status;
+
+	command = resolve_command(interp, &argv, arena);
+	if (argv[0] && cmd->assignments && command &&
+	    (command->function || command->builtin))
+		saved = save_variables(interp, cmd->assignments, arena);
+	redirect_plan_init(&plan, fds);
+
+	if (GET_ERROR(&error)) {
+		if (saved)
+			restore_variables(interp, saved);
+		redirect_plan_close(&plan);
+		reraise(&error);
+	}
+
+	open_redirections(interp, cmd, &plan, arena);
+
+	if (!argv[0]) {
+		assign(interp, cmd->assignments, false, arena);
+		status = 0;
+	} else if (command && command->function) {
+		assign(interp, cmd->assignments, false, arena);
+		status = run_function(interp, command->function, argv,
+				      &plan.layout);
+	} else if (command && command->builtin) {
+		assign(interp, cmd->assignments, false, arena);
+		status = run_builtin(interp, command->builtin, argv,
+				     &plan.layout);
+	} else if (!cmd->assignments) {
+		pid = spawn_external(interp, argv, &plan, arena, &status);
+		if (pid > 0)
+			status = interpreter_wait(interp, pid);
+	} else {
+		/* The assignments are made in the child, so it must fork */
+		pid = fork_child(interp, true);
+		if (pid == 0)
+			exec_external(interp, cmd, argv, NULL, &plan, NULL,
+				      arena);
+		status = interpreter_wait(interp, pid);
+	}
+
+	exit_error_handler(&error);
+	if (saved)
+		restore_variables(interp, saved);
+	redirect_plan_close(&plan);
+	return status;
+}
+
+static void describe_argument(struct string_builder *sb,
+			      struct ast_argument *arg)
+{
+	for (struct ast_argument_part_list *parts = arg ? arg->parts : NULL;
+	     parts; parts = parts->rest) {
+		struct ast_argument_part *part = parts->first;
+		const char *source;
+		size_t len;
+
+		if (part->string) {
+			string_builder_sized_append(sb, part->string->data,
+						    part->string->size);
+		} else if (part->parameter) {
+			string_builder_append(sb, "$");
+			string_builder_sized_append(sb, part->parameter->data,
+						    part->parameter->size);
+		} else if (part->glob) {
+			if (part->glob->type == GLOB_STAR)
+				string_builder_append(sb, "*");
+			else if (part->glob->type == GLOB_ONE)
+				string_builder_append(sb, "?");
+			else
+				string_builder_append(sb, "[...]");
+		} else if (part->arith) {
+			source = arith_program_source(part->arith->program,
+						      &len);
+			string_builder_append(sb, "$((");
+			string_builder_sized_append(sb, source, len);
+			string_builder_append(sb, "))");
+		} else {
+			string_builder_append(sb, "$(...)");
+		}
+	}
+}
+
+static void describe_loop(struct string_builder *sb, struct ast_loop *loop)
+{
+	switch (loop->kind) {
+	case LOOP_FOR:
+		string_builder_append(sb, "for ");
+		string_builder_sized_append(sb, loop->variable->data,
+					    loop->variable->size);
+		string_builder_append(sb, " in");
+		for (struct ast_argument_list *args = loop->words; args;
+		     args = args->rest) {
+			string_builder_append(sb, " ");
+			describe_argument(sb, args->first);
+		}
+		break;
+	case LOOP_WHILE:
+		string_builder_append(sb, "while ...");
+		break;
+	case LOOP_UNTIL:
+		string_builder_append(sb, "until ...");
+		break;
+	}
+	string_builder_append(sb, "; do ...; done");
+}
+
+static void describe_pipeline(struct string_builder *sb,
+			      struct ast_pipeline *pipeline)
+{
+	for (; pipeline; pipeline = pipeline->rest) {
+		struct ast_command *cmd = pipeline->first;
+		const char *space = "";
+
+		for (struct ast_assignment_list *a = cmd->assignments; a;
+		     a = a->rest, space = " ") {
+			string_builder_append(sb, space);
+			string_builder_sized_append(sb, a->first->name->data,
+						    a->first->name->size);
+			string_builder_append(sb, "=");
+			describe_argument(sb, a->first->value);
+		}
+		for (struct ast_argument_list *args = cmd->arglist; args;
+		     args = args->rest, space = " ") {
+			string_builder_append(sb, space);
+			describe_argument(sb, args->first);
+		}
+		if (cmd->loop)
+			describe_loop(sb, cmd->loop);
+		if (cmd->function) {
+			string_builder_sized_append(sb,
+						    cmd->function->name->data,
+						    cmd->function->name->size);
+			string_builder_append(sb, "() { ...; }");
+		}
+		if (pipeline->rest)
+			string_builder_append(sb, " | ");
+	}
+}
+
+/* Reconstruct the text of a command for the job table */
+static char *describe(struct ast_pipeline *pipeline, struct ast_and_or *and_or,
+		      struct arena *arena)
+{
+	struct string_builder *sb = string_builder_new(arena);
+
+	if (pipeline)
+		describe_pipeline(sb, pipeline);
+	for (; and_or; and_or = and_or->rest) {
+		describe_pipeline(sb, and_or->pipeline);
+		if (and_or->rest)
+			string_builder_append(sb, and_or->connective ==
+							  CONNECTIVE_AND ?
+						  " && " :
+						  " || ");
+	}
+	return string_builder_finalize(sb);
+}
+
+/*
+ * The children and pipe ends of a pipeline being started. It lives in
+ * the arena rather than on the stack, so it is still accurate when an
+ * error unwinds to the handler in run_pipeline().
+ */
+struct pipeline_start {
+	pid_t *pids;
+	size_t started;
+	/* The read end for the next stage, or -1 */
+	int input_fd;
+	/* The pipe to the next stage, until the shell closes its ends */
+	int pipefd[2];
+};
+
+/*
+ * Close the shell's pipe ends, so that the stages already running see
+ * the end of their input, and reap them, or leave them to the job
+ * table if the pipeline was to run in the background.
+ */
+static void abandon_pipeline(struct interpreter_state *interp,
+			     struct ast_pipeline *pipeline,
+			     struct pipeline_start *start, bool background,
+			     struct arena *arena)
+{
+	if (start->input_fd >= 0)
+		close(start->input_fd);
+	if (start->pipefd[0] >= 0)
+		close(start->pipefd[0]);
+	if (start->pipefd[1] >= 0)
+		close(start->pipefd[1]);
+	if (!start->started)
+		return;
+
+	if (background) {
+		job_add(interp->jobs, start->pids, start->started,
+			describe(pipeline, NULL, arena));
+		return;
+	}
+	for (size_t i = 0; i < start->started; i++)
+		interpreter_wait(interp, start->pids[i]);
+}
+
+static int run_pipeline(struct interpreter_state *interp,
+			struct ast_pipeline *pipeline, const struct io_fds *fds,
+			bool background, struct arena *arena)
+{
+	struct pipeline_start *start;
+	struct ast_pipeline *p;
+	struct error error;
+	size_t count = 0;
+	pid_t *pids;
+	int status = 0;
+
+	for (p = pipeline; p; p = p->rest)
+		count++;
+	pids = arena_malloc(arena, sizeof(pid_t), count);
+	start = arena_malloc(arena, sizeof(struct pipeline_start), 1);
+	*start = (struct pipeline_start){
+		.pids = pids,
+		.input_fd = -1,
+		.pipefd = { -1, -1 },
+	};
+	p = pipeline;
+
+	/* Build the environment once so each child inherits the cache */
+	variable_table_envp(interp->variables);
+
+	if (GET_ERROR(&error)) {
+		abandon_pipeline(interp, pipeline, start, background, arena);
+		reraise(&error);
+	}
+
+	for (size_t i = 0; i < count; i++, p = p->rest) {
+		struct io_fds stage = *fds;
+
+		if (start->input_fd >= 0)
+			stage.input_fd = start->input_fd;
+		if (p->rest) {
+			CHECKP(pipe2(start->pipefd, O_CLOEXEC));
+			stage.output_fd = start->pipefd[1];
+		}
+
+		pids[i] = fork_child(interp, !background);
+		if (pids[i] == 0) {
+			/* Background jobs get a process group of their own */
+			if (background)
+				setpgid(0, i ? pids[0] : 0);
+			run_command_child(interp, p->first, &stage, arena);
+		}
+		start->started++;
+		if (background)
+			setpgid(pids[i], pids[0]);
+
+		if (start->input_fd >= 0)
+			checked_close(start->input_fd);
+		start->input_fd = -1;
+		if (p->rest) {
+			checked_close(start->pipefd[1]);
+			start->input_fd = start->pipefd[0];
+			start->pipefd[0] = start->pipefd[1] = -1;
+		}
+	}
+	exit_error_handler(&error);
+
+	if (background) {
+		job_add(interp->jobs, pids, count,
+			describe(pipeline, NULL, arena));
+		return 0;
+	}
+
+	for (size_t i = 0; i < count; i++)
+		status = interpreter_wait(interp, pids[i]);
+	return status;
+}
+
+static uint64_t rusage_us(const struct timeval *tv)
+{
+	return (uint64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+/* Start, stop or redirect tracing to follow SHELL_TRACE */
+static void update_trace(struct interpreter_state *interp)
+{
+	const char *path = variable_get(interp->variables, "SHELL_TRACE");
+	struct error error;
+
+	if (path && !*path)
+		path = NULL;
+	if (interp->trace && path && !strcmp(trace_path(interp->trace), path))
+		return;
+
+	if (interp->trace) {
+		trace_close(interp->trace);
+		interp->trace = NULL;
+	}
+	if (!path)
+		return;
+
+	if (GET_ERROR(&error)) {
+		print_error(&error);
+		exit_error_handler(&error);
+		return;
+	}
+	interp->trace = trace_open(path);
+	exit_error_handler(&error);
+}
+
+/* Keep descriptors for appending redirections while SHELL_FDCACHE=1 */
+static void update_fd_cache(struct interpreter_state *interp)
+{
+	const char *value = variable_get(interp->variables, "SHELL_FDCACHE");
+	bool enabled = value && !strcmp(value, "1");
+
+	if (enabled && !interp->fd_cache) {
+		interp->fd_cache = fd_cache_new();
+	} else if (!enabled && interp->fd_cache) {
+		fd_cache_free(interp->fd_cache);
+		interp->fd_cache = NULL;
+	}
+}
+
+/* A loop being run, see VM_LOOP_START */
+struct vm_loop {
+	/* The words of a for loop, and the next one */
+	char **words;
+	size_t next;
+	/* The status of the last run of the body */
+	int status;
+	/* Where memory allocated in an iteration is freed back to */
+	struct arena_mark mark;
+	struct redirect_plan plan;
+	/* What to go back to when the loop is left */
+	struct io_fds saved_fds;
+	size_t saved_recover;
+	bool saved_in_pipeline;
+	size_t saved_recover_depth;
+};
+
+/* The registers of a running program */
+struct vm {
+	const struct vm_program *program;
+	/* The descriptors commands run with, redirected by loops */
+	struct io_fds fds;
+	size_t pc;
+	int status;
+	/* Where an error continues, and whether it fails a pipeline */
+	size_t recover;
+	bool in_pipeline;
+	/* The loops an error there leaves running */
+	size_t recover_depth;
+	struct vm_loop *loops;
+	size_t depth;
+	size_t loops_capacity;
+	/* In the child of VM_BACKGROUND, which exits on other errors */
+	bool in_job;
+	/* The command being built; a capacity of 0 means it is not ours */
+	char **argv;
+	size_t argc;
+	size_t argv_capacity;
+	/* For VM_TIME_START and VM_TIME_STOP */
+	struct trace_totals *saved_timing;
+	struct trace_totals totals;
+	struct rusage before;
+	uint64_t start;
+	/* What the current statement allocates */
+	struct arena arena;
+};
+
+static void vm_push(struct vm *vm, char *word)
+{
+	if (vm->argc + 1 >= vm->argv_capacity) {
+		size_t capacity = vm->argv_capacity * 2 + 8;
+		char **argv = arena_malloc(&vm->arena, sizeof(char *),
+					   capacity);
+
+		memcpy(argv, vm->argv, vm->argc * sizeof(char *));
+		vm->argv = argv;
+		vm->argv_capacity = capacity;
+	}
+	vm->argv[vm->argc++] = word;
+	vm->argv[vm->argc] = NULL;
+}
+
+static void vm_time_stop(struct interpreter_state *interp, struct vm *vm)
+{
+	struct rusage after;
+
+	vm->totals.wall_ns = trace_now() - vm->start;
+	getrusage(RUSAGE_SELF, &after);
+	vm->totals.user_us += rusage_us(&after.ru_utime) -
+			      rusage_us(&vm->before.ru_utime);
+	vm->totals.sys_us += rusage_us(&after.ru_stime) -
+			     rusage_us(&vm->before.ru_stime);
+	interp->timing = vm->saved_timing;
+	trace_report_time(vm->fds.error_fd, &vm->totals);
+}
+
+static void vm_background(struct interpreter_state *interp, struct vm *vm,
+			  const struct vm_insn *insn)
+{
+	pid_t pid = fork_child(interp, false);
+
+	if (pid == 0) {
+		setpgid(0, 0);
+		vm->in_job = true;
+		vm->pc++;
+		return;
+	}
+	setpgid(pid, pid);
+	job_add(interp->jobs, &pid, 1,
+		describe(NULL, insn->ptr, &vm->arena));
+	vm->status = 0;
+	vm->pc = insn->arg;
+}
+
+static void vm_loop_start(struct interpreter_state *interp, struct vm *vm,
+			  struct ast_command *cmd)
+{
+	struct vm_loop *loop;
+
+	if (vm->depth == vm->loops_capacity) {
+		vm->loops_capacity = vm->loops_capacity * 2 + 4;
+		vm->loops = checked_realloc(vm->loops, sizeof(struct vm_loop),
+					    vm->loops_capacity);
+	}
+	loop = &vm->loops[vm->depth++];
+	*loop = (struct vm_loop){
+		.saved_fds = vm->fds,
+		.saved_recover = vm->recover,
+		.saved_in_pipeline = vm->in_pipeline,
+		.saved_recover_depth = vm->recover_depth,
+	};
+	if (cmd->loop->kind == LOOP_FOR)
+		loop->words = vm->argv;
+
+	redirect_plan_init(&loop->plan, &vm->fds);
+	open_redirections(interp, cmd, &loop->plan, &vm->arena);
+	vm->fds = loop->plan.layout;
+	arena_mark(&vm->arena, &loop->mark);
+}
+
+static void vm_loop_leave(struct vm *vm)
+{
+	struct vm_loop *loop = &vm->loops[--vm->depth];
+
+	redirect_plan_close(&loop->plan);
+	vm->fds = loop->saved_fds;
+}
+
+static void vm_loop_end(struct vm *vm)
+{
+	struct vm_loop *loop = &vm->loops[vm->depth - 1];
+
+	vm->status = loop->status;
+	vm->recover = loop->saved_recover;
+	vm->in_pipeline = loop->saved_in_pipeline;
+	vm->recover_depth = loop->saved_recover_depth;
+	vm_loop_leave(vm);
+}
+
+static void vm_for_next(struct interpreter_state *interp, struct vm *vm,
+			const struct vm_insn *insn)
+{
+	struct vm_loop *loop = &vm->loops[vm->depth - 1];
+	const char *word = loop->words[loop->next];
+
+	if (!word) {
+		vm->pc = insn->arg;
+		return;
+	}
+	loop->next++;
+	variable_set(interp->variables, insn->ptr, word);
+	vm->pc++;
+}
+
+/*
+ * Replace the shell by the last command it runs, if nothing is left for
+ * the shell to do once the command has finished but exit with its
+ * status: so not with background jobs to wait for, a trace or timing
+ * to report, or cached descriptors which the command would inherit.
+ * Otherwise, return for the command to be run as usual.
+ */
+static void vm_exec(struct interpreter_state *interp, struct vm *vm,
+		    struct ast_command *cmd)
+{
+	char **argv = vm->argv;
+	struct redirect_plan plan;
+	struct command *command;
+	struct error error;
+	const char *path;
+
+	if (interp->jobs->count || interp->trace || interp->timing ||
+	    interp->fd_cache || interp->frame)
+		return;
+
+	command = resolve_command(interp, &argv, &vm->arena);
+	if (!argv[0] || (command && (command->function || command->builtin)))
+		return;
+	/* Let run_command() report a command which is not found */
+	path = find_command(interp, argv[0], &vm->arena);
+	if (!path)
+		return;
+
+	redirect_plan_init(&plan, &vm->fds);
+	if (GET_ERROR(&error)) {
+		redirect_plan_close(&plan);
+		reraise(&error);
+	}
+	open_redirections(interp, cmd, &plan, &vm->arena);
+	exit_error_handler(&error);
+
+	fflush(NULL);
+	exec_external(interp, cmd, argv,
+		      variable_table_envp(interp->variables), &plan, path,
+		      &vm->arena);
+}
+
+static void vm_step(struct interpreter_state *interp, struct vm *vm)
+{
+	static const struct arena_mark empty;
+	const struct vm_insn *insn = &vm->program->code[vm->pc];
+	char **fields;
+
+	switch (insn->op) {
+	case VM_STATEMENT:
+		/* Inside a loop, only what this iteration allocated */
+		arena_rewind(&vm->arena,
+			     vm->depth ? &vm->loops[vm->depth - 1].mark :
+					 &empty);
+		vm->recover = insn->arg;
+		vm->in_pipeline = false;
+		vm->recover_depth = vm->depth;
+		jobs_reap(interp->jobs);
+		update_trace(interp);
+		update_fd_cache(interp);
+		break;
+	case VM_TRY:
+		vm->recover = insn->arg;
+		vm->in_pipeline = true;
+		vm->recover_depth = vm->depth;
+		break;
+	case VM_ARGV:
+		vm->argc = 0;
+		vm->argv_capacity = 0;
+		vm->argv = (char **)insn->ptr;
+		if (!vm->argv) {
+			vm->argv_capacity = 8;
+			vm->argv = arena_malloc(&vm->arena, sizeof(char *),
+						vm->argv_capacity);
+			vm->argv[0] = NULL;
+		}
+		break;
+	case VM_PUSH:
+		vm_push(vm, (char *)insn->ptr);
+		break;
+	case VM_EXPAND:
+		fields = expand_argument(interp, insn->ptr, &vm->arena);
+		for (; *fields; fields++)
+			vm_push(vm, *fields);
+		break;
+	case VM_EXEC:
+		vm_exec(interp, vm, insn->ptr);
+		/* fallthru */
+	case VM_RUN:
+		vm->status = run_command(interp, insn->ptr, vm->argv, &vm->fds,
+					 &vm->arena);
+		break;
+	case VM_PIPELINE:
+		vm->status = run_pipeline(interp, insn->ptr, &vm->fds,
+					  insn->arg, &vm->arena);
+		break;
+	case VM_TIME_START:
+		vm->saved_timing = interp->timing;
+		vm->totals = (struct trace_totals){ 0 };
+		interp->timing = &vm->totals;
+		getrusage(RUSAGE_SELF, &vm->before);
+		vm->start = trace_now();
+		break;
+	case VM_TIME_STOP:
+		vm_time_stop(interp, vm);
+		break;
+	case VM_JUMP_IF_FAILURE:
+		if (vm->status) {
+			vm->pc = insn->arg;
+			return;
+		}
+		break;
+	case VM_JUMP_IF_SUCCESS:
+		if (!vm->status) {
+			vm->pc = insn->arg;
+			return;
+		}
+		break;
+	case VM_SET_STATUS:
+		interp->last_status = vm->status;
+		break;
+	case VM_BACKGROUND:
+		vm_background(interp, vm, insn);
+		return;
+	case VM_EXIT:
+		child_exit(vm->status);
+	case VM_LOOP_START:
+		vm_loop_start(interp, vm, insn->ptr);
+		break;
+	case VM_FOR_NEXT:
+		vm_for_next(interp, vm, insn);
+		return;
+	case VM_LOOP_NEXT:
+		vm->loops[vm->depth - 1].status = vm->status;
+		vm->pc = insn->arg;
+		return;
+	case VM_LOOP_END:
+		vm_loop_end(vm);
+		break;
+	case VM_DEFINE:
+		function_define(interp->commands, insn->ptr);
+		vm->status = 0;
+		break;
+	}
+	vm->pc++;
+}
+
+static void vm_free(struct vm *vm)
+{
+	while (vm->depth)
+		vm_loop_leave(vm);
+	free(vm->loops);
+	arena_free(&vm->arena);
+}
+
+/*
+ * Run a program until it ends or an error escapes an instruction. An
+ * error in a pipeline fails only that pipeline, so that "cd dir || exit"
+ * can recover; any other error fails the statement.
+ *
+ * Return: Whether the program ended.
+ */
+static bool vm_run(struct interpreter_state *interp, struct vm *vm)
+{
+	struct error error;
+
+	if (GET_ERROR(&error)) {
+		if (vm->in_job && (error.type == ERROR_SYSTEM_EXIT ||
+				   !vm->in_pipeline))
+			child_exit(error_status(&error));
+		if (interp->timing == &vm->totals)
+			interp->timing = vm->saved_timing;
+		if (error.type == ERROR_SYSTEM_EXIT) {
+			vm_free(vm);
+			reraise(&error);
+		}
+		print_error(&error);
+		exit_error_handler(&error);
+		while (vm->depth > vm->recover_depth)
+			vm_loop_leave(vm);
+		vm->status = 1;
+		vm->pc = vm->recover;
+		return false;
+	}
+
+	while (vm->pc < vm->program->count)
+		vm_step(interp, vm);
+	exit_error_handler(&error);
+	return true;
+}
+
+int interpreter_run_program(struct interpreter_state *interp,
+			    const struct vm_program *program,
+			    const struct io_fds *fds)
+{
+	struct vm vm = {
+		.program = program,
+		.fds = *fds,
+	};
+
+	while (!vm_run(interp, &vm))
+		continue;
+	vm_free(&vm);
+	return interp->last_status;
+}
+
+/* Run a program compiled to be run once, and free it */
+static int run_once(struct interpreter_state *interp,
+		    struct vm_program *program, const struct io_fds *fds)
+{
+	struct error error;
+	int status;
+
+	if (GET_ERROR(&error)) {
+		vm_program_free(program);
+		reraise(&error);
+	}
+	status = interpreter_run_program(interp, program, fds);
+	exit_error_handler(&error);
+	vm_program_free(program);
+	return status;
+}
+
+int interpreter_run_fds(struct interpreter_state *interp,
+			struct ast_statement_list *list,
+			const struct io_fds *fds)
+{
+	return run_once(interp, vm_compile(list), fds);
+}
+
+int interpreter_run(struct interpreter_state *interp,
+		    struct ast_statement_list *list)
+{
+	return interpreter_run_fds(interp, list, &standard_fds);
+}
+
+int interpreter_run_final(struct interpreter_state *interp,
+			  struct ast_statement_list *list)
+{
+	return run_once(interp, vm_compile_final(list), &standard_fds);
+}
+
+pid_t interpreter_subshell(struct interpreter_state *interp,
+			   struct ast_statement_list *list,
+			   const struct io_fds *fds)
+{
+	pid_t pid = fork_child(interp, true);
+
+	if (pid == 0) {
+		struct error error;
+		int status;
+
+		if (GET_ERROR(&error))
+			child_exit(error_status(&error));
+		probe(interp, "(subshell)");
+		status = interpreter_run_fds(interp, list, fds);
+		if (interp->trace)
+			trace_close(interp->trace);
+		child_exit(status);
+	}
+	return pid;
+}
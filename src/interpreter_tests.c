@@ -0,0 +1,479 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "ast.h"
+#include "capture.h"
+#include "error.h"
+#include "interpreter.h"
+#include "parser.h"
+#include "unit.h"
+#include "variables.h"
+
+/* Run input and return what it wrote to standard output */
+static char *run(struct interpreter_state *interp, const char *input,
+		 struct arena *arena)
+{
+	struct ast_statement_list *list = parse_input_view(input);
+	struct capture cap = { .arena = arena };
+	struct io_fds fds = {
+		.input_fd = STDIN_FILENO,
+		.error_fd = STDERR_FILENO,
+	};
+	char *output;
+	int pipefd[2];
+
+	capture_pipe(pipefd);
+	fds.output_fd = pipefd[1];
+	interpreter_run_fds(interp, list, &fds);
+	checked_close(pipefd[1]);
+	capture_read(&cap, pipefd[0]);
+	checked_close(pipefd[0]);
+	ast_statement_list_free(list);
+
+	output = arena_malloc(arena, sizeof(char), cap.total + 1);
+	output[0] = '\0';
+	for (size_t i = 0; i < cap.count; i++)
+		strncat(output, cap.chunks[i].data, cap.chunks[i].len);
+	return output;
+}
+
+DEFTEST("interpreter.builtin")
+{
+	struct interpreter_state *interp = interpreter_new(false);
+	struct arena arena = { NULL };
+
+	EXPECT(!strcmp(run(interp, "echo hello   world", &arena),
+		       "hello world\n"));
+	EXPECT(!strcmp(run(interp, "echo -n a; echo b", &arena), "ab\n"));
+	arena_free(&arena);
+	interpreter_free(interp);
+}
+
+DEFTEST("interpreter.external")
+{
+	struct interpreter_state *interp = interpreter_new(false);
+	struct arena arena = { NULL };
+
+	EXPECT(!strcmp(run(interp, "printf '%s-' a b", &arena), "a-b-"));
+	run(interp, "false", &arena);
+	EXPECT(interp->last_status == 1);
+	EXPECT(!strcmp(run(interp, "echo $?", &arena), "1\n"));
+	run(interp, "no-such-command-exists", &arena);
+	EXPECT(interp->last_status == 127);
+	arena_free(&arena);
+	interpreter_free(interp);
+}
+
+DEFTEST("interpreter.external.path")
+{
+	struct interpreter_state *interp = interpreter_new(false);
+	struct arena arena = { NULL };
+	char dir[] = "/tmp/shell_path_XXXXXX";
+	char *tool, *input;
+
+	ASSERT(mkdtemp(dir));
+	tool = arena_malloc(&arena, sizeof(char), sizeof(dir) + 8);
+	sprintf(tool, "%s/mytool", dir);
+	input = arena_malloc(&arena, sizeof(char), 2 * sizeof(dir) + 128);
+	sprintf(input, "echo '#!/bin/sh' >%s; echo 'echo tool $X' >>%s; "
+		       "chmod +x %s", tool, tool, tool);
+	run(interp, input, &arena);
+
+	/* Every way of running an external follows the shell's $PATH */
+	sprintf(input, "PATH=%s:$PATH", dir);
+	run(interp, input, &arena);
+	EXPECT(!strcmp(run(interp, "mytool; mytool | cat; X=1 mytool",
+			   &arena),
+		       "tool\ntool\ntool 1\n"));
+
+	run(interp, "PATH=/nonexistent; ls / | cat", &arena);
+	EXPECT(interp->last_status == 127);
+	run(interp, "X=1 ls /", &arena);
+	EXPECT(interp->last_status == 127);
+
+	unlink(tool);
+	rmdir(dir);
+	arena_free(&arena);
+	interpreter_free(interp);
+}
+
+DEFTEST("interpreter.pipeline")
+{
+	struct interpreter_state *interp = interpreter_new(false);
+	struct arena arena = { NULL };
+
+	EXPECT(!strcmp(run(interp, "echo b a c | tr ' ' '\\n' | sort", &arena),
+		       "a\nb\nc\n"));
+	run(interp, "true | false", &arena);
+	EXPECT(interp->last_status == 1);
+	arena_free(&arena);
+	interpreter_free(interp);
+}
+
+DEFTEST("interpreter.variables")
+{
+	struct interpreter_state *interp = interpreter_new(false);
+	struct arena arena = { NULL };
+
+	EXPECT(!strcmp(run(interp, "X=one; echo $X ${X}s", &arena),
+		       "one ones\n"));
+	/* Prefix assignments reach the environment of externals only */
+	EXPECT(!strcmp(run(interp, "Y=two printenv Y; echo \"-$Y-\"", &arena),
+		       "two\n--\n"));
+	/* ...and to builtins and functions only while they run */
+	EXPECT(!strcmp(run(interp, "X=0; X=1 echo $X; echo X=$X", &arena),
+		       "0\nX=0\n"));
+	EXPECT(!strcmp(run(interp, "f() { echo $Z; }; Z=in f; echo \"-$Z-\"",
+			   &arena),
+		       "in\n--\n"));
+	EXPECT(!strcmp(run(interp, "export E=1; printenv E; unset E; "
+				   "echo \"-$E-\"; printenv E",
+			   &arena),
+		       "1\n--\n"));
+	/* A name exported before it is set reaches externals once set */
+	EXPECT(!strcmp(run(interp, "export L; printenv L; echo \"-$L-\"; "
+				   "L=x; printenv L",
+			   &arena),
+		       "--\nx\n"));
+	arena_free(&arena);
+	interpreter_free(interp);
+}
+
+DEFTEST("interpreter.substitution")
+{
+	struct interpreter_state *interp = interpreter_new(false);
+	struct arena arena = { NULL };
+
+	EXPECT(!strcmp(run(interp, "echo x$(printf ' a  b\\n\\n')y", &arena),
+		       "x a by\n"));
+	EXPECT(!strcmp(run(interp, "printf '<%s>' $(echo x y)z", &arena),
+		       "<x><yz>"));
+	EXPECT(!strcmp(run(interp, "printf '<%s>' \"$(echo x y)\"", &arena),
+		       "<x y>"));
+	EXPECT(!strcmp(run(interp, "X=$(echo a b); printf '<%s>' \"$X\"",
+			   &arena),
+		       "<a b>"));
+	EXPECT(!strcmp(run(interp, "echo `echo ticks`", &arena), "ticks\n"));
+	arena_free(&arena);
+	interpreter_free(interp);
+}
+
+DEFTEST("interpreter.substitution.large")
+{
+	struct interpreter_state *interp = interpreter_new(false);
+	struct arena arena = { NULL };
+	char *output;
+
+	/* Larger than a chunk, so words span chunk boundaries */
+	output = run(interp,
+		     "printf '%s\\n' $(seq 100000) | tail -n 1; "
+		     "echo $(seq 100000) | wc -c",
+		     &arena);
+	EXPECT(!strcmp(output, "100000\n588895\n"));
+	arena_free(&arena);
+	interpreter_free(interp);
+}
+
+DEFTEST("interpreter.redirection")
+{
+	struct interpreter_state *interp = interpreter_new(false);
+	struct arena arena = { NULL };
+	char path[] = "/tmp/shell_test_XXXXXX";
+	char *input;
+
+	close(CHECKP(mkstemp(path)));
+	input = arena_malloc(&arena, sizeof(char), 256);
+	snprintf(input, 256, "echo one > %s; echo two >> %s; cat < %s", path,
+		 path, path);
+	EXPECT(!strcmp(run(interp, input, &arena), "one\ntwo\n"));
+	unlink(path);
+	arena_free(&arena);
+	interpreter_free(interp);
+}
+
+DEFTEST("interpreter.substitution.in_process")
+{
+	struct interpreter_state *interp = interpreter_new(true);
+	struct arena arena = { NULL };
+	char *cwd = getcwd(NULL, 0);
+	char *expected = arena_malloc(&arena, sizeof(char), strlen(cwd) + 3);
+
+	sprintf(expected, "<%s>", cwd);
+	EXPECT(!strcmp(run(interp, "printf '<%s>' $(pwd)", &arena), expected));
+	EXPECT(!strcmp(run(interp, "X='a b'; printf '<%s>' $(echo $X; echo c)",
+			   &arena),
+		       "<a><b><c>"));
+	EXPECT(!strcmp(run(interp, "alias ll='ls -l'; echo $(alias)", &arena),
+		       "alias ll='ls -l'\n"));
+	free(cwd);
+	arena_free(&arena);
+	interpreter_free(interp);
+}
+
+DEFTEST("interpreter.arith")
+{
+	struct interpreter_state *interp = interpreter_new(false);
+	struct arena arena = { NULL };
+
+	EXPECT(!strcmp(run(interp, "i=0; i=$((i+1)); i=$(( $i * 10 )); "
+				   "echo $i $((2**10)) $(( (1+2)*3 ))",
+			   &arena),
+		       "10 1024 9\n"));
+	EXPECT(!strcmp(run(interp, "echo \"$((i > 5 ? i << 1 : 0))\"", &arena),
+		       "20\n"));
+	EXPECT(!strcmp(run(interp, "echo $((1/0)); echo $?", &arena),
+		       "1\n"));
+	variable_set(interp->variables, "1", "5");
+	EXPECT(!strcmp(run(interp, "false; echo $(( $1 + 1 )) $(( $? ))",
+			   &arena),
+		       "6 1\n"));
+	arena_free(&arena);
+	interpreter_free(interp);
+}
+
+DEFTEST("interpreter.and_or")
+{
+	struct interpreter_state *interp = interpreter_new(false);
+	struct arena arena = { NULL };
+
+	EXPECT(!strcmp(run(interp, "true && echo a || echo b", &arena),
+		       "a\n"));
+	EXPECT(!strcmp(run(interp, "false && echo a || echo b", &arena),
+		       "b\n"));
+	EXPECT(!strcmp(run(interp, "false || false && echo a; echo $?",
+			   &arena),
+		       "1\n"));
+	EXPECT(!strcmp(run(interp, "false || echo $?", &arena), "1\n"));
+	/* Skipped branches are not expanded */
+	EXPECT(!strcmp(run(interp, "true || echo $((1/0)) && echo c",
+			   &arena),
+		       "c\n"));
+	EXPECT(!strcmp(run(interp, "cd /nonexistent || echo no",
+			   &arena),
+		       "no\n"));
+	arena_free(&arena);
+	interpreter_free(interp);
+}
+
+DEFTEST("interpreter.loops")
+{
+	struct interpreter_state *interp = interpreter_new(false);
+	struct arena arena = { NULL };
+	char path[] = "/tmp/shell_test_XXXXXX";
+	char *input;
+
+	EXPECT(!strcmp(run(interp, "for i in a 'b c'; do echo $i; done",
+			   &arena),
+		       "a\nb c\n"));
+	EXPECT(!strcmp(run(interp,
+			   "for i in 1 2; do for j in x y; do echo -n $i$j;"
+			   " done; done | tr x X",
+			   &arena),
+		       "1X1y2X2y"));
+	EXPECT(!strcmp(run(interp,
+			   "n=0; while test $n != 3; do n=$((n + 1)); done;"
+			   " until true; do echo no; done; echo $n $?",
+			   &arena),
+		       "3 0\n"));
+	/* The status is that of the body, or 0 when it never ran */
+	run(interp, "for i in 1; do false; done", &arena);
+	EXPECT(interp->last_status == 1);
+	run(interp, "for i in; do false; done", &arena);
+	EXPECT(interp->last_status == 0);
+
+	close(CHECKP(mkstemp(path)));
+	input = arena_malloc(&arena, sizeof(char), 256);
+	snprintf(input, 256,
+		 "printf 'a 1\\nb 2\\n' > %s;"
+		 " while read k v; do echo $v$k; done < %s",
+		 path, path);
+	EXPECT(!strcmp(run(interp, input, &arena), "1a\n2b\n"));
+	unlink(path);
+	arena_free(&arena);
+	interpreter_free(interp);
+}
+
+DEFTEST("interpreter.functions")
+{
+	struct interpreter_state *interp = interpreter_new(true);
+	struct arena arena = { NULL };
+
+	EXPECT(!strcmp(run(interp, "f() { echo $2 $1; }; f a b; f c", &arena),
+		       "b a\nc\n"));
+	/* Functions outlive the input they were defined in */
+	EXPECT(!strcmp(run(interp, "f x | tr x y", &arena), "y\n"));
+	EXPECT(!strcmp(run(interp,
+			   "g() { echo g$1; f $1$1; }; g z; echo $1.",
+			   &arena),
+		       "gz\nzz\n.\n"));
+
+	/* A function is found before a builtin, and after an alias */
+	EXPECT(!strcmp(run(interp, "pwd() { echo here; }; pwd", &arena),
+		       "here\n"));
+	EXPECT(!strcmp(run(interp, "alias p=f; p 1", &arena), "1\n"));
+
+	EXPECT(!strcmp(run(interp, "d() { echo $(( $1 * 2 )); }; d 21",
+			   &arena),
+		       "42\n"));
+	run(interp, "h() { true; false; }; h", &arena);
+	EXPECT(interp->last_status == 1);
+	run(interp, "loop() { loop; }; loop", &arena);
+	EXPECT(interp->last_status == 1 && !interp->frame);
+	arena_free(&arena);
+	interpreter_free(interp);
+}
+
+DEFTEST("interpreter.cd")
+{
+	struct interpreter_state *interp = interpreter_new(false);
+	struct arena arena = { NULL };
+
+	EXPECT(!strcmp(run(interp, "cd /usr/bin; cd ../lib; pwd; echo $OLDPWD",
+			   &arena),
+		       "/usr/lib\n/usr/bin\n"));
+	EXPECT(!strcmp(run(interp, "pushd /; pushd /tmp; dirs", &arena),
+		       "/ /usr/lib\n/tmp / /usr/lib\n/tmp / /usr/lib\n"));
+	EXPECT(!strcmp(run(interp, "pushd; popd; popd; pwd", &arena),
+		       "/ /tmp /usr/lib\n/tmp /usr/lib\n/usr/lib\n/usr/lib\n"));
+	EXPECT(!strcmp(run(interp, "popd || echo $?", &arena), "1\n"));
+
+	/* Redirections are relative to the shell's directory */
+	run(interp, "cd /tmp; echo hi >cd_test_file", &arena);
+	EXPECT(!strcmp(run(interp, "cat /tmp/cd_test_file", &arena), "hi\n"));
+	unlink("/tmp/cd_test_file");
+	arena_free(&arena);
+	interpreter_free(interp);
+}
+
+DEFTEST("interpreter.fd_cache")
+{
+	struct interpreter_state *interp = interpreter_new(false);
+	struct arena arena = { NULL };
+
+	run(interp, "cd /tmp; SHELL_FDCACHE=1; rm -f fd_cache_log", &arena);
+	EXPECT(!strcmp(run(interp,
+			   "echo a >>fd_cache_log; /bin/echo b >>fd_cache_log;"
+			   "echo c >>/tmp/fd_cache_log; cat fd_cache_log",
+			   &arena),
+		       "a\nb\nc\n"));
+	/* A removed log is created again */
+	EXPECT(!strcmp(run(interp,
+			   "rm fd_cache_log; echo d >>fd_cache_log;"
+			   "cat fd_cache_log",
+			   &arena),
+		       "d\n"));
+	/* Any value but 1 turns the cache off */
+	run(interp, "SHELL_FDCACHE=0; echo e", &arena);
+	EXPECT(!interp->fd_cache);
+	unlink("/tmp/fd_cache_log");
+	arena_free(&arena);
+	interpreter_free(interp);
+}
+
+DEFTEST("interpreter.jobs")
+{
+	struct interpreter_state *interp = interpreter_new(false);
+	struct arena arena = { NULL };
+
+	EXPECT(!strcmp(run(interp, "sleep 5 >/dev/null & jobs", &arena),
+		       "[1]+  Running                 sleep 5 &\n"));
+	EXPECT(!strcmp(run(interp, "false | true & false & wait %3; echo $?",
+			   &arena),
+		       "1\n"));
+	EXPECT(!strcmp(run(interp, "wait %2; echo $?", &arena), "0\n"));
+	EXPECT(!strcmp(run(interp, "true && exit 3 & wait %2; echo $?",
+			   &arena),
+		       "3\n"));
+	EXPECT(!strcmp(run(interp, "wait %9; echo $?", &arena), "127\n"));
+	arena_free(&arena);
+	interpreter_free(interp);
+}
+
+DEFTEST("interpreter.parallel")
+{
+	struct interpreter_state *interp = interpreter_new(false);
+	struct arena arena = { NULL };
+	char *output;
+
+	EXPECT(!strcmp(run(interp, "parallel -j 1 echo {}-x ::: a b c",
+			   &arena),
+		       "a-x\nb-x\nc-x\n"));
+	EXPECT(!strcmp(run(interp, "parallel -j1 echo ::: a", &arena),
+		       "a\n"));
+	/* The status is the number of failed jobs */
+	EXPECT(!strcmp(run(interp,
+			   "parallel -j 4 sh -c 'exit $1' sh ::: 0 1 2 0; "
+			   "echo $?",
+			   &arena),
+		       "2\n"));
+	/* Grouped output of a job is never interleaved with another */
+	output = run(interp,
+		     "parallel -j 2 -g sh -c 'echo $1; sleep 0.1; echo $1' "
+		     "sh ::: a b",
+		     &arena);
+	EXPECT(!strcmp(output, "a\na\nb\nb\n") ||
+	       !strcmp(output, "b\nb\na\na\n"));
+	arena_free(&arena);
+	interpreter_free(interp);
+}
+
+DEFTEST("interpreter.time")
+{
+	struct interpreter_state *interp = interpreter_new(false);
+	struct ast_statement_list *list =
+		parse_input("time sh -c 'exit 2' | cat");
+	struct arena arena = { NULL };
+	struct capture cap = { .arena = &arena };
+	struct io_fds fds = {
+		.input_fd = STDIN_FILENO,
+		.output_fd = STDOUT_FILENO,
+	};
+	int pipefd[2];
+
+	capture_pipe(pipefd);
+	fds.error_fd = pipefd[1];
+	/* The status of the pipeline is kept */
+	EXPECT(interpreter_run_fds(interp, list, &fds) == 0);
+	checked_close(pipefd[1]);
+	capture_read(&cap, pipefd[0]);
+	checked_close(pipefd[0]);
+
+	ASSERT(cap.count >= 1);
+	EXPECT(!strncmp(cap.chunks[0].data, "\nreal\t0m0.", 10));
+	EXPECT(strstr(cap.chunks[0].data, "\nuser\t"));
+	EXPECT(strstr(cap.chunks[0].data, "\nexec\t"));
+	EXPECT(strstr(cap.chunks[0].data, "\nmaxrss\t"));
+	ast_statement_list_free(list);
+	arena_free(&arena);
+	interpreter_free(interp);
+}
+
+DEFTEST("interpreter.trace")
+{
+	struct interpreter_state *interp = interpreter_new(false);
+	struct arena arena = { NULL };
+	char path[] = "/tmp/shell_trace_XXXXXX";
+	int fd = mkstemp(path);
+	struct capture cap = { .arena = &arena };
+
+	ASSERT(fd >= 0);
+	variable_set(interp->variables, "SHELL_TRACE", path);
+	run(interp, "sh -c 'exit 3'; echo a | cat; X=$(sh -c true)", &arena);
+	/* Unsetting it closes the trace, writing out every record */
+	run(interp, "SHELL_TRACE=; true", &arena);
+
+	capture_read(&cap, fd);
+	ASSERT(cap.count >= 1);
+	EXPECT(strstr(cap.chunks[0].data, "\"name\":\"sh\",\"status\":3,"));
+	EXPECT(strstr(cap.chunks[0].data, "\"name\":\"echo\",\"status\":0,"));
+	EXPECT(strstr(cap.chunks[0].data, "\"name\":\"cat\",\"status\":0,"));
+	EXPECT(strstr(cap.chunks[0].data, "\"name\":\"(subshell)\","));
+	EXPECT(!strstr(cap.chunks[0].data, "\"name\":\"true\""));
+	close(fd);
+	unlink(path);
+	arena_free(&arena);
+	interpreter_free(interp);
+}
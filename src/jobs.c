@@ -0,0 +1,370 @@
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "error.h"
+#include "jobs.h"
+#include "unit.h"
+
+struct job_table *job_table_new(void)
+{
+	struct job_table *table = checked_calloc(sizeof(struct job_table), 1);
+	sigset_t chld;
+
+	sigemptyset(&chld);
+	sigaddset(&chld, SIGCHLD);
+	CHECKP(sigprocmask(SIG_BLOCK, &chld, &table->saved_mask));
+	table->signal_fd = signalfd(-1, &chld, SFD_NONBLOCK | SFD_CLOEXEC);
+	CHECKP(table->signal_fd);
+	return table;
+}
+
+static void job_free(struct job *job)
+{
+	free(job->processes);
+	free(job->command);
+	free(job);
+}
+
+void job_table_free(struct job_table *table)
+{
+	for (size_t i = 0; i < table->count; i++)
+		job_free(table->jobs[i]);
+	free(table->jobs);
+	checked_close(table->signal_fd);
+	CHECKP(sigprocmask(SIG_SETMASK, &table->saved_mask, NULL));
+	free(table);
+}
+
+void jobs_child_init(struct job_table *table)
+{
+	CHECKP(sigprocmask(SIG_SETMASK, &table->saved_mask, NULL));
+}
+
+struct job *job_add(struct job_table *table, const pid_t *pids, size_t count,
+		    const char *command)
+{
+	struct job *job = checked_calloc(sizeof(struct job), 1);
+
+	CHECK(count);
+	job->id = 1;
+	for (size_t i = 0; i < table->count; i++) {
+		if (table->jobs[i]->id >= job->id)
+			job->id = table->jobs[i]->id + 1;
+	}
+	job->pgid = pids[0];
+	job->processes = checked_calloc(sizeof(struct job_process), count);
+	for (size_t i = 0; i < count; i++)
+		job->processes[i].pid = pids[i];
+	job->process_count = count;
+	job->live = count;
+	job->state = JOB_RUNNING;
+	job->command = checked_strdup(command);
+
+	if (table->count == table->capacity) {
+		table->capacity = table->capacity ? table->capacity * 2 : 8;
+		table->jobs = checked_realloc(table->jobs, sizeof(struct job *),
+					      table->capacity);
+	}
+	table->jobs[table->count++] = job;
+	return job;
+}
+
+void job_remove(struct job_table *table, struct job *job)
+{
+	for (size_t i = 0; i < table->count; i++) {
+		if (table->jobs[i] != job)
+			continue;
+		memmove(&table->jobs[i], &table->jobs[i + 1],
+			(table->count - i - 1) * sizeof(struct job *));
+		table->count--;
+		job_free(job);
+		return;
+	}
+}
+
+struct job *job_current(struct job_table *table)
+{
+	return table->count ? table->jobs[table->count - 1] : NULL;
+}
+
+struct job *job_find(struct job_table *table, const char *spec)
+{
+	bool by_id = spec[0] == '%';
+	char *end;
+	long number;
+
+	if (!strcmp(spec, "%") || !strcmp(spec, "%%") || !strcmp(spec, "%+"))
+		return job_current(table);
+	if (!strcmp(spec, "%-"))
+		return table->count > 1 ? table->jobs[table->count - 2] : NULL;
+
+	if (by_id)
+		spec++;
+	errno = 0;
+	number = strtol(spec, &end, 10);
+	if (!*spec || *end || errno || number <= 0)
+		return NULL;
+
+	for (size_t i = 0; i < table->count; i++) {
+		struct job *job = table->jobs[i];
+
+		if (by_id && job->id == number)
+			return job;
+		for (size_t j = 0; !by_id && j < job->process_count; j++) {
+			if (job->processes[j].pid == number)
+				return job;
+		}
+	}
+	return NULL;
+}
+
+static void process_exited(struct job *job, struct job_process *proc,
+			   int status)
+{
+	if (proc->exited)
+		return;
+	proc->exited = true;
+	job->live--;
+	if (proc == &job->processes[job->process_count - 1])
+		job->status = status;
+	if (!job->live)
+		job->state = JOB_DONE;
+}
+
+static struct job_process *find_process(struct job_table *table, pid_t pid,
+					struct job **job)
+{
+	for (size_t i = 0; i < table->count; i++) {
+		*job = table->jobs[i];
+		for (size_t j = 0; j < (*job)->process_count; j++) {
+			if ((*job)->processes[j].pid == pid)
+				return &(*job)->processes[j];
+		}
+	}
+	return NULL;
+}
+
+/* Apply a state change reported by waitid() */
+static void update(struct job_table *table, const siginfo_t *info)
+{
+	struct job_process *proc;
+	struct job *job;
+
+	proc = find_process(table, info->si_pid, &job);
+	if (!proc)
+		return;
+
+	switch (info->si_code) {
+	case CLD_EXITED:
+		process_exited(job, proc, info->si_status);
+		break;
+	case CLD_KILLED:
+	case CLD_DUMPED:
+		process_exited(job, proc, 128 + info->si_status);
+		break;
+	case CLD_STOPPED:
+		job->state = JOB_STOPPED;
+		break;
+	case CLD_CONTINUED:
+		if (job->state == JOB_STOPPED)
+			job->state = JOB_RUNNING;
+		break;
+	}
+}
+
+void jobs_reap(struct job_table *table)
+{
+	struct signalfd_siginfo si;
+	bool pending = false;
+
+	/* Signals coalesce, so this only says something has changed */
+	while (read(table->signal_fd, &si, sizeof(si)) == sizeof(si))
+		pending = true;
+	if (!pending)
+		return;
+
+	for (;;) {
+		siginfo_t info = { 0 };
+
+		if (waitid(P_ALL, 0, &info,
+			   WEXITED | WSTOPPED | WCONTINUED | WNOHANG) < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == ECHILD)
+				return;
+			RAISE(ERROR_INVALID_ARGUMENT, "waitid: %s",
+			      strerror(errno));
+		}
+		if (!info.si_pid)
+			return;
+		update(table, &info);
+	}
+}
+
+int job_wait(struct job_table *table, struct job *job, bool stopped)
+{
+	int options = WEXITED | (stopped ? WSTOPPED : 0);
+
+	for (size_t i = 0; i < job->process_count; i++) {
+		struct job_process *proc = &job->processes[i];
+
+		while (!proc->exited) {
+			siginfo_t info = { 0 };
+
+			if (waitid(P_PID, proc->pid, &info, options) < 0) {
+				if (errno == EINTR)
+					continue;
+				if (errno != ECHILD)
+					RAISE(ERROR_INVALID_ARGUMENT,
+					      "waitid(%d): %s", (int)proc->pid,
+					      strerror(errno));
+				/* Not our child, as in a subshell */
+				process_exited(job, proc, 127);
+				break;
+			}
+			update(table, &info);
+			if (info.si_code == CLD_STOPPED)
+				return 128 + info.si_status;
+		}
+	}
+	return job->status;
+}
+
+const char *job_describe(struct job_table *table, const struct job *job,
+			 char *buf, size_t len)
+{
+	char marker = ' ';
+	char state[16];
+
+	if (job == job_current(table))
+		marker = '+';
+	else if (table->count > 1 && job == table->jobs[table->count - 2])
+		marker = '-';
+
+	switch (job->state) {
+	case JOB_RUNNING:
+		snprintf(state, sizeof(state), "Running");
+		break;
+	case JOB_STOPPED:
+		snprintf(state, sizeof(state), "Stopped");
+		break;
+	case JOB_DONE:
+		if (job->status)
+			snprintf(state, sizeof(state), "Exit %d", job->status);
+		else
+			snprintf(state, sizeof(state), "Done");
+		break;
+	}
+
+	snprintf(buf, len, "[%d]%c  %-24s%s%s", job->id, marker, state,
+		 job->command, job->state == JOB_RUNNING ? " &" : "");
+	return buf;
+}
+
+void jobs_notify(struct job_table *table, int fd)
+{
+	char buf[1024];
+
+	jobs_reap(table);
+	for (size_t i = 0; i < table->count;) {
+		struct job *job = table->jobs[i];
+
+		if (job->state != JOB_DONE) {
+			i++;
+			continue;
+		}
+		dprintf(fd, "%s\n", job_describe(table, job, buf, sizeof(buf)));
+		job_remove(table, job);
+	}
+}
+
+/* Start a job of processes exiting with the given statuses */
+static struct job *start_job(struct job_table *table, const int *statuses,
+			     size_t count)
+{
+	pid_t pids[8];
+
+	for (size_t i = 0; i < count; i++) {
+		pids[i] = checked_fork();
+		if (pids[i] == 0) {
+			setpgid(0, i ? pids[0] : 0);
+			_exit(statuses[i]);
+		}
+		setpgid(pids[i], pids[0]);
+	}
+	return job_add(table, pids, count, "test");
+}
+
+DEFTEST("jobs.reap")
+{
+	struct job_table *table = job_table_new();
+	struct job *jobs[16];
+	struct pollfd pfd = { .fd = table->signal_fd, .events = POLLIN };
+	size_t done = 0;
+
+	for (int i = 0; i < ARRAY_SIZE(jobs); i++)
+		jobs[i] = start_job(table, &i, 1);
+
+	while (done < ARRAY_SIZE(jobs)) {
+		ASSERT(poll(&pfd, 1, 5000) == 1);
+		jobs_reap(table);
+		done = 0;
+		for (size_t i = 0; i < ARRAY_SIZE(jobs); i++)
+			done += jobs[i]->state == JOB_DONE;
+	}
+
+	for (int i = 0; i < ARRAY_SIZE(jobs); i++) {
+		EXPECT(jobs[i]->id == i + 1);
+		EXPECT(jobs[i]->status == i);
+	}
+	/* Nothing was left unreaped */
+	EXPECT(waitpid(-1, NULL, WNOHANG) < 0 && errno == ECHILD);
+	job_table_free(table);
+}
+
+DEFTEST("jobs.wait")
+{
+	struct job_table *table = job_table_new();
+	const int statuses[] = { 3, 0, 5 };
+	struct job *job = start_job(table, statuses, ARRAY_SIZE(statuses));
+
+	/* The status of a pipeline is that of its last process */
+	EXPECT(job_wait(table, job, false) == 5);
+	EXPECT(job->state == JOB_DONE);
+	EXPECT(job->live == 0);
+	job_table_free(table);
+}
+
+DEFTEST("jobs.find")
+{
+	struct job_table *table = job_table_new();
+	const int status = 0;
+	struct job *first = start_job(table, &status, 1);
+	struct job *second = start_job(table, &status, 1);
+	char pid[16];
+	char buf[128];
+
+	EXPECT(job_find(table, "%1") == first);
+	EXPECT(job_find(table, "%2") == second);
+	EXPECT(job_find(table, "%%") == second);
+	EXPECT(job_find(table, "%-") == first);
+	EXPECT(job_find(table, "%3") == NULL);
+	EXPECT(job_find(table, "%x") == NULL);
+	snprintf(pid, sizeof(pid), "%d", (int)first->pgid);
+	EXPECT(job_find(table, pid) == first);
+
+	job_wait(table, first, false);
+	EXPECT(!strcmp(job_describe(table, first, buf, sizeof(buf)),
+		       "[1]-  Done                    test"));
+	job_wait(table, second, false);
+	job_remove(table, first);
+	EXPECT(job_current(table) == second);
+	EXPECT(job_find(table, "%-") == NULL);
+	job_table_free(table);
+}
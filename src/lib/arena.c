@@ -87,6 +87,57 @@ void arena_free(struct arena *arena)
 	arena->pages = NULL;
 }
 
+void arena_mark(struct arena *arena, struct arena_mark *mark)
+{
+	mark->page = arena->pages;
+	mark->ptr = arena->pages ? arena->pages->ptr : NULL;
+}
+
+void arena_rewind(struct arena *arena, const struct arena_mark *mark)
+{
+	struct arena_header *page = arena->pages;
+
+	while (page && page != mark->page && page->parent) {
+		arena->pages = page->parent;
+		free(page);
+		page = arena->pages;
+	}
+	if (!page)
+		return;
+
+	if (page == mark->page) {
+		page->bytes_left += page->ptr - mark->ptr;
+		page->ptr = mark->ptr;
+	} else {
+		/* The first page, which the mark was taken before */
+		size_t header = increase_size_to_align(
+			sizeof(struct arena_header));
+		void *start = (void *)page + header;
+
+		page->bytes_left += page->ptr - start;
+		page->ptr = start;
+	}
+}
+
+DEFTEST("arena.rewind")
+{
+	struct arena arena = { NULL };
+	struct arena_mark empty, mark;
+	void *first, *kept;
+
+	arena_mark(&arena, &empty);
+	first = arena_malloc(&arena, 1, 16);
+	arena_mark(&arena, &mark);
+	kept = arena_malloc(&arena, 1, 16);
+	arena_malloc(&arena, 1, ARENA_DEFAULT_PAGE_SIZE);
+
+	arena_rewind(&arena, &mark);
+	EXPECT(arena_malloc(&arena, 1, 16) == kept);
+	arena_rewind(&arena, &empty);
+	EXPECT(arena_malloc(&arena, 1, 16) == first);
+	arena_free(&arena);
+}
+
 DEFTEST("arena.alignment")
 {
 	struct arena arena = { NULL };
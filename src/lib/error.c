@@ -163,6 +163,17 @@ char *checked_strdup(const char *str)
 	return buf;
 }
 
+char *checked_strndup(const char *str, size_t len)
+{
+	char *buf;
+
+	len = strnlen(str, len);
+	buf = checked_malloc(sizeof(char), len + 1);
+	memcpy(buf, str, len);
+	buf[len] = '\0';
+	return buf;
+}
+
 void checked_pipe(int pipefd[2])
 {
 	if (!pipe(pipefd))
@@ -209,7 +220,12 @@ int checked_dup2(int filedes, int filedes2)
 
 int checked_open(const char *pathname, int flags, mode_t mode)
 {
-	int fd = open(pathname, flags, mode);
+	return checked_openat(AT_FDCWD, pathname, flags, mode);
+}
+
+int checked_openat(int dirfd, const char *pathname, int flags, mode_t mode)
+{
+	int fd = openat(dirfd, pathname, flags, mode);
 
 	if (fd >= 0)
 		return fd;
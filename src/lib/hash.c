@@ -0,0 +1,27 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hash.h"
+#include "unit.h"
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+uint32_t hash_bytes(const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+	uint32_t hash = FNV_OFFSET_BASIS;
+
+	for (size_t i = 0; i < len; i++) {
+		hash ^= p[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+DEFTEST("hash.fnv1a")
+{
+	EXPECT(hash_bytes("", 0) == FNV_OFFSET_BASIS);
+	EXPECT(hash_bytes("a", 1) == 0xe40c292c);
+	EXPECT(hash_bytes("foobar", 6) == 0xbf9cf968);
+}
@@ -5,6 +5,7 @@
 #include "arena.h"
 #include "error.h"
 #include "string_builder.h"
+#include "unit.h"
 
 struct string_builder_entry {
 	const char *str;
@@ -50,8 +51,9 @@ void string_builder_sized_append(struct string_builder *sb, const char *str,
 		return;
 	CHECK(str);
 
-	if (sb->entries && str == sb->last->str + len) {
+	if (sb->entries && str == sb->last->str + sb->last->len) {
 		sb->last->len += len;
+		sb->total_size += len;
 		return;
 	}
 
@@ -109,3 +111,17 @@ size_t string_builder_length(struct string_builder *sb)
 {
 	return sb->total_size;
 }
+
+DEFTEST("string_builder.contiguous")
+{
+	struct arena arena = { NULL };
+	struct string_builder *sb = string_builder_new(&arena);
+	const char *text = "hello world";
+
+	string_builder_sized_append(sb, text, 5);
+	string_builder_sized_append(sb, text + 5, 6);
+	string_builder_sized_append(sb, text + 4, 1);
+	EXPECT(string_builder_length(sb) == 12);
+	EXPECT(!strcmp(string_builder_finalize(sb), "hello worldo"));
+	arena_free(&arena);
+}
@@ -1,10 +1,8 @@
-#include <inttypes.h>
-#include <graphviz/cgraph.h>
 #include <stdbool.h>
 #include <stdlib.h>
-#include <stdio.h>
+#include <string.h>
 
-#include "arena.h"
+#include "arith.h"
 #include "ast.h"
 #include "common.h"
 #include "error.h"
@@ -20,12 +18,17 @@
 		__m_##NAME(AST_INEW_ASSIGN, AST_INEW_ASSIGN, AST_INEW_ASSIGN, \
 			   SEMICOLON);                                        \
 		_ret->priv.marked_for_deletion = false;                       \
+		_ret->priv.borrowed = false;                                  \
 		return _ret;                                                  \
 	}
 AST_PPLIST(AST_INEW, EMPTY);
 
 /* Implement *_free functions */
-#define AST_IFREE_POINTER(_, FIELD) free(ptr->FIELD)
+#define AST_IFREE_POINTER(_, FIELD)       \
+	do {                              \
+		if (!ptr->priv.borrowed)  \
+			free(ptr->FIELD); \
+	} while (0)
 #define AST_IFREE_AST_TYPE(TYPE, FIELD) TYPE##_free(ptr->FIELD)
 #define AST_IFREE(NAME)                                                        \
 	void NAME##_free(struct NAME *ptr)                                     \
@@ -43,124 +46,69 @@ AST_PPLIST(AST_INEW, EMPTY);
 	}
 AST_PPLIST(AST_IFREE, EMPTY);
 
-static char *ptr_to_graph_node_name(const char *prefix, void *ptr,
-				    struct arena *arena)
+static char *copy_pfield_data(const struct ast_string *str)
 {
-	size_t size = strlen(prefix) + 17;
-	char *result = arena_malloc(arena, sizeof(char), size);
-	snprintf(result, size, "%s%016lX", prefix, (uintptr_t)ptr);
-	return result;
-}
+	char *data;
 
-static char *render_pfield_data(struct ast_string *str, struct arena *arena)
-{
-	char *result = arena_malloc(arena, sizeof(char), str->size + 1);
-	memcpy(result, str->data, str->size);
-	result[str->size] = '\0';
-	return result;
+	if (!str->data)
+		return NULL;
+	data = checked_malloc(sizeof(char), str->size ? str->size : 1);
+	memcpy(data, str->data, str->size);
+	return data;
 }
 
-static char *render_field_size(struct ast_string *str, struct arena *arena)
+static struct arith_program *copy_pfield_program(const struct ast_arith *arith)
 {
-	const size_t size = 22;
-	char *result = arena_malloc(arena, sizeof(char), size);
-	snprintf(result, size, "%zu", str->size);
-	return result;
-}
+	size_t size;
+	void *program;
 
-static char *render_field_background(struct ast_statement *statement,
-				     struct arena *arena)
-{
-	return arena_strdup(arena, statement->background ? "true" : "false");
+	/* Programs contain no pointers, so they are copied as they are */
+	if (!arith->program)
+		return NULL;
+	size = arith_program_size(arith->program);
+	program = checked_malloc(1, size);
+	memcpy(program, arith->program, size);
+	return program;
 }
 
-static char *render_field_type(struct ast_glob *glob, struct arena *arena)
+/* Lay the words out again as one block, however the original was */
+static char **copy_pfield_argv(const struct ast_command *cmd)
 {
-	switch (glob->type) {
-	case GLOB_STAR:
-		return arena_strdup(arena, "GLOB_STAR");
-	case GLOB_ONE:
-		return arena_strdup(arena, "GLOB_ONE");
-	case GLOB_CHARSET:
-		return arena_strdup(arena, "GLOB_CHARSET");
+	size_t count = 0;
+	size_t size = 0;
+	char **argv;
+	char *words;
+
+	if (!cmd->argv)
+		return NULL;
+	for (; cmd->argv[count]; count++)
+		size += strlen(cmd->argv[count]) + 1;
+
+	argv = checked_malloc(1, (count + 1) * sizeof(char *) + size);
+	words = (char *)(argv + count + 1);
+	for (size_t i = 0; i < count; i++) {
+		argv[i] = strcpy(words, cmd->argv[i]);
+		words += strlen(words) + 1;
 	}
-	RAISE(ERROR_NOT_IMPLEMENTED, "Unknown glob type!");
+	argv[count] = NULL;
+	return argv;
 }
 
-static void *null_graphviz_ptr;
-
-/* Implement *_graph functions */
-#define AST_IGRAPH_PRIMITIVE(TYPE, FIELD)                                      \
-	do {                                                                   \
-		Agnode_t *child_node = agnode(                                 \
-			graph,                                                 \
-			ptr_to_graph_node_name("nv", &(astobj->FIELD), arena), \
-			1);                                                    \
-		agsafeset(child_node, "label",                                 \
-			  render_field_##FIELD(astobj, arena), "");            \
-		agsafeset(child_node, "shape", "plaintext", "");               \
-		agsafeset(child_node, "margin", "0", "");                      \
-		agsafeset(child_node, "fontname", "monospace", "monospace");   \
-		Agedge_t *edge = agedge(                                       \
-			graph, node, child_node,                               \
-			ptr_to_graph_node_name("ev", &(astobj->FIELD), arena), \
-			1);                                                    \
-		agsafeset(edge, "label", #FIELD, "");                          \
-	} while (0)
-#define AST_IGRAPH_POINTER(TYPE, FIELD)                                     \
-	do {                                                                \
-		if (astobj->FIELD) {                                        \
-			Agnode_t *child_node =                              \
-				agnode(graph,                               \
-				       ptr_to_graph_node_name(              \
-					       "np", astobj->FIELD, arena), \
-				       1);                                  \
-			agset(child_node, "label",                          \
-			      render_pfield_##FIELD(astobj, arena));        \
-			agsafeset(child_node, "shape", "plaintext", "");    \
-			agsafeset(child_node, "margin", "0", "");           \
-			Agedge_t *edge =                                    \
-				agedge(graph, node, child_node,             \
-				       ptr_to_graph_node_name(              \
-					       "ep", astobj->FIELD, arena), \
-				       1);                                  \
-			agsafeset(edge, "label", #FIELD, "");               \
-		}                                                           \
-	} while (0)
-#define AST_IGRAPH_AST_TYPE(TYPE, FIELD)                                    \
-	do {                                                                \
-		Agnode_t *child_node =                                      \
-			TYPE##_graph(astobj->FIELD, graph, arena);          \
-		Agedge_t *edge = agedge(                                    \
-			graph, node, child_node,                            \
-			ptr_to_graph_node_name("ea", astobj->FIELD, arena), \
-			1);                                                 \
-		agsafeset(edge, "label", #FIELD, "");                       \
-	} while (0)
-#define AST_IGRAPH(NAME)                                                       \
-	Agnode_t *NAME##_graph(struct NAME *astobj, Agraph_t *graph,           \
-			       struct arena *arena)                            \
-	{                                                                      \
-		Agnode_t *node;                                                \
-		if (!astobj) {                                                 \
-			node = agnode(graph,                                   \
-				      ptr_to_graph_node_name(                  \
-					      "z", null_graphviz_ptr++,        \
-					      arena),                          \
-				      1);                                      \
-			agsafeset(node, "label", "NULL", "");                  \
-			agsafeset(node, "shape", "plaintext", "");             \
-			agsafeset(node, "fontname", "monospace", "monospace"); \
-			agsafeset(node, "margin", "0", "");                    \
-		} else {                                                       \
-			node = agnode(graph,                                   \
-				      ptr_to_graph_node_name("na", astobj,     \
-							     arena),           \
-				      1);                                      \
-			agset(node, "label", #NAME);                           \
-			__m_##NAME(AST_IGRAPH_PRIMITIVE, AST_IGRAPH_POINTER,   \
-				   AST_IGRAPH_AST_TYPE, SEMICOLON);            \
-		}                                                              \
-		return node;                                                   \
+/* Implement *_copy functions */
+#define AST_ICOPY_PRIMITIVE(_, FIELD) _ret->FIELD = ptr->FIELD
+#define AST_ICOPY_POINTER(_, FIELD) _ret->FIELD = copy_pfield_##FIELD(ptr)
+#define AST_ICOPY_AST_TYPE(TYPE, FIELD) _ret->FIELD = TYPE##_copy(ptr->FIELD)
+#define AST_ICOPY(NAME)                                                    \
+	struct NAME *NAME##_copy(const struct NAME *ptr)                   \
+	{                                                                  \
+		struct NAME *_ret;                                         \
+		if (!ptr)                                                  \
+			return NULL;                                       \
+		_ret = checked_malloc(sizeof(struct NAME), 1);             \
+		__m_##NAME(AST_ICOPY_PRIMITIVE, AST_ICOPY_POINTER,         \
+			   AST_ICOPY_AST_TYPE, SEMICOLON);                 \
+		_ret->priv.marked_for_deletion = false;                    \
+		_ret->priv.borrowed = false;                               \
+		return _ret;                                               \
 	}
-AST_PPLIST(AST_IGRAPH, EMPTY);
+AST_PPLIST(AST_ICOPY, EMPTY);
@@ -0,0 +1,409 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "arith.h"
+#include "ast.h"
+#include "ast_cache.h"
+#include "common.h"
+#include "error.h"
+#include "parser.h"
+#include "unit.h"
+
+#define AST_CACHE_MAGIC "shastc\0"
+#define AST_CACHE_VERSION 4
+
+/* Every object in a file starts at a multiple of this */
+#define AST_CACHE_ALIGN 16
+
+#ifndef MAP_FIXED_NOREPLACE
+/* Older kernels take the address as a hint, which is checked anyway */
+#define MAP_FIXED_NOREPLACE 0
+#endif
+
+struct cache_header {
+	char magic[8];
+	uint32_t version;
+	/* Changes whenever the layout of the tree does */
+	uint32_t layout;
+	uint64_t dev;
+	uint64_t ino;
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	uint64_t script_size;
+	/* The address the pointers in the file are relative to */
+	uint64_t base;
+	uint64_t size;
+	/* Offsets of the statement list (0 if there is none) ... */
+	uint64_t root;
+	/* ... and of the table of offsets of every pointer in the file */
+	uint64_t relocs;
+	uint64_t reloc_count;
+};
+
+struct writer {
+	char *buf;
+	size_t len;
+	size_t capacity;
+	uint64_t *relocs;
+	size_t reloc_count;
+	size_t reloc_capacity;
+};
+
+/* Append an object (zeroes, if data is NULL) and return its offset */
+static uint64_t put(struct writer *w, const void *data, size_t size)
+{
+	size_t offset = (w->len + AST_CACHE_ALIGN - 1) & ~(AST_CACHE_ALIGN - 1);
+
+	if (offset + size > w->capacity) {
+		w->capacity = (offset + size) * 2;
+		w->buf = checked_realloc(w->buf, sizeof(char), w->capacity);
+	}
+	memset(w->buf + w->len, 0, offset - w->len);
+	if (data)
+		memcpy(w->buf + offset, data, size);
+	else
+		memset(w->buf + offset, 0, size);
+	w->len = offset + size;
+	return offset;
+}
+
+/* Point the pointer at offset slot to the object at offset target */
+static void put_pointer(struct writer *w, uint64_t slot, uint64_t target)
+{
+	uint64_t value = target ? AST_CACHE_BASE + target : 0;
+
+	memcpy(w->buf + slot, &value, sizeof(value));
+	if (!target)
+		return;
+
+	if (w->reloc_count == w->reloc_capacity) {
+		w->reloc_capacity = w->reloc_capacity * 2 + 64;
+		w->relocs = checked_realloc(w->relocs, sizeof(uint64_t),
+					    w->reloc_capacity);
+	}
+	w->relocs[w->reloc_count++] = slot;
+}
+
+static uint64_t serialize_pfield_data(struct writer *w,
+				      struct ast_string *str)
+{
+	if (!str->data)
+		return 0;
+	return put(w, str->data, str->size);
+}
+
+static uint64_t serialize_pfield_program(struct writer *w,
+					 struct ast_arith *arith)
+{
+	/* Programs contain no pointers, so they are copied as they are */
+	if (!arith->program)
+		return 0;
+	return put(w, arith->program, arith_program_size(arith->program));
+}
+
+static uint64_t serialize_pfield_argv(struct writer *w,
+				      struct ast_command *cmd)
+{
+	size_t count = 0;
+	uint64_t vector;
+
+	if (!cmd->argv)
+		return 0;
+	while (cmd->argv[count])
+		count++;
+
+	vector = put(w, NULL, (count + 1) * sizeof(char *));
+	for (size_t i = 0; i < count; i++)
+		put_pointer(w, vector + i * sizeof(char *),
+			    put(w, cmd->argv[i], strlen(cmd->argv[i]) + 1));
+	return vector;
+}
+
+/* Forward-declare the *_serialize functions, as the tree is circular */
+#define AST_SERIALIZE_PROTO(NAME) \
+	static uint64_t NAME##_serialize(struct writer *w, struct NAME *ptr)
+AST_PPLIST(AST_SERIALIZE_PROTO, SEMICOLON);
+
+/* Implement *_serialize functions */
+#define AST_FIELD_OFFSET(FIELD) ((char *)&ptr->FIELD - (char *)ptr)
+#define AST_ISERIALIZE_POINTER(_, FIELD)                    \
+	put_pointer(w, offset + AST_FIELD_OFFSET(FIELD), \
+		    serialize_pfield_##FIELD(w, ptr))
+#define AST_ISERIALIZE_AST_TYPE(TYPE, FIELD)                \
+	put_pointer(w, offset + AST_FIELD_OFFSET(FIELD), \
+		    TYPE##_serialize(w, ptr->FIELD))
+#define AST_ISERIALIZE(NAME)                                                 \
+	AST_SERIALIZE_PROTO(NAME)                                            \
+	{                                                                    \
+		struct NAME copy;                                            \
+		uint64_t offset;                                             \
+		if (!ptr)                                                    \
+			return 0;                                            \
+		copy = *ptr;                                                 \
+		copy.priv.marked_for_deletion = false;                       \
+		copy.priv.borrowed = true;                                   \
+		offset = put(w, &copy, sizeof(copy));                        \
+		__m_##NAME(EMPTY, AST_ISERIALIZE_POINTER,                    \
+			   AST_ISERIALIZE_AST_TYPE, SEMICOLON);              \
+		return offset;                                               \
+	}
+AST_PPLIST(AST_ISERIALIZE, EMPTY);
+
+#define AST_SIZEOF(NAME) sizeof(struct NAME)
+#define PLUS() +
+
+static uint32_t layout(void)
+{
+	return AST_CACHE_ALIGN + sizeof(void *) + AST_PPLIST(AST_SIZEOF, PLUS);
+}
+
+static char *cache_path(const char *dir, const struct stat *script)
+{
+	size_t size = strlen(dir) + 64;
+	char *path = checked_malloc(sizeof(char), size);
+
+	snprintf(path, size, "%s/%jx-%jx.ast", dir, (uintmax_t)script->st_dev,
+		 (uintmax_t)script->st_ino);
+	return path;
+}
+
+static void init_header(struct cache_header *header,
+			const struct stat *script)
+{
+	*header = (struct cache_header){
+		.version = AST_CACHE_VERSION,
+		.layout = layout(),
+		.dev = script->st_dev,
+		.ino = script->st_ino,
+		.mtime_sec = script->st_mtim.tv_sec,
+		.mtime_nsec = script->st_mtim.tv_nsec,
+		.script_size = script->st_size,
+		.base = AST_CACHE_BASE,
+	};
+	memcpy(header->magic, AST_CACHE_MAGIC, sizeof(header->magic));
+}
+
+/* Whether a header is for the script as it is now, and makes sense */
+static bool header_valid(const struct cache_header *header,
+			 const struct stat *script, const struct stat *file)
+{
+	struct cache_header expected;
+
+	init_header(&expected, script);
+	return !memcmp(header, &expected,
+		       offsetof(struct cache_header, size)) &&
+	       header->size == (uint64_t)file->st_size &&
+	       header->root < header->size && header->relocs <= header->size &&
+	       header->reloc_count <=
+		       (header->size - header->relocs) / sizeof(uint64_t);
+}
+
+static bool relocate(char *addr, const struct cache_header *header)
+{
+	const uint64_t *relocs = (const uint64_t *)(addr + header->relocs);
+	uint64_t delta = (uintptr_t)addr - header->base;
+
+	for (uint64_t i = 0; i < header->reloc_count; i++) {
+		if (relocs[i] > header->size - sizeof(uint64_t) ||
+		    relocs[i] % sizeof(uint64_t))
+			return false;
+		*(uint64_t *)(addr + relocs[i]) += delta;
+	}
+	return true;
+}
+
+bool ast_cache_load(const char *dir, const struct stat *script,
+		    struct ast_cache_mapping *mapping)
+{
+	struct cache_header header;
+	char *path = cache_path(dir, script);
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	struct stat file;
+	void *addr;
+
+	free(path);
+	if (fd < 0)
+		return false;
+	if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+	    fstat(fd, &file) || !header_valid(&header, script, &file)) {
+		close(fd);
+		return false;
+	}
+
+	*mapping = (struct ast_cache_mapping){ .size = header.size };
+	addr = mmap((void *)header.base, header.size, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_FIXED_NOREPLACE, fd, 0);
+	if (addr != MAP_FAILED && addr != (void *)header.base) {
+		munmap(addr, header.size);
+		addr = MAP_FAILED;
+	}
+	if (addr == MAP_FAILED) {
+		addr = mmap(NULL, header.size, PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE, fd, 0);
+		if (addr != MAP_FAILED && !relocate(addr, &header)) {
+			munmap(addr, header.size);
+			addr = MAP_FAILED;
+		}
+		mapping->relocated = true;
+	}
+	close(fd);
+	if (addr == MAP_FAILED)
+		return false;
+
+	mapping->addr = addr;
+	if (header.root)
+		mapping->list = (struct ast_statement_list *)((char *)addr +
+							      header.root);
+	return true;
+}
+
+void ast_cache_unmap(struct ast_cache_mapping *mapping)
+{
+	munmap(mapping->addr, mapping->size);
+	mapping->addr = NULL;
+	mapping->list = NULL;
+}
+
+/*
+ * Write buf out aside and rename it to path, so a loader never sees
+ * half a file. The temporary file is created before the error handler
+ * is set, so the handler only reads what was known on entry.
+ */
+static void write_cache_file(const char *path, const void *buf, size_t len)
+{
+	char *tmp = checked_malloc(sizeof(char), strlen(path) + 8);
+	struct error error;
+	int saved;
+	int fd;
+
+	sprintf(tmp, "%s.XXXXXX", path);
+	fd = mkostemp(tmp, O_CLOEXEC);
+	if (fd < 0) {
+		saved = errno;
+		free(tmp);
+		RAISE(ERROR_INVALID_ARGUMENT, "mkostemp: %s: %s", path,
+		      strerror(saved));
+	}
+
+	if (GET_ERROR(&error)) {
+		close(fd);
+		unlink(tmp);
+		free(tmp);
+		reraise(&error);
+	}
+	checked_write_all(fd, buf, len);
+	exit_error_handler(&error);
+
+	if (close(fd) || rename(tmp, path)) {
+		saved = errno;
+		unlink(tmp);
+		free(tmp);
+		RAISE(ERROR_INVALID_ARGUMENT, "%s: %s", path, strerror(saved));
+	}
+	free(tmp);
+}
+
+void ast_cache_store(const char *dir, const struct stat *script,
+		     struct ast_statement_list *list)
+{
+	/* On the heap, as it grows after the error handler is set */
+	struct writer *w = checked_calloc(sizeof(struct writer), 1);
+	struct cache_header header;
+	struct error error;
+	char *path = cache_path(dir, script);
+
+	if (GET_ERROR(&error)) {
+		free(path);
+		free(w->buf);
+		free(w->relocs);
+		free(w);
+		reraise(&error);
+	}
+
+	init_header(&header, script);
+	put(w, &header, sizeof(header));
+	header.root = ast_statement_list_serialize(w, list);
+	header.relocs = put(w, w->relocs, w->reloc_count * sizeof(uint64_t));
+	header.reloc_count = w->reloc_count;
+	header.size = w->len;
+	memcpy(w->buf, &header, sizeof(header));
+
+	if (mkdir(dir, 0700) && errno != EEXIST)
+		RAISE(ERROR_INVALID_ARGUMENT, "mkdir: %s: %s", dir,
+		      strerror(errno));
+	write_cache_file(path, w->buf, w->len);
+	exit_error_handler(&error);
+
+	free(path);
+	free(w->buf);
+	free(w->relocs);
+	free(w);
+}
+
+static void expect_same(struct ast_statement_list *list)
+{
+	struct ast_command *cmd = list->first->and_or->pipeline->first;
+	struct ast_command *ls = list->rest->first->and_or->pipeline->first;
+	struct ast_argument_list *args = cmd->arglist;
+	struct ast_arith *arith = args->rest->rest->first->parts->first->arith;
+
+	EXPECT(cmd->assignments->first->name->size == 1 &&
+	       cmd->assignments->first->name->data[0] == 'x');
+	EXPECT(args->first->parts->first->string->size == 4 &&
+	       !strncmp(args->first->parts->first->string->data, "echo", 4));
+	EXPECT(args->rest->first->parts->rest->first->quoted);
+	ASSERT(arith);
+	EXPECT(arith_program_size(arith->program) > 0);
+	EXPECT(!list->first->and_or->pipeline->rest->first->arglist->rest);
+
+	ASSERT(ls->argv);
+	EXPECT(!strcmp(ls->argv[0], "ls") && !strcmp(ls->argv[1], "-l"));
+	EXPECT(!ls->argv[2]);
+	EXPECT(ls->output_file && !list->rest->rest);
+}
+
+DEFTEST("ast_cache.roundtrip")
+{
+	char dir[] = "/tmp/ast_cache_test_XXXXXX";
+	struct stat script = { .st_dev = 1, .st_ino = 2, .st_size = 3 };
+	struct ast_cache_mapping first;
+	struct ast_cache_mapping second;
+	struct ast_statement_list *list =
+		parse_input("x=1 echo a\"$x\"b $((1 + 2)) | cat; ls -l > f");
+	char *path;
+
+	ASSERT(mkdtemp(dir));
+	path = cache_path(dir, &script);
+	expect_same(list);
+	EXPECT(!ast_cache_load(dir, &script, &first));
+	ast_cache_store(dir, &script, list);
+	ast_statement_list_free(list);
+
+	ASSERT(ast_cache_load(dir, &script, &first));
+	EXPECT(!first.relocated && first.addr == (void *)AST_CACHE_BASE);
+	expect_same(first.list);
+
+	/* The address is taken now, so this one has to be moved */
+	ASSERT(ast_cache_load(dir, &script, &second));
+	EXPECT(second.relocated);
+	expect_same(second.list);
+	ast_cache_unmap(&first);
+	ast_cache_unmap(&second);
+
+	/* Once the script changes, its cached tree is out of date */
+	script.st_mtim.tv_sec++;
+	EXPECT(!ast_cache_load(dir, &script, &first));
+
+	unlink(path);
+	free(path);
+	rmdir(dir);
+}
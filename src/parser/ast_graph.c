@@ -0,0 +1,203 @@
+#include <inttypes.h>
+#include <graphviz/cgraph.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "arena.h"
+#include "arith.h"
+#include "ast.h"
+#include "ast_graph.h"
+#include "common.h"
+#include "error.h"
+#include "string_builder.h"
+
+static char *ptr_to_graph_node_name(const char *prefix, void *ptr,
+				    struct arena *arena)
+{
+	size_t size = strlen(prefix) + 17;
+	char *result = arena_malloc(arena, sizeof(char), size);
+	snprintf(result, size, "%s%016lX", prefix, (uintptr_t)ptr);
+	return result;
+}
+
+static char *render_pfield_data(struct ast_string *str, struct arena *arena)
+{
+	char *result = arena_malloc(arena, sizeof(char), str->size + 1);
+	memcpy(result, str->data, str->size);
+	result[str->size] = '\0';
+	return result;
+}
+
+static char *render_pfield_program(struct ast_arith *arith,
+				   struct arena *arena)
+{
+	size_t len;
+	const char *source = arith_program_source(arith->program, &len);
+	char *result = arena_malloc(arena, sizeof(char), len + 1);
+
+	memcpy(result, source, len);
+	result[len] = '\0';
+	return result;
+}
+
+static char *render_pfield_argv(struct ast_command *cmd, struct arena *arena)
+{
+	struct string_builder *sb = string_builder_new(arena);
+
+	for (char **arg = cmd->argv; *arg; arg++) {
+		if (arg != cmd->argv)
+			string_builder_append(sb, " ");
+		string_builder_append(sb, *arg);
+	}
+	return string_builder_finalize(sb);
+}
+
+static char *render_field_size(struct ast_string *str, struct arena *arena)
+{
+	const size_t size = 22;
+	char *result = arena_malloc(arena, sizeof(char), size);
+	snprintf(result, size, "%zu", str->size);
+	return result;
+}
+
+static char *render_field_background(struct ast_statement *statement,
+				     struct arena *arena)
+{
+	return arena_strdup(arena, statement->background ? "true" : "false");
+}
+
+static char *render_field_connective(struct ast_and_or *and_or,
+				     struct arena *arena)
+{
+	switch (and_or->connective) {
+	case CONNECTIVE_AND:
+		return arena_strdup(arena, "&&");
+	case CONNECTIVE_OR:
+		return arena_strdup(arena, "||");
+	}
+	RAISE(ERROR_NOT_IMPLEMENTED, "Unknown connective!");
+}
+
+static char *render_field_timed(struct ast_and_or *and_or,
+				struct arena *arena)
+{
+	return arena_strdup(arena, and_or->timed ? "true" : "false");
+}
+
+static char *render_field_literal(struct ast_argument *arg,
+				  struct arena *arena)
+{
+	return arena_strdup(arena, arg->literal ? "true" : "false");
+}
+
+static char *render_field_quoted(struct ast_argument_part *part,
+				 struct arena *arena)
+{
+	return arena_strdup(arena, part->quoted ? "true" : "false");
+}
+
+static char *render_field_type(struct ast_glob *glob, struct arena *arena)
+{
+	switch (glob->type) {
+	case GLOB_STAR:
+		return arena_strdup(arena, "GLOB_STAR");
+	case GLOB_ONE:
+		return arena_strdup(arena, "GLOB_ONE");
+	case GLOB_CHARSET:
+		return arena_strdup(arena, "GLOB_CHARSET");
+	}
+	RAISE(ERROR_NOT_IMPLEMENTED, "Unknown glob type!");
+}
+
+static char *render_field_kind(struct ast_loop *loop, struct arena *arena)
+{
+	switch (loop->kind) {
+	case LOOP_FOR:
+		return arena_strdup(arena, "LOOP_FOR");
+	case LOOP_WHILE:
+		return arena_strdup(arena, "LOOP_WHILE");
+	case LOOP_UNTIL:
+		return arena_strdup(arena, "LOOP_UNTIL");
+	}
+	RAISE(ERROR_NOT_IMPLEMENTED, "Unknown loop kind!");
+}
+
+static void *null_graphviz_ptr;
+
+/* Implement *_graph functions */
+#define AST_IGRAPH_PRIMITIVE(TYPE, FIELD)                                      \
+	do {                                                                   \
+		Agnode_t *child_node = agnode(                                 \
+			graph,                                                 \
+			ptr_to_graph_node_name("nv", &(astobj->FIELD), arena), \
+			1);                                                    \
+		agsafeset(child_node, "label",                                 \
+			  render_field_##FIELD(astobj, arena), "");            \
+		agsafeset(child_node, "shape", "plaintext", "");               \
+		agsafeset(child_node, "margin", "0", "");                      \
+		agsafeset(child_node, "fontname", "monospace", "monospace");   \
+		Agedge_t *edge = agedge(                                       \
+			graph, node, child_node,                               \
+			ptr_to_graph_node_name("ev", &(astobj->FIELD), arena), \
+			1);                                                    \
+		agsafeset(edge, "label", #FIELD, "");                          \
+	} while (0)
+#define AST_IGRAPH_POINTER(TYPE, FIELD)                                     \
+	do {                                                                \
+		if (astobj->FIELD) {                                        \
+			Agnode_t *child_node =                              \
+				agnode(graph,                               \
+				       ptr_to_graph_node_name(              \
+					       "np", astobj->FIELD, arena), \
+				       1);                                  \
+			agset(child_node, "label",                          \
+			      render_pfield_##FIELD(astobj, arena));        \
+			agsafeset(child_node, "shape", "plaintext", "");    \
+			agsafeset(child_node, "margin", "0", "");           \
+			Agedge_t *edge =                                    \
+				agedge(graph, node, child_node,             \
+				       ptr_to_graph_node_name(              \
+					       "ep", astobj->FIELD, arena), \
+				       1);                                  \
+			agsafeset(edge, "label", #FIELD, "");               \
+		}                                                           \
+	} while (0)
+#define AST_IGRAPH_AST_TYPE(TYPE, FIELD)                                    \
+	do {                                                                \
+		Agnode_t *child_node =                                      \
+			TYPE##_graph(astobj->FIELD, graph, arena);          \
+		Agedge_t *edge = agedge(                                    \
+			graph, node, child_node,                            \
+			ptr_to_graph_node_name("ea", astobj->FIELD, arena), \
+			1);                                                 \
+		agsafeset(edge, "label", #FIELD, "");                       \
+	} while (0)
+#define AST_IGRAPH(NAME)                                                       \
+	Agnode_t *NAME##_graph(struct NAME *astobj, Agraph_t *graph,           \
+			       struct arena *arena)                            \
+	{                                                                      \
+		Agnode_t *node;                                                \
+		if (!astobj) {                                                 \
+			node = agnode(graph,                                   \
+				      ptr_to_graph_node_name(                  \
+					      "z", null_graphviz_ptr++,        \
+					      arena),                          \
+				      1);                                      \
+			agsafeset(node, "label", "NULL", "");                  \
+			agsafeset(node, "shape", "plaintext", "");             \
+			agsafeset(node, "fontname", "monospace", "monospace"); \
+			agsafeset(node, "margin", "0", "");                    \
+		} else {                                                       \
+			node = agnode(graph,                                   \
+				      ptr_to_graph_node_name("na", astobj,     \
+							     arena),           \
+				      1);                                      \
+			agset(node, "label", #NAME);                           \
+			__m_##NAME(AST_IGRAPH_PRIMITIVE, AST_IGRAPH_POINTER,   \
+				   AST_IGRAPH_AST_TYPE, SEMICOLON);            \
+		}                                                              \
+		return node;                                                   \
+	}
+AST_PPLIST(AST_IGRAPH, EMPTY);
@@ -7,12 +7,14 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 
 #include "common.h"
 #include "error.h"
 #include "lex.h"
+#include "unit.h"
 
 const char *token_type_as_string[] = PPLIST_STRINGIFY(TOKEN_TYPE_PPLIST);
 
@@ -381,3 +383,112 @@ void lexer_next(struct lexer_state *lex)
 	RAISE(ERROR_SYNTAX, "Lex error at offset %zu",
 	      lex->begin + lex->length);
 }
+
+static void push_token(struct token_array *tokens, struct token token)
+{
+	if (tokens->count == tokens->capacity) {
+		tokens->capacity *= 2;
+		tokens->tokens = checked_realloc(tokens->tokens,
+						 sizeof(struct token),
+						 tokens->capacity);
+	}
+	tokens->tokens[tokens->count++] = token;
+}
+
+/*
+ * Where the input was cut short, a lex error ends the tokens as the end
+ * of the input would: just after the last token lexed.
+ */
+static void lex_stop_early(struct token_array *tokens)
+{
+	uint32_t end = 0;
+
+	if (tokens->count)
+		end = tokens->tokens[tokens->count - 1].begin +
+		      tokens->tokens[tokens->count - 1].length;
+	push_token(tokens, (struct token){ .type = TT_STOP, .begin = end });
+}
+
+static void lex_tokens(const char *input, struct token_array *tokens,
+		       bool prefix)
+{
+	size_t len = strlen(input);
+	struct lexer_state lex;
+	struct error error;
+
+	if (len > UINT32_MAX)
+		RAISE(ERROR_OVERFLOW, "The input is too large to lex.");
+
+	tokens->count = 0;
+	tokens->capacity = len / LEX_BYTES_PER_TOKEN + 16;
+	tokens->tokens = checked_malloc(sizeof(struct token),
+					tokens->capacity);
+
+	if (GET_ERROR(&error)) {
+		if (prefix && error.type == ERROR_SYNTAX) {
+			exit_error_handler(&error);
+			lex_stop_early(tokens);
+			return;
+		}
+		token_array_free(tokens);
+		reraise(&error);
+	}
+
+	init_lexer(&lex, input);
+	do {
+		lexer_next(&lex);
+		push_token(tokens, (struct token){
+			.type = lex.type,
+			.begin = lex.begin,
+			.length = lex.length,
+		});
+	} while (lex.type != TT_STOP);
+
+	exit_error_handler(&error);
+}
+
+void lex_all(const char *input, struct token_array *tokens)
+{
+	lex_tokens(input, tokens, false);
+}
+
+void lex_prefix(const char *input, struct token_array *tokens)
+{
+	lex_tokens(input, tokens, true);
+}
+
+void token_array_free(struct token_array *tokens)
+{
+	free(tokens->tokens);
+	tokens->tokens = NULL;
+	tokens->count = 0;
+	tokens->capacity = 0;
+}
+
+DEFTEST("lex.all")
+{
+	struct token_array tokens;
+	struct error error;
+	const enum token_type expected[] = {
+		TT_RAW, TT_WHITESPACE, TT_UNBRACED_PARAMETER,
+		TT_PIPE, TT_RAW,       TT_STATEMENT_END,
+		TT_STOP,
+	};
+
+	lex_all("echo $x|wc;", &tokens);
+	ASSERT(tokens.count == ARRAY_SIZE(expected));
+	for (size_t i = 0; i < tokens.count; i++)
+		EXPECT(tokens.tokens[i].type == expected[i]);
+	EXPECT(tokens.tokens[2].begin == 5 && tokens.tokens[2].length == 2);
+	token_array_free(&tokens);
+
+	if (GET_ERROR(&error)) {
+		EXPECT(error.type == ERROR_SYNTAX);
+		EXPECT(!tokens.tokens && !tokens.count);
+		exit_error_handler(&error);
+		return;
+	}
+	lex_all("echo 'unclosed", &tokens);
+	exit_error_handler(&error);
+	EXPECT(false);
+}
@@ -1,13 +1,24 @@
+#include <ctype.h>
 #include <stdbool.h>
 #include <string.h>
 
+#include "arith.h"
 #include "ast.h"
 #include "error.h"
 #include "lex.h"
+#include "parser.h"
+#include "unit.h"
 
 struct parser_state {
-	struct lexer_state *lex;
+	const char *input;
+	/* The whole input, lexed up front; the last token is TT_STOP */
+	const struct token *tokens;
+	size_t pos;
 	bool in_ticks;
+	/* Whether strings may point into the input rather than copy it */
+	bool borrow;
+	/* What closes the innermost construct being parsed, if anything */
+	const char *awaiting;
 };
 
 struct escapedef {
@@ -33,15 +44,22 @@ static struct escapedef escape_for_raw[] = {
 	{ NULL },
 };
 
+static const struct token *parser_token(struct parser_state *parser)
+{
+	return &parser->tokens[parser->pos];
+}
+
 static enum token_type parser_peek(struct parser_state *parser)
 {
-	return parser->lex->type;
+	return parser_token(parser)->type;
 }
 
 static bool parser_accept(struct parser_state *parser, enum token_type token)
 {
 	if (parser_peek(parser) == token) {
-		lexer_next(parser->lex);
+		/* Past the end, the input keeps ending */
+		if (token != TT_STOP)
+			parser->pos++;
 		return true;
 	}
 	return false;
@@ -54,7 +72,7 @@ static bool parser_expect(struct parser_state *parser, enum token_type token)
 
 	RAISE(ERROR_SYNTAX, "Expected token of type %s, got %s!",
 	      token_type_as_string[token],
-	      token_type_as_string[parser->lex->type]);
+	      token_type_as_string[parser_peek(parser)]);
 }
 
 static struct ast_string *string_start(void)
@@ -65,27 +83,73 @@ static struct ast_string *string_start(void)
 static void string_append(struct ast_string *string, const char *buf,
 			  size_t buf_sz)
 {
+	if (string->priv.borrowed) {
+		char *copy = checked_malloc(sizeof(char),
+					    string->size + buf_sz);
+
+		memcpy(copy, string->data, string->size);
+		string->data = copy;
+		string->priv.borrowed = false;
+	}
 	string->data = checked_realloc(string->data, sizeof(char),
 				       string->size + buf_sz);
 	memcpy(string->data + string->size, buf, buf_sz);
 	string->size = string->size + buf_sz;
 }
 
+/*
+ * Whether a span of input may contain an escape. Only the first
+ * character of each escape is looked for, which is enough to know the
+ * span can be used as it is.
+ */
+static bool may_have_escape(const char *p, size_t len,
+			    struct escapedef *escapes)
+{
+	for (; escapes && escapes->find; escapes++) {
+		if (memchr(p, escapes->find[0], len))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Use a span of input for a string without copying it, if the string is
+ * empty or is already a view which the span continues.
+ */
+static bool string_borrow(struct ast_string *string, const char *p,
+			  size_t len)
+{
+	if (!string->size && !string->data) {
+		string->data = (char *)p;
+		string->priv.borrowed = true;
+	} else if (!string->priv.borrowed ||
+		   string->data + string->size != p) {
+		return false;
+	}
+	string->size += len;
+	return true;
+}
+
 static void
 parser_expect_into_string(struct parser_state *parser, enum token_type token,
 			  struct ast_string *string, size_t charskip_left,
 			  size_t charskip_right, struct escapedef *escapes)
 {
-	const char *start =
-		parser->lex->input + parser->lex->begin + charskip_left;
+	const struct token *tok = parser_token(parser);
+	const char *start = parser->input + tok->begin + charskip_left;
 	const char *p = start;
 	size_t chars_left;
 
-	CHECK(parser->lex->length >= charskip_left + charskip_right);
+	CHECK(tok->length >= charskip_left + charskip_right);
 
-	chars_left = parser->lex->length - charskip_left - charskip_right;
+	chars_left = tok->length - charskip_left - charskip_right;
 	parser_expect(parser, token);
 
+	if (parser->borrow && chars_left &&
+	    !may_have_escape(start, chars_left, escapes) &&
+	    string_borrow(string, start, chars_left))
+		return;
+
 	while (chars_left) {
 		size_t chars_consumed = 0;
 
@@ -117,11 +181,64 @@ parser_expect_into_string(struct parser_state *parser, enum token_type token,
 static struct ast_statement_list *
 parse_statement_list(struct parser_state *parser);
 
+/*
+ * Gather the raw text of an arithmetic expression up to the closing
+ * )) and compile it, so that the bytecode is kept with the statement.
+ */
+static struct ast_arith *parse_arith(struct parser_state *parser)
+{
+	struct ast_string *text = string_start();
+	const char *outer = parser->awaiting;
+	struct ast_arith *arith;
+	struct error error;
+	size_t depth = 0;
+
+	if (GET_ERROR(&error)) {
+		ast_string_free(text);
+		reraise(&error);
+	}
+
+	parser->awaiting = ")";
+	for (;;) {
+		switch (parser_peek(parser)) {
+		case TT_STOP:
+			RAISE(ERROR_SYNTAX, "Missing ))");
+		case TT_START_MATHEXP:
+			depth += 2;
+			break;
+		case TT_LPAREN:
+		case TT_START_PAREN_SUBSTITUTION:
+			depth++;
+			break;
+		case TT_RPAREN:
+			if (!depth)
+				goto done;
+			depth--;
+			break;
+		default:
+			break;
+		}
+		parser_expect_into_string(parser, parser_peek(parser), text, 0,
+					  0, NULL);
+	}
+
+done:
+	parser_expect(parser, TT_RPAREN);
+	if (!parser_accept(parser, TT_RPAREN))
+		RAISE(ERROR_SYNTAX, "Missing ))");
+	arith = ast_arith_new(arith_compile(text->data, text->size));
+	exit_error_handler(&error);
+	ast_string_free(text);
+	parser->awaiting = outer;
+	return arith;
+}
+
 static struct ast_argument_part *
 parse_argument_part(struct parser_state *parser, bool in_qq)
 {
 	struct ast_argument_part *part =
-		ast_argument_part_new(NULL, NULL, NULL, NULL);
+		ast_argument_part_new(NULL, NULL, NULL, NULL, NULL, in_qq);
+	const char *outer = parser->awaiting;
 
 	if (parser_peek(parser) == TT_UNBRACED_PARAMETER) {
 		part->parameter = string_start();
@@ -135,10 +252,13 @@ parse_argument_part(struct parser_state *parser, bool in_qq)
 			RAISE(ERROR_SYNTAX, "Bad parameter: ${}");
 
 		part->parameter = string_start();
+		parser->awaiting = "}";
 
 		for (;;) {
-			if (parser_accept(parser, TT_RBRACE))
+			if (parser_accept(parser, TT_RBRACE)) {
+				parser->awaiting = outer;
 				return part;
+			}
 
 			if (parser_accept(parser, TT_STOP))
 				RAISE(ERROR_SYNTAX,
@@ -151,15 +271,24 @@ parse_argument_part(struct parser_state *parser, bool in_qq)
 
 	if (!parser->in_ticks && parser_accept(parser, TT_TICK)) {
 		parser->in_ticks = true;
+		parser->awaiting = "`";
 		part->substitution = parse_statement_list(parser);
 		parser->in_ticks = false;
 		parser_expect(parser, TT_TICK);
+		parser->awaiting = outer;
+		return part;
+	}
+
+	if (parser_accept(parser, TT_START_MATHEXP)) {
+		part->arith = parse_arith(parser);
 		return part;
 	}
 
 	if (parser_accept(parser, TT_START_PAREN_SUBSTITUTION)) {
+		parser->awaiting = ")";
 		part->substitution = parse_statement_list(parser);
 		parser_expect(parser, TT_RPAREN);
+		parser->awaiting = outer;
 		return part;
 	}
 
@@ -200,6 +329,12 @@ parse_argument_part(struct parser_state *parser, bool in_qq)
 				parser, parser_peek(parser), part->string, 0, 0,
 				in_qq ? escape_for_qqstring : escape_for_raw);
 			break;
+		case TT_LBRACE:
+		case TT_RBRACE:
+			/* Braces outside ${} are ordinary characters */
+			parser_expect_into_string(parser, parser_peek(parser),
+						  part->string, 0, 0, NULL);
+			break;
 		case TT_GLOB_ONE:
 		case TT_GLOB_STAR:
 		case TT_GLOB_CHARSET:
@@ -252,7 +387,7 @@ static struct ast_argument *parse_argument(struct parser_state *parser)
 	struct ast_argument_part_list *parts =
 		parse_argument_part_list(parser, false);
 	if (parts)
-		return ast_argument_new(parts);
+		return ast_argument_new(parts, false);
 	return NULL;
 }
 
@@ -298,10 +433,235 @@ parse_assignment_list(struct parser_state *parser)
 	return NULL;
 }
 
+/*
+ * Whether the next token is a reserved word, which is only one at the
+ * start of a command and when it makes up a whole word
+ */
+static bool parser_peek_keyword(struct parser_state *parser,
+				const char *keyword)
+{
+	const struct token *tok = parser_token(parser);
+	size_t len = strlen(keyword);
+
+	if (tok->type != TT_RAW || tok->length != len ||
+	    strncmp(parser->input + tok->begin, keyword, len))
+		return false;
+
+	switch (tok[1].type) {
+	case TT_STOP:
+	case TT_WHITESPACE:
+	case TT_STATEMENT_END:
+	case TT_BACKGROUND:
+	case TT_PIPE:
+	case TT_AND:
+	case TT_OR:
+	case TT_RPAREN:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static void parser_expect_keyword(struct parser_state *parser,
+				  const char *keyword)
+{
+	while (parser_accept(parser, TT_WHITESPACE) ||
+	       parser_accept(parser, TT_STATEMENT_END))
+		continue;
+
+	if (!parser_peek_keyword(parser, keyword))
+		RAISE(ERROR_SYNTAX, "Expected %s", keyword);
+	parser->pos++;
+}
+
+static bool has_statements(struct ast_statement_list *list)
+{
+	for (; list; list = list->rest) {
+		if (list->first)
+			return true;
+	}
+	return false;
+}
+
+/* The name and words of a for loop, up to the ; or newline before do */
+static void parse_for(struct parser_state *parser, struct ast_loop *loop)
+{
+	while (parser_accept(parser, TT_WHITESPACE))
+		continue;
+
+	loop->variable = string_start();
+	parser_expect_into_string(parser, TT_RAW, loop->variable, 0, 0, NULL);
+	for (size_t i = 0; i < loop->variable->size; i++) {
+		char c = loop->variable->data[i];
+
+		if (!isalnum(c) && c != '_')
+			RAISE(ERROR_SYNTAX, "Bad for loop variable");
+	}
+
+	while (parser_accept(parser, TT_WHITESPACE))
+		continue;
+	if (!parser_peek_keyword(parser, "in"))
+		RAISE(ERROR_SYNTAX, "Expected in");
+	parser->pos++;
+
+	while (parser_accept(parser, TT_WHITESPACE))
+		continue;
+	loop->words = parse_argument_list(parser);
+	while (parser_accept(parser, TT_WHITESPACE))
+		continue;
+	parser_expect(parser, TT_STATEMENT_END);
+}
+
+static struct ast_loop *parse_loop(struct parser_state *parser)
+{
+	const char *outer = parser->awaiting;
+	struct ast_loop *loop;
+	struct error error;
+	enum ast_loop_kind kind;
+
+	while (parser_accept(parser, TT_WHITESPACE))
+		continue;
+
+	if (parser_peek_keyword(parser, "for"))
+		kind = LOOP_FOR;
+	else if (parser_peek_keyword(parser, "while"))
+		kind = LOOP_WHILE;
+	else if (parser_peek_keyword(parser, "until"))
+		kind = LOOP_UNTIL;
+	else
+		return NULL;
+	parser->pos++;
+
+	loop = ast_loop_new(kind, NULL, NULL, NULL, NULL);
+	if (GET_ERROR(&error)) {
+		ast_loop_free(loop);
+		reraise(&error);
+	}
+
+	parser->awaiting = "do";
+	if (kind == LOOP_FOR) {
+		parse_for(parser, loop);
+	} else {
+		loop->condition = parse_statement_list(parser);
+		if (!has_statements(loop->condition))
+			RAISE(ERROR_SYNTAX, "Expected a loop condition");
+	}
+	parser_expect_keyword(parser, "do");
+	parser->awaiting = "done";
+	loop->body = parse_statement_list(parser);
+	if (!has_statements(loop->body))
+		RAISE(ERROR_SYNTAX, "Expected a command after do");
+	parser_expect_keyword(parser, "done");
+
+	exit_error_handler(&error);
+	parser->awaiting = outer;
+	return loop;
+}
+
+/* A loop may be followed by redirections, but not by arguments */
+static struct ast_command *parse_loop_command(struct parser_state *parser,
+					      struct ast_loop *loop)
+{
+	struct ast_command *command =
+		ast_command_new(NULL, NULL, NULL, NULL, NULL, NULL, loop, NULL);
+	struct ast_argument **target;
+	struct error error;
+
+	if (GET_ERROR(&error)) {
+		ast_command_free(command);
+		reraise(&error);
+	}
+
+	for (;;) {
+		while (parser_accept(parser, TT_WHITESPACE))
+			continue;
+
+		if (parser_accept(parser, TT_READ_SIGIL))
+			target = &command->input_file;
+		else if (parser_accept(parser, TT_WRITE_SIGIL))
+			target = &command->output_file;
+		else if (parser_accept(parser, TT_APPEND_SIGIL))
+			target = &command->append_file;
+		else
+			break;
+
+		while (parser_accept(parser, TT_WHITESPACE))
+			continue;
+		ast_argument_free(*target);
+		*target = parse_argument(parser);
+		if (!*target)
+			RAISE(ERROR_SYNTAX, "Expected a file to redirect to");
+	}
+
+	exit_error_handler(&error);
+	return command;
+}
+
+/* Whether the next tokens are name() or name (), starting a function */
+static bool parser_peek_function(struct parser_state *parser)
+{
+	const struct token *tok = parser_token(parser);
+
+	if (tok->type != TT_RAW)
+		return false;
+	tok++;
+	if (tok->type == TT_WHITESPACE)
+		tok++;
+	return tok[0].type == TT_LPAREN && tok[1].type == TT_RPAREN;
+}
+
+static struct ast_function *parse_function(struct parser_state *parser)
+{
+	const char *outer = parser->awaiting;
+	struct ast_function *function;
+	struct error error;
+
+	if (!parser_peek_function(parser))
+		return NULL;
+
+	function = ast_function_new(string_start(), NULL);
+	if (GET_ERROR(&error)) {
+		ast_function_free(function);
+		reraise(&error);
+	}
+
+	parser_expect_into_string(parser, TT_RAW, function->name, 0, 0, NULL);
+	parser_accept(parser, TT_WHITESPACE);
+	parser_expect(parser, TT_LPAREN);
+	parser_expect(parser, TT_RPAREN);
+	parser->awaiting = "{";
+	while (parser_accept(parser, TT_WHITESPACE) ||
+	       parser_accept(parser, TT_STATEMENT_END))
+		continue;
+
+	parser_expect(parser, TT_LBRACE);
+	parser->awaiting = "}";
+	function->body = parse_statement_list(parser);
+	if (!has_statements(function->body))
+		RAISE(ERROR_SYNTAX, "Expected a command in the function");
+	parser_expect(parser, TT_RBRACE);
+
+	exit_error_handler(&error);
+	parser->awaiting = outer;
+	return function;
+}
+
 static struct ast_command *parse_command(struct parser_state *parser)
 {
-	struct ast_command *command = ast_command_new(
-		parse_assignment_list(parser), NULL, NULL, NULL, NULL);
+	struct ast_loop *loop = parse_loop(parser);
+	struct ast_function *function;
+	struct ast_command *command;
+
+	if (loop)
+		return parse_loop_command(parser, loop);
+
+	function = parse_function(parser);
+	if (function)
+		return ast_command_new(NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+				       function);
+
+	command = ast_command_new(parse_assignment_list(parser), NULL, NULL,
+				  NULL, NULL, NULL, NULL, NULL);
 
 	for (;;) {
 		while (parser_accept(parser, TT_WHITESPACE))
@@ -363,6 +723,12 @@ static struct ast_pipeline *parse_pipeline(struct parser_state *parser)
 	if (parser_peek(parser) == TT_PIPE)
 		RAISE(ERROR_SYNTAX, "Unexpected pipe!");
 
+	/* These end the statement list of a loop or a function */
+	if (parser_peek_keyword(parser, "do") ||
+	    parser_peek_keyword(parser, "done") ||
+	    parser_peek(parser) == TT_RBRACE)
+		return NULL;
+
 	command = parse_command(parser);
 	if (!command)
 		return NULL;
@@ -378,15 +744,86 @@ static struct ast_pipeline *parse_pipeline(struct parser_state *parser)
 	return pipeline;
 }
 
-static struct ast_statement *parse_statement(struct parser_state *parser)
+/* Accept the time keyword, which must be followed by whitespace */
+static bool parser_accept_time(struct parser_state *parser)
 {
+	const struct token *tok;
+
+	while (parser_accept(parser, TT_WHITESPACE))
+		continue;
+
+	tok = parser_token(parser);
+	if (tok->type != TT_RAW || tok->length != 4 ||
+	    strncmp(parser->input + tok->begin, "time", 4) ||
+	    tok[1].type != TT_WHITESPACE)
+		return false;
+	parser->pos++;
+	return true;
+}
+
+/* Skip whitespace and newlines, but not ;, as may follow && and || */
+static void parser_skip_linebreak(struct parser_state *parser)
+{
+	for (;;) {
+		const struct token *tok = parser_token(parser);
+
+		if (tok->type != TT_WHITESPACE &&
+		    (tok->type != TT_STATEMENT_END ||
+		     parser->input[tok->begin] != '\n'))
+			return;
+		parser->pos++;
+	}
+}
+
+static struct ast_and_or *parse_and_or(struct parser_state *parser)
+{
+	bool timed = parser_accept_time(parser);
 	struct ast_pipeline *pipeline = parse_pipeline(parser);
+	struct ast_and_or *and_or;
+
+	if (!pipeline) {
+		if (timed)
+			RAISE(ERROR_SYNTAX, "Expected a command after time");
+		return NULL;
+	}
+
+	and_or = ast_and_or_new(pipeline, timed, CONNECTIVE_AND, NULL);
+
+	while (parser_accept(parser, TT_WHITESPACE))
+		continue;
+
+	if (parser_accept(parser, TT_AND))
+		and_or->connective = CONNECTIVE_AND;
+	else if (parser_accept(parser, TT_OR))
+		and_or->connective = CONNECTIVE_OR;
+	else
+		return and_or;
+
+	/*
+	 * Input which ends here leaves the statement unfinished, and
+	 * parse_prefix() reports it as awaiting more.
+	 */
+	parser_skip_linebreak(parser);
+	and_or->rest = parse_and_or(parser);
+	if (!and_or->rest) {
+		bool and = and_or->connective == CONNECTIVE_AND;
+
+		ast_and_or_free(and_or);
+		RAISE(ERROR_SYNTAX, "Expected a command after %s",
+		      and ? "&&" : "||");
+	}
+	return and_or;
+}
+
+static struct ast_statement *parse_statement(struct parser_state *parser)
+{
+	struct ast_and_or *and_or = parse_and_or(parser);
 	struct ast_statement *statement;
 
-	if (!pipeline)
+	if (!and_or)
 		return NULL;
 
-	statement = ast_statement_new(pipeline, false);
+	statement = ast_statement_new(and_or, false);
 
 	while (parser_accept(parser, TT_WHITESPACE))
 		continue;
@@ -414,24 +851,269 @@ parse_statement_list(struct parser_state *parser)
 		while (parser_accept(parser, TT_WHITESPACE))
 			continue;
 
-		if (parser_accept(parser, TT_STATEMENT_END))
+		/* & ends a statement just as ; does */
+		if (parser_accept(parser, TT_STATEMENT_END) ||
+		    (list->first && list->first->background))
 			list->rest = parse_statement_list(parser);
 	}
 
 	return list;
 }
 
-struct ast_statement_list *parse_input(const char *input)
+static struct ast_statement_list *parse_text(const char *input, bool borrow)
 {
-	struct lexer_state lex;
-	struct parser_state parse = { .lex = &lex, .in_ticks = false };
-	struct ast_statement_list *statement_list;
-
-	init_lexer(&lex, input);
-	lexer_next(&lex);
+	struct token_array tokens;
+	struct parser_state parse = {
+		.input = input,
+		.in_ticks = false,
+		.borrow = borrow,
+	};
+	struct ast_statement_list *statement_list = NULL;
+	struct error error;
+
+	lex_all(input, &tokens);
+	parse.tokens = tokens.tokens;
+
+	if (GET_ERROR(&error)) {
+		ast_statement_list_free(statement_list);
+		token_array_free(&tokens);
+		reraise(&error);
+	}
 	statement_list = parse_statement_list(&parse);
 	if (parser_peek(&parse) != TT_STOP)
 		RAISE(ERROR_SYNTAX, "Unexpected token: %s",
 		      token_type_as_string[parser_peek(&parse)]);
+	ast_simplify(statement_list);
+	exit_error_handler(&error);
+
+	token_array_free(&tokens);
 	return statement_list;
 }
+
+struct ast_statement_list *parse_input(const char *input)
+{
+	return parse_text(input, false);
+}
+
+struct ast_statement_list *parse_input_view(const char *input)
+{
+	return parse_text(input, true);
+}
+
+/*
+ * Parse a statement, or return false if it is a syntax error. Any other
+ * error frees the statements parsed before it.
+ */
+static bool try_parse_statement(struct parser_state *parser,
+				struct ast_statement **statement,
+				struct ast_statement_list *before)
+{
+	struct error error;
+
+	if (GET_ERROR(&error)) {
+		if (error.type != ERROR_SYNTAX) {
+			ast_statement_list_free(before);
+			reraise(&error);
+		}
+		exit_error_handler(&error);
+		return false;
+	}
+	*statement = parse_statement(parser);
+	exit_error_handler(&error);
+	return true;
+}
+
+/*
+ * A statement is only whole once it has been ended, by a newline, ; or &.
+ * One cut short by the end of the input may yet go on, or may not even
+ * parse until it does; one which stops short of the end never will.
+ */
+static struct ast_statement_list *parse_prefix(struct parser_state *parser,
+					       size_t *end,
+					       const char **awaiting)
+{
+	struct ast_statement_list *list = NULL;
+	struct ast_statement_list **tail = &list;
+	struct ast_statement *statement;
+
+	*end = 0;
+	for (;;) {
+		while (parser_accept(parser, TT_WHITESPACE))
+			continue;
+		if (parser_peek(parser) == TT_STOP)
+			break;
+		if (!try_parse_statement(parser, &statement, list))
+			break;
+
+		if (!parser_accept(parser, TT_STATEMENT_END) &&
+		    !(statement && statement->background)) {
+			ast_statement_free(statement);
+			break;
+		}
+		*tail = ast_statement_list_new(statement, NULL);
+		tail = &(*tail)->rest;
+		*end = parser_token(parser)->begin;
+	}
+
+	if (parser_peek(parser) != TT_STOP)
+		*awaiting = NULL;
+	else
+		*awaiting = parser->awaiting ? parser->awaiting : "";
+	return list;
+}
+
+struct ast_statement_list *parse_input_prefix(const char *input, size_t *end,
+					      const char **awaiting)
+{
+	struct token_array tokens;
+	struct parser_state parse = {
+		.input = input,
+		.in_ticks = false,
+		.borrow = true,
+	};
+	struct ast_statement_list *statement_list;
+	const struct token *stop;
+	struct error error;
+
+	lex_prefix(input, &tokens);
+	parse.tokens = tokens.tokens;
+
+	if (GET_ERROR(&error)) {
+		token_array_free(&tokens);
+		reraise(&error);
+	}
+	statement_list = parse_prefix(&parse, end, awaiting);
+	exit_error_handler(&error);
+
+	/* Cut short in a token, the statement first needs that finished */
+	stop = &tokens.tokens[tokens.count - 1];
+	if (*awaiting && input[stop->begin])
+		*awaiting = input[stop->begin] == '\'' ? "'" : "";
+
+	ast_simplify(statement_list);
+	token_array_free(&tokens);
+	return statement_list;
+}
+
+DEFTEST("parser.view")
+{
+	const char *input = "echo hi \"a\\$b\"";
+	struct ast_statement_list *list = parse_input_view(input);
+	struct ast_argument_list *args =
+		list->first->and_or->pipeline->first->arglist;
+	struct ast_string *echo = args->first->parts->first->string;
+	struct ast_string *hi = args->rest->first->parts->first->string;
+	struct ast_string *quoted =
+		args->rest->rest->first->parts->first->string;
+
+	EXPECT(echo->priv.borrowed && echo->data == input && echo->size == 4);
+	EXPECT(hi->priv.borrowed && hi->data == input + 5);
+	EXPECT(!quoted->priv.borrowed && quoted->size == 3 &&
+	       !strncmp(quoted->data, "a$b", 3));
+	ast_statement_list_free(list);
+
+	list = parse_input(input);
+	args = list->first->and_or->pipeline->first->arglist;
+	EXPECT(!args->first->parts->first->string->priv.borrowed);
+	ast_statement_list_free(list);
+}
+
+DEFTEST("parser.and_or")
+{
+	struct ast_statement_list *list =
+		parse_input("true &&\n\n  echo x ||\necho y");
+	struct ast_and_or *and_or = list->first->and_or;
+
+	/* A newline may follow && and || without ending the statement */
+	EXPECT(!list->rest);
+	EXPECT(and_or->connective == CONNECTIVE_AND);
+	ASSERT(and_or->rest && and_or->rest->rest);
+	EXPECT(and_or->rest->connective == CONNECTIVE_OR);
+	ast_statement_list_free(list);
+
+	EXPECT_RAISES(ERROR_SYNTAX, parse_input("true &&\n; echo x"));
+	EXPECT_RAISES(ERROR_SYNTAX, parse_input("true ||\n"));
+}
+
+DEFTEST("parser.loops")
+{
+	struct ast_statement_list *list =
+		parse_input("for x in a $b\ndo echo done; done > out");
+	struct ast_command *cmd = list->first->and_or->pipeline->first;
+	struct ast_loop *loop = cmd->loop;
+
+	ASSERT_NOT_NULL(loop);
+	EXPECT(loop->kind == LOOP_FOR && !cmd->arglist && cmd->output_file);
+	EXPECT(loop->variable->size == 1 && loop->variable->data[0] == 'x');
+	EXPECT(loop->words && loop->words->rest && !loop->words->rest->rest);
+	/* done is only a keyword where a command could start */
+	EXPECT(loop->body->first->and_or->pipeline->first->arglist->rest);
+	ast_statement_list_free(list);
+
+	list = parse_input("while true; do :; done | cat");
+	loop = list->first->and_or->pipeline->first->loop;
+	EXPECT(loop && loop->kind == LOOP_WHILE && loop->condition);
+	EXPECT(list->first->and_or->pipeline->rest);
+	ast_statement_list_free(list);
+
+	EXPECT_RAISES(ERROR_SYNTAX, parse_input("for x; do :; done"));
+	EXPECT_RAISES(ERROR_SYNTAX, parse_input("until true; do :"));
+}
+
+DEFTEST("parser.functions")
+{
+	struct ast_statement_list *list =
+		parse_input("f () {\necho }\n}; echo {x} | cat");
+	struct ast_command *cmd = list->first->and_or->pipeline->first;
+	struct ast_function *function = cmd->function;
+
+	ASSERT_NOT_NULL(function);
+	EXPECT(function->name->size == 1 && function->name->data[0] == 'f');
+	EXPECT(!cmd->arglist && has_statements(function->body));
+	/* A brace is only special where a command could start */
+	EXPECT(list->rest->first->and_or->pipeline->first->argv);
+	ast_statement_list_free(list);
+
+	EXPECT_RAISES(ERROR_SYNTAX, parse_input("f() { echo; "));
+	EXPECT_RAISES(ERROR_SYNTAX, parse_input("f() echo"));
+	EXPECT_RAISES(ERROR_SYNTAX, parse_input("}"));
+}
+
+DEFTEST("parser.prefix")
+{
+	const struct {
+		const char *input;
+		size_t statements;
+		size_t end;
+		const char *awaiting;
+	} cases[] = {
+		{ "a; b\nc 'cut\nshort", 2, 5, "'" },
+		{ "a\n\nb &", 3, 6, "" },
+		{ "for x in a\ndo b\n", 0, 0, "done" },
+		{ "f() {\nfor x in a\n", 0, 0, "do" },
+		{ "a\nb $(c\n", 1, 2, ")" },
+		{ "a )\nb\n", 0, 0, NULL },
+		{ "a &&\n\n b ||\n", 0, 0, "" },
+		{ "a &&\n\n b\nc", 1, 9, "" },
+		{ "a &&\n;b\n", 0, 0, NULL },
+	};
+
+	for (size_t i = 0; i < ARRAY_SIZE(cases); i++) {
+		struct ast_statement_list *list;
+		const char *awaiting = "unset";
+		size_t statements = 0;
+		size_t end = SIZE_MAX;
+
+		list = parse_input_prefix(cases[i].input, &end, &awaiting);
+		for (struct ast_statement_list *p = list; p; p = p->rest)
+			statements++;
+		EXPECT(statements == cases[i].statements);
+		EXPECT(end == cases[i].end);
+		if (!cases[i].awaiting)
+			EXPECT_NULL(awaiting);
+		else
+			EXPECT(awaiting &&
+			       !strcmp(awaiting, cases[i].awaiting));
+		ast_statement_list_free(list);
+	}
+}
@@ -0,0 +1,159 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "error.h"
+#include "parser.h"
+#include "unit.h"
+
+static bool is_literal_part(struct ast_argument_part *part)
+{
+	return part->string && !part->parameter && !part->glob &&
+	       !part->substitution && !part->arith;
+}
+
+/* Append the text of b to a, as a view if b directly follows it */
+static void join_strings(struct ast_string *a, struct ast_string *b)
+{
+	char *data;
+
+	if (a->priv.borrowed && b->priv.borrowed &&
+	    a->data + a->size == b->data) {
+		a->size += b->size;
+		return;
+	}
+
+	data = checked_malloc(sizeof(char), a->size + b->size);
+	memcpy(data, a->data, a->size);
+	memcpy(data + a->size, b->data, b->size);
+	if (!a->priv.borrowed)
+		free(a->data);
+	a->data = data;
+	a->size += b->size;
+	a->priv.borrowed = false;
+}
+
+/*
+ * Merge runs of adjacent literal parts into one, and mark the argument
+ * literal if that leaves a single literal part.
+ */
+static void simplify_argument(struct ast_argument *arg)
+{
+	struct ast_argument_part_list *parts;
+
+	if (!arg)
+		return;
+
+	for (parts = arg->parts; parts; parts = parts->rest) {
+		struct ast_argument_part_list *next;
+
+		if (parts->first->substitution)
+			ast_simplify(parts->first->substitution);
+		while ((next = parts->rest) && is_literal_part(parts->first) &&
+		       is_literal_part(next->first)) {
+			join_strings(parts->first->string, next->first->string);
+			parts->first->quoted |= next->first->quoted;
+			parts->rest = next->rest;
+			next->rest = NULL;
+			ast_argument_part_list_free(next);
+		}
+	}
+
+	arg->literal = arg->parts && !arg->parts->rest &&
+		       is_literal_part(arg->parts->first);
+}
+
+/*
+ * Lay out the words of a command made only of literal arguments as one
+ * block: the NULL-terminated vector, followed by the NUL-terminated
+ * words it points to.
+ */
+static char **literal_argv(struct ast_argument_list *args)
+{
+	size_t count = 0;
+	size_t size = 0;
+	char **argv;
+	char *words;
+
+	for (struct ast_argument_list *a = args; a; a = a->rest) {
+		if (!a->first->literal)
+			return NULL;
+		count++;
+		size += a->first->parts->first->string->size + 1;
+	}
+	if (!count)
+		return NULL;
+
+	argv = checked_malloc(1, (count + 1) * sizeof(char *) + size);
+	words = (char *)(argv + count + 1);
+	for (size_t i = 0; i < count; i++, args = args->rest) {
+		struct ast_string *word = args->first->parts->first->string;
+
+		memcpy(words, word->data, word->size);
+		words[word->size] = '\0';
+		argv[i] = words;
+		words += word->size + 1;
+	}
+	argv[count] = NULL;
+	return argv;
+}
+
+static void simplify_command(struct ast_command *cmd)
+{
+	for (struct ast_assignment_list *a = cmd->assignments; a; a = a->rest)
+		simplify_argument(a->first->value);
+	for (struct ast_argument_list *a = cmd->arglist; a; a = a->rest)
+		simplify_argument(a->first);
+	simplify_argument(cmd->input_file);
+	simplify_argument(cmd->output_file);
+	simplify_argument(cmd->append_file);
+	if (cmd->loop) {
+		for (struct ast_argument_list *a = cmd->loop->words; a;
+		     a = a->rest)
+			simplify_argument(a->first);
+		ast_simplify(cmd->loop->condition);
+		ast_simplify(cmd->loop->body);
+	}
+	if (cmd->function)
+		ast_simplify(cmd->function->body);
+
+	free(cmd->argv);
+	cmd->argv = literal_argv(cmd->arglist);
+}
+
+void ast_simplify(struct ast_statement_list *list)
+{
+	for (; list; list = list->rest) {
+		if (!list->first)
+			continue;
+		for (struct ast_and_or *and_or = list->first->and_or; and_or;
+		     and_or = and_or->rest) {
+			for (struct ast_pipeline *p = and_or->pipeline; p;
+			     p = p->rest)
+				simplify_command(p->first);
+		}
+	}
+}
+
+DEFTEST("simplify.literal_argv")
+{
+	struct ast_statement_list *list =
+		parse_input_view("echo a'b c'\"d\" $x; ls -l | wc");
+	struct ast_command *echo = list->first->and_or->pipeline->first;
+	struct ast_pipeline *ls = list->rest->first->and_or->pipeline;
+	struct ast_argument *ab = echo->arglist->rest->first;
+
+	/* The parts of a'b c'"d" are merged into one word */
+	EXPECT(ab->literal && !ab->parts->rest);
+	EXPECT(ab->parts->first->string->size == 5 &&
+	       !strncmp(ab->parts->first->string->data, "ab cd", 5));
+	EXPECT(!echo->argv);
+
+	ASSERT(ls->first->argv && ls->rest->first->argv);
+	EXPECT(!strcmp(ls->first->argv[0], "ls"));
+	EXPECT(!strcmp(ls->first->argv[1], "-l"));
+	EXPECT(!ls->first->argv[2]);
+	EXPECT(!strcmp(ls->rest->first->argv[0], "wc"));
+	ast_statement_list_free(list);
+}
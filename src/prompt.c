@@ -0,0 +1,151 @@
+#include <pwd.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "error.h"
+#include "prompt.h"
+#include "unit.h"
+
+struct prompt {
+	char *user;
+	char *home;
+	char *cwd;
+	int status;
+	/* Whether rendered is out of date */
+	bool dirty;
+	char *rendered;
+	size_t rendered_size;
+};
+
+static char *lookup_user(void)
+{
+	struct passwd *pw = getpwuid(geteuid());
+	const char *user;
+
+	if (pw && pw->pw_name)
+		return checked_strdup(pw->pw_name);
+	user = getenv("USER");
+	return checked_strdup(user ? user : "?");
+}
+
+static char *lookup_home(void)
+{
+	const char *home = getenv("HOME");
+	struct passwd *pw;
+
+	if (home)
+		return checked_strdup(home);
+	pw = getpwuid(geteuid());
+	return pw && pw->pw_dir ? checked_strdup(pw->pw_dir) : NULL;
+}
+
+struct prompt *prompt_new(void)
+{
+	struct prompt *prompt = checked_calloc(sizeof(struct prompt), 1);
+	char *cwd = getcwd(NULL, 0);
+
+	prompt->user = lookup_user();
+	prompt->home = lookup_home();
+	prompt->cwd = checked_strdup(cwd ? cwd : "?");
+	prompt->dirty = true;
+	free(cwd);
+	return prompt;
+}
+
+void prompt_free(struct prompt *prompt)
+{
+	free(prompt->user);
+	free(prompt->home);
+	free(prompt->cwd);
+	free(prompt->rendered);
+	free(prompt);
+}
+
+void prompt_set_cwd(struct prompt *prompt, const char *cwd)
+{
+	if (!strcmp(prompt->cwd, cwd))
+		return;
+	free(prompt->cwd);
+	prompt->cwd = checked_strdup(cwd);
+	prompt->dirty = true;
+}
+
+void prompt_set_status(struct prompt *prompt, int status)
+{
+	if (prompt->status == status)
+		return;
+	prompt->status = status;
+	prompt->dirty = true;
+}
+
+/* Format the prompt, as for snprintf() */
+static int format(struct prompt *prompt, char *buf, size_t size)
+{
+	size_t home_len = prompt->home ? strlen(prompt->home) : 0;
+	const char *dir = prompt->cwd;
+	const char *tilde = "";
+
+	/* Shorten the home directory to ~ */
+	if (home_len > 1 && !strncmp(dir, prompt->home, home_len) &&
+	    (!dir[home_len] || dir[home_len] == '/')) {
+		tilde = "~";
+		dir += home_len;
+	}
+
+	if (!prompt->status)
+		return snprintf(buf, size, "%s %s%s :) $ ", prompt->user,
+				tilde, dir);
+	return snprintf(buf, size, "%s %s%s :( %d $ ", prompt->user, tilde,
+			dir, prompt->status);
+}
+
+const char *prompt_render(struct prompt *prompt)
+{
+	size_t size;
+
+	if (!prompt->dirty)
+		return prompt->rendered;
+
+	size = format(prompt, NULL, 0) + 1;
+	if (size > prompt->rendered_size) {
+		prompt->rendered = checked_realloc(prompt->rendered,
+						   sizeof(char), size);
+		prompt->rendered_size = size;
+	}
+	format(prompt, prompt->rendered, size);
+	prompt->dirty = false;
+	return prompt->rendered;
+}
+
+DEFTEST("prompt.render")
+{
+	struct prompt *prompt = prompt_new();
+	const char *rendered;
+
+	free(prompt->user);
+	free(prompt->home);
+	prompt->user = checked_strdup("user");
+	prompt->home = checked_strdup("/home/user");
+
+	prompt_set_cwd(prompt, "/home/user/src");
+	EXPECT(!strcmp(prompt_render(prompt), "user ~/src :) $ "));
+	prompt_set_cwd(prompt, "/home/username");
+	EXPECT(!strcmp(prompt_render(prompt), "user /home/username :) $ "));
+	prompt_set_cwd(prompt, "/home/user");
+	prompt_set_status(prompt, 127);
+	EXPECT(!strcmp(prompt_render(prompt), "user ~ :( 127 $ "));
+
+	/* Nothing is rendered again until an input changes */
+	rendered = prompt_render(prompt);
+	prompt_set_status(prompt, 127);
+	prompt_set_cwd(prompt, "/home/user");
+	EXPECT(!prompt->dirty);
+	EXPECT(prompt_render(prompt) == rendered);
+	prompt_set_status(prompt, 0);
+	EXPECT(prompt->dirty);
+	EXPECT(!strcmp(prompt_render(prompt), "user ~ :) $ "));
+	prompt_free(prompt);
+}
@@ -0,0 +1,132 @@
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "error.h"
+#include "redirect.h"
+#include "unit.h"
+
+static int *layout_fd(struct redirect_plan *plan, int target_fd)
+{
+	switch (target_fd) {
+	case STDIN_FILENO:
+		return &plan->layout.input_fd;
+	case STDOUT_FILENO:
+		return &plan->layout.output_fd;
+	case STDERR_FILENO:
+		return &plan->layout.error_fd;
+	}
+	RAISE(ERROR_INVALID_ARGUMENT, "Cannot redirect descriptor %d.",
+	      target_fd);
+}
+
+static void add_opened(struct redirect_plan *plan, int fd)
+{
+	if (plan->opened_count == REDIRECT_MAX_OPENED) {
+		close(fd);
+		RAISE(ERROR_OVERFLOW, "Too many redirections.");
+	}
+	plan->opened[plan->opened_count++] = fd;
+}
+
+void redirect_plan_init(struct redirect_plan *plan, const struct io_fds *fds)
+{
+	plan->layout = *fds;
+	plan->opened_count = 0;
+}
+
+void redirect_plan_open(struct redirect_plan *plan, int target_fd, int dirfd,
+			const char *path, int flags)
+{
+	int *fd = layout_fd(plan, target_fd);
+
+	*fd = checked_openat(dirfd, path, flags | O_CLOEXEC, 0666);
+	add_opened(plan, *fd);
+}
+
+void redirect_plan_use(struct redirect_plan *plan, int target_fd, int fd)
+{
+	*layout_fd(plan, target_fd) = fd;
+}
+
+/*
+ * The standard descriptors are put in place in order, so a source
+ * which is itself a standard descriptor could be overwritten before it
+ * is used (say, output to fd 0 and input from a file). Such sources are
+ * first copied above the standard descriptors.
+ */
+static void move_sources(struct redirect_plan *plan)
+{
+	for (int target = 0; target < 3; target++) {
+		int *fd = layout_fd(plan, target);
+
+		if (*fd > STDERR_FILENO || *fd == target)
+			continue;
+		*fd = fcntl(*fd, F_DUPFD_CLOEXEC, STDERR_FILENO + 1);
+		CHECKP(*fd);
+		add_opened(plan, *fd);
+	}
+}
+
+void redirect_plan_file_actions(struct redirect_plan *plan,
+				posix_spawn_file_actions_t *actions)
+{
+	move_sources(plan);
+	for (int target = 0; target < 3; target++) {
+		int fd = *layout_fd(plan, target);
+
+		if (fd != target)
+			CHECK(!posix_spawn_file_actions_adddup2(actions, fd,
+								target));
+	}
+}
+
+void redirect_plan_apply(struct redirect_plan *plan)
+{
+	move_sources(plan);
+	for (int target = 0; target < 3; target++) {
+		int fd = *layout_fd(plan, target);
+
+		if (fd != target)
+			checked_dup2(fd, target);
+	}
+}
+
+void redirect_plan_close(struct redirect_plan *plan)
+{
+	for (size_t i = 0; i < plan->opened_count; i++)
+		close(plan->opened[i]);
+	plan->opened_count = 0;
+}
+
+DEFTEST("redirect.plan")
+{
+	struct io_fds fds = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+	struct redirect_plan plan;
+	char path[] = "/tmp/redirect_test_XXXXXX";
+	int fd = mkstemp(path);
+
+	ASSERT(fd >= 0);
+	close(fd);
+
+	redirect_plan_init(&plan, &fds);
+	redirect_plan_open(&plan, STDOUT_FILENO, AT_FDCWD, path,
+			   O_WRONLY | O_APPEND);
+	EXPECT(plan.layout.input_fd == STDIN_FILENO);
+	EXPECT(plan.layout.output_fd > STDERR_FILENO);
+	EXPECT(fcntl(plan.layout.output_fd, F_GETFD) & FD_CLOEXEC);
+	EXPECT(plan.opened_count == 1);
+
+	/* Output to stdin would be clobbered by the input redirection */
+	plan.layout.output_fd = STDIN_FILENO;
+	redirect_plan_open(&plan, STDIN_FILENO, AT_FDCWD, path, O_RDONLY);
+	move_sources(&plan);
+	EXPECT(plan.layout.output_fd > STDERR_FILENO);
+	EXPECT(plan.layout.error_fd == STDERR_FILENO);
+	EXPECT(plan.opened_count == 3);
+
+	redirect_plan_close(&plan);
+	EXPECT(fcntl(plan.opened[0], F_GETFD) < 0);
+	unlink(path);
+}
@@ -1,6 +1,12 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "error.h"
+#include "interpreter.h"
 #include "shell_builtins.h"
+#include "string_builder.h"
 
 struct builtin_command_list *builtin_command_list = NULL;
 
@@ -13,3 +19,39 @@ struct builtin_command *builtin_command_get(const char *name)
 	}
 	return NULL;
 }
+
+void builtin_write(struct interpreter_state *state, int fd, const char *buf,
+		   size_t len)
+{
+	if (fd == BUILTIN_CAPTURE_FD) {
+		CHECK(state && state->capture);
+		string_builder_append_cb((char *)buf, len, state->capture);
+		return;
+	}
+	checked_write_all(fd, buf, len);
+}
+
+void builtin_printf(struct interpreter_state *state, int fd,
+		    const char *format, ...)
+{
+	char small[256];
+	char *buf = small;
+	va_list args;
+	int len;
+
+	va_start(args, format);
+	len = vsnprintf(small, sizeof(small), format, args);
+	va_end(args);
+	CHECKP(len);
+
+	if (len >= sizeof(small)) {
+		buf = checked_malloc(sizeof(char), len + 1);
+		va_start(args, format);
+		vsnprintf(buf, len + 1, format, args);
+		va_end(args);
+	}
+
+	builtin_write(state, fd, buf, len);
+	if (buf != small)
+		free(buf);
+}
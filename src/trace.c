@@ -0,0 +1,396 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "error.h"
+#include "trace.h"
+#include "unit.h"
+
+#define TRACE_RING_MASK (TRACE_RING_SIZE - 1)
+_Static_assert((TRACE_RING_SIZE & TRACE_RING_MASK) == 0,
+	       "TRACE_RING_SIZE must be a power of two");
+
+struct trace {
+	char *path;
+	int fd;
+	/* Wakes the flusher early, when the ring is half full */
+	int wake_fd;
+	pthread_t flusher;
+	atomic_bool stop;
+	/* Written only by the shell */
+	_Atomic size_t head;
+	/* Written only by the flusher */
+	_Atomic size_t tail;
+	_Atomic uint64_t dropped;
+	struct trace_record ring[TRACE_RING_SIZE];
+};
+
+/* What a child writes to its probe */
+struct trace_probe_message {
+	uint64_t ns;
+	char name[TRACE_NAME_MAX];
+};
+
+struct trace_launch {
+	pid_t pid;
+	/* -1 for a spawned child, whose exec time and name are known */
+	int probe_fd;
+	uint64_t start_ns;
+	uint64_t exec_ns;
+	char name[TRACE_NAME_MAX];
+};
+
+uint64_t trace_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static size_t format_name(const char *name, char *buf)
+{
+	size_t len = 0;
+
+	for (size_t i = 0; i < TRACE_NAME_MAX && name[i]; i++) {
+		unsigned char c = name[i];
+
+		if (c == '"' || c == '\\')
+			len += sprintf(buf + len, "\\%c", c);
+		else if (c < 0x20)
+			len += sprintf(buf + len, "\\u%04x", c);
+		else
+			buf[len++] = c;
+	}
+	buf[len] = '\0';
+	return len;
+}
+
+int trace_format(const struct trace_record *record, char *buf, size_t len)
+{
+	char name[TRACE_NAME_MAX * 6 + 1];
+
+	format_name(record->name, name);
+	return snprintf(buf, len,
+			"{\"pid\":%d,\"name\":\"%s\",\"status\":%d,"
+			"\"start_ns\":%" PRIu64 ",\"exec_ns\":%" PRIu64
+			",\"wall_ns\":%" PRIu64 ",\"user_us\":%" PRIu64
+			",\"sys_us\":%" PRIu64 ",\"max_rss_kb\":%" PRIu64
+			"}\n",
+			(int)record->pid, name, record->status,
+			record->start_ns, record->exec_ns, record->wall_ns,
+			record->user_us, record->sys_us, record->max_rss_kb);
+}
+
+/*
+ * Write out everything in the ring. This runs on the flusher thread,
+ * so it avoids stdio, whose locks a fork() could copy while held.
+ */
+static void flush(struct trace *trace)
+{
+	size_t head = atomic_load_explicit(&trace->head, memory_order_acquire);
+	size_t tail = atomic_load_explicit(&trace->tail, memory_order_relaxed);
+	char buf[1 << 16];
+	size_t used = 0;
+
+	for (; tail != head; tail++) {
+		const struct trace_record *record =
+			&trace->ring[tail & TRACE_RING_MASK];
+		int len = trace_format(record, buf + used, sizeof(buf) - used);
+
+		if (used + len >= sizeof(buf)) {
+			write(trace->fd, buf, used);
+			used = 0;
+			len = trace_format(record, buf, sizeof(buf));
+		}
+		used += len;
+		/* The slot may be reused once it has been formatted */
+		atomic_store_explicit(&trace->tail, tail + 1,
+				      memory_order_release);
+	}
+	if (used)
+		write(trace->fd, buf, used);
+}
+
+static void *flusher(void *data)
+{
+	struct trace *trace = data;
+	struct pollfd pfd = { .fd = trace->wake_fd, .events = POLLIN };
+	uint64_t wakeups;
+
+	for (;;) {
+		bool stop = atomic_load(&trace->stop);
+
+		flush(trace);
+		if (stop)
+			return NULL;
+		if (poll(&pfd, 1, TRACE_FLUSH_INTERVAL_MS) > 0)
+			read(trace->wake_fd, &wakeups, sizeof(wakeups));
+	}
+}
+
+struct trace *trace_open(const char *path)
+{
+	struct trace *trace = checked_calloc(sizeof(struct trace), 1);
+	int rv;
+
+	trace->fd = checked_open(path, O_WRONLY | O_CREAT | O_APPEND |
+					       O_CLOEXEC,
+				 0666);
+	trace->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (trace->wake_fd < 0) {
+		close(trace->fd);
+		free(trace);
+		RAISE(ERROR_INVALID_ARGUMENT, "eventfd: %s", strerror(errno));
+	}
+	trace->path = checked_strdup(path);
+
+	rv = pthread_create(&trace->flusher, NULL, flusher, trace);
+	if (rv) {
+		close(trace->wake_fd);
+		close(trace->fd);
+		free(trace->path);
+		free(trace);
+		RAISE(ERROR_INVALID_ARGUMENT, "pthread_create: %s",
+		      strerror(rv));
+	}
+	return trace;
+}
+
+static void wake(struct trace *trace)
+{
+	uint64_t one = 1;
+
+	write(trace->wake_fd, &one, sizeof(one));
+}
+
+void trace_close(struct trace *trace)
+{
+	atomic_store(&trace->stop, true);
+	wake(trace);
+	pthread_join(trace->flusher, NULL);
+	checked_close(trace->wake_fd);
+	checked_close(trace->fd);
+	free(trace->path);
+	free(trace);
+}
+
+const char *trace_path(const struct trace *trace)
+{
+	return trace->path;
+}
+
+bool trace_push(struct trace *trace, const struct trace_record *record)
+{
+	size_t head = atomic_load_explicit(&trace->head, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&trace->tail, memory_order_acquire);
+
+	if (head - tail == TRACE_RING_SIZE) {
+		atomic_fetch_add_explicit(&trace->dropped, 1,
+					  memory_order_relaxed);
+		return false;
+	}
+
+	trace->ring[head & TRACE_RING_MASK] = *record;
+	atomic_store_explicit(&trace->head, head + 1, memory_order_release);
+	if (head + 1 - tail == TRACE_RING_SIZE / 2)
+		wake(trace);
+	return true;
+}
+
+uint64_t trace_dropped(struct trace *trace)
+{
+	return atomic_load(&trace->dropped);
+}
+
+static struct trace_launch *new_launch(struct trace_launches *launches)
+{
+	if (launches->count == launches->capacity) {
+		launches->capacity =
+			launches->capacity ? launches->capacity * 2 : 8;
+		launches->launches =
+			checked_realloc(launches->launches,
+					sizeof(struct trace_launch),
+					launches->capacity);
+	}
+	return &launches->launches[launches->count++];
+}
+
+void trace_launch_add(struct trace_launches *launches, pid_t pid,
+		      int probe_fd, uint64_t start_ns)
+{
+	*new_launch(launches) = (struct trace_launch){
+		.pid = pid,
+		.probe_fd = probe_fd,
+		.start_ns = start_ns,
+	};
+}
+
+void trace_launch_spawned(struct trace_launches *launches, pid_t pid,
+			  uint64_t start_ns, const char *name)
+{
+	struct trace_launch *launch = new_launch(launches);
+
+	*launch = (struct trace_launch){
+		.pid = pid,
+		.probe_fd = -1,
+		.start_ns = start_ns,
+		.exec_ns = trace_now() - start_ns,
+	};
+	strncpy(launch->name, name, TRACE_NAME_MAX);
+}
+
+static uint64_t timeval_us(const struct timeval *tv)
+{
+	return (uint64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+bool trace_launch_finish(struct trace_launches *launches, pid_t pid,
+			 int status, const struct rusage *usage,
+			 struct trace_record *record)
+{
+	struct trace_probe_message message = { 0 };
+	struct trace_launch launch;
+	size_t i;
+	ssize_t rv = 0;
+
+	for (i = 0; i < launches->count; i++) {
+		if (launches->launches[i].pid == pid)
+			break;
+	}
+	if (i == launches->count)
+		return false;
+	launch = launches->launches[i];
+	launches->launches[i] = launches->launches[--launches->count];
+
+	if (launch.probe_fd >= 0) {
+		/* The child is gone, so this never blocks */
+		do
+			rv = read(launch.probe_fd, &message, sizeof(message));
+		while (rv < 0 && errno == EINTR);
+		checked_close(launch.probe_fd);
+	}
+
+	memset(record, 0, sizeof(*record));
+	record->pid = pid;
+	record->status = status;
+	record->start_ns = launch.start_ns;
+	record->wall_ns = trace_now() - launch.start_ns;
+	if (launch.probe_fd < 0) {
+		record->exec_ns = launch.exec_ns;
+		memcpy(record->name, launch.name, TRACE_NAME_MAX);
+	} else if (rv == sizeof(message)) {
+		record->exec_ns = message.ns - launch.start_ns;
+		memcpy(record->name, message.name, TRACE_NAME_MAX);
+	}
+	record->user_us = timeval_us(&usage->ru_utime);
+	record->sys_us = timeval_us(&usage->ru_stime);
+	record->max_rss_kb = usage->ru_maxrss;
+	return true;
+}
+
+void trace_launches_free(struct trace_launches *launches)
+{
+	for (size_t i = 0; i < launches->count; i++) {
+		if (launches->launches[i].probe_fd >= 0)
+			close(launches->launches[i].probe_fd);
+	}
+	free(launches->launches);
+	memset(launches, 0, sizeof(*launches));
+}
+
+void trace_probe(int probe_fd, const char *name)
+{
+	struct trace_probe_message message = { 0 };
+
+	strncpy(message.name, name, TRACE_NAME_MAX);
+	message.ns = trace_now();
+	write(probe_fd, &message, sizeof(message));
+}
+
+void trace_totals_add(struct trace_totals *totals,
+		      const struct trace_record *record)
+{
+	totals->user_us += record->user_us;
+	totals->sys_us += record->sys_us;
+	if (record->max_rss_kb > totals->max_rss_kb)
+		totals->max_rss_kb = record->max_rss_kb;
+	if (record->exec_ns > totals->exec_ns)
+		totals->exec_ns = record->exec_ns;
+	totals->children++;
+}
+
+static void report_line(int fd, const char *label, uint64_t us)
+{
+	dprintf(fd, "%s\t%" PRIu64 "m%" PRIu64 ".%03" PRIu64 "s\n", label,
+		us / 60000000, us / 1000000 % 60, us / 1000 % 1000);
+}
+
+void trace_report_time(int fd, const struct trace_totals *totals)
+{
+	dprintf(fd, "\n");
+	report_line(fd, "real", totals->wall_ns / 1000);
+	report_line(fd, "user", totals->user_us);
+	report_line(fd, "sys", totals->sys_us);
+	if (!totals->children)
+		return;
+	dprintf(fd, "exec\t%" PRIu64 ".%06" PRIu64 "s\n",
+		totals->exec_ns / 1000000000, totals->exec_ns / 1000 % 1000000);
+	dprintf(fd, "maxrss\t%" PRIu64 "k\n", totals->max_rss_kb);
+}
+
+DEFTEST("trace.format")
+{
+	struct trace_record record = {
+		.pid = 42,
+		.status = 1,
+		.exec_ns = 1500,
+		.name = "a\"b\n",
+	};
+	char buf[512];
+
+	trace_format(&record, buf, sizeof(buf));
+	EXPECT(!strcmp(buf, "{\"pid\":42,\"name\":\"a\\\"b\\u000a\","
+			    "\"status\":1,\"start_ns\":0,\"exec_ns\":1500,"
+			    "\"wall_ns\":0,\"user_us\":0,\"sys_us\":0,"
+			    "\"max_rss_kb\":0}\n"));
+}
+
+DEFTEST("trace.ring")
+{
+	char path[] = "/tmp/trace_test_XXXXXX";
+	int fd = mkstemp(path);
+	struct trace *trace;
+	size_t pushed = 0;
+	size_t lines = 0;
+	char buf[4096];
+	ssize_t rv;
+
+	ASSERT(fd >= 0);
+	trace = trace_open(path);
+	for (int i = 0; i < 3 * TRACE_RING_SIZE; i++) {
+		struct trace_record record = { .pid = i, .name = "x" };
+
+		pushed += trace_push(trace, &record);
+	}
+	EXPECT(pushed + trace_dropped(trace) == 3 * TRACE_RING_SIZE);
+	trace_close(trace);
+
+	/* Everything which was not dropped was written */
+	while ((rv = read(fd, buf, sizeof(buf))) > 0) {
+		for (ssize_t i = 0; i < rv; i++)
+			lines += buf[i] == '\n';
+	}
+	EXPECT(lines == pushed);
+	close(fd);
+	unlink(path);
+}
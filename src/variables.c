@@ -0,0 +1,272 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "hash.h"
+#include "variables.h"
+
+#define VARIABLE_TABLE_INITIAL_BUCKETS 64
+
+struct variable {
+	/* Stored as "NAME=value" so it can be handed to execve as-is */
+	char *pair;
+	size_t name_len;
+	uint32_t hash;
+	bool exported;
+	/*
+	 * Exported by name before being given a value. Such a variable
+	 * reads as unset and stays out of the environment until set.
+	 */
+	bool unset;
+	struct variable *next;
+};
+
+struct variable_table {
+	struct variable **buckets;
+	size_t bucket_count;
+	size_t count;
+	size_t exported_count;
+
+	/*
+	 * generation is bumped each time an exported variable
+	 * changes. The cached envp is rebuilt only when it was built
+	 * for an older generation.
+	 */
+	unsigned long generation;
+	unsigned long envp_generation;
+	char **envp;
+};
+
+struct variable_table *variable_table_new(void)
+{
+	struct variable_table *table =
+		checked_calloc(sizeof(struct variable_table), 1);
+
+	table->bucket_count = VARIABLE_TABLE_INITIAL_BUCKETS;
+	table->buckets = checked_calloc(sizeof(struct variable *),
+					table->bucket_count);
+
+	/* Force the first call to variable_table_envp to build */
+	table->generation = 1;
+	return table;
+}
+
+void variable_table_free(struct variable_table *table)
+{
+	for (size_t i = 0; i < table->bucket_count; i++) {
+		struct variable *var = table->buckets[i];
+
+		while (var) {
+			struct variable *next = var->next;
+
+			free(var->pair);
+			free(var);
+			var = next;
+		}
+	}
+	free(table->buckets);
+	free(table->envp);
+	free(table);
+}
+
+static struct variable **find_slot(struct variable_table *table,
+				   const char *name, size_t name_len,
+				   uint32_t hash)
+{
+	struct variable **slot =
+		&table->buckets[hash & (table->bucket_count - 1)];
+
+	for (; *slot; slot = &(*slot)->next) {
+		struct variable *var = *slot;
+
+		if (var->hash == hash && var->name_len == name_len &&
+		    !memcmp(var->pair, name, name_len))
+			break;
+	}
+	return slot;
+}
+
+static void grow(struct variable_table *table)
+{
+	size_t new_count = table->bucket_count * 2;
+	struct variable **new_buckets =
+		checked_calloc(sizeof(struct variable *), new_count);
+
+	for (size_t i = 0; i < table->bucket_count; i++) {
+		struct variable *var = table->buckets[i];
+
+		while (var) {
+			struct variable *next = var->next;
+			struct variable **slot =
+				&new_buckets[var->hash & (new_count - 1)];
+
+			var->next = *slot;
+			*slot = var;
+			var = next;
+		}
+	}
+	free(table->buckets);
+	table->buckets = new_buckets;
+	table->bucket_count = new_count;
+}
+
+static char *make_pair(const char *name, size_t name_len, const char *value,
+		       size_t value_len)
+{
+	char *pair = checked_malloc(sizeof(char), name_len + value_len + 2);
+
+	memcpy(pair, name, name_len);
+	pair[name_len] = '=';
+	memcpy(pair + name_len + 1, value, value_len);
+	pair[name_len + value_len + 1] = '\0';
+	return pair;
+}
+
+static struct variable *sized_set(struct variable_table *table,
+				  const char *name, size_t name_len,
+				  const char *value, size_t value_len)
+{
+	uint32_t hash = hash_bytes(name, name_len);
+	struct variable **slot = find_slot(table, name, name_len, hash);
+	struct variable *var = *slot;
+
+	if (var) {
+		free(var->pair);
+		var->pair = make_pair(name, name_len, value, value_len);
+		var->unset = false;
+		if (var->exported)
+			table->generation++;
+		return var;
+	}
+
+	if (table->count >= table->bucket_count) {
+		grow(table);
+		slot = find_slot(table, name, name_len, hash);
+	}
+
+	var = checked_malloc(sizeof(struct variable), 1);
+	var->pair = make_pair(name, name_len, value, value_len);
+	var->name_len = name_len;
+	var->hash = hash;
+	var->exported = false;
+	var->unset = false;
+	var->next = NULL;
+	*slot = var;
+	table->count++;
+	return var;
+}
+
+static void mark_exported(struct variable_table *table, struct variable *var)
+{
+	if (var->exported)
+		return;
+	var->exported = true;
+	table->exported_count++;
+	table->generation++;
+}
+
+void variable_table_import(struct variable_table *table, char *const envp[])
+{
+	for (; *envp; envp++) {
+		const char *eq = strchr(*envp, '=');
+
+		if (!eq || eq == *envp)
+			continue;
+		mark_exported(table, sized_set(table, *envp, eq - *envp, eq + 1,
+					       strlen(eq + 1)));
+	}
+}
+
+const char *variable_sized_get(struct variable_table *table, const char *name,
+			       size_t name_len)
+{
+	struct variable *var =
+		*find_slot(table, name, name_len, hash_bytes(name, name_len));
+
+	if (!var || var->unset)
+		return NULL;
+	return var->pair + var->name_len + 1;
+}
+
+const char *variable_get(struct variable_table *table, const char *name)
+{
+	return variable_sized_get(table, name, strlen(name));
+}
+
+void variable_sized_set(struct variable_table *table, const char *name,
+			size_t name_len, const char *value, size_t value_len)
+{
+	sized_set(table, name, name_len, value, value_len);
+}
+
+void variable_set(struct variable_table *table, const char *name,
+		  const char *value)
+{
+	sized_set(table, name, strlen(name), value, strlen(value));
+}
+
+void variable_export(struct variable_table *table, const char *name)
+{
+	size_t name_len = strlen(name);
+	struct variable *var =
+		*find_slot(table, name, name_len, hash_bytes(name, name_len));
+
+	if (!var) {
+		var = sized_set(table, name, name_len, "", 0);
+		var->unset = true;
+	}
+	mark_exported(table, var);
+}
+
+void variable_unset(struct variable_table *table, const char *name)
+{
+	size_t name_len = strlen(name);
+	struct variable **slot =
+		find_slot(table, name, name_len, hash_bytes(name, name_len));
+	struct variable *var = *slot;
+
+	if (!var)
+		return;
+
+	*slot = var->next;
+	table->count--;
+	if (var->exported) {
+		table->exported_count--;
+		table->generation++;
+	}
+	free(var->pair);
+	free(var);
+}
+
+bool variable_is_exported(struct variable_table *table, const char *name)
+{
+	size_t name_len = strlen(name);
+	struct variable *var =
+		*find_slot(table, name, name_len, hash_bytes(name, name_len));
+
+	return var && var->exported;
+}
+
+char *const *variable_table_envp(struct variable_table *table)
+{
+	size_t i = 0;
+
+	if (table->envp_generation == table->generation)
+		return table->envp;
+
+	table->envp = checked_realloc(table->envp, sizeof(char *),
+				      table->exported_count + 1);
+	for (size_t b = 0; b < table->bucket_count; b++) {
+		for (struct variable *var = table->buckets[b]; var;
+		     var = var->next) {
+			if (var->exported && !var->unset)
+				table->envp[i++] = var->pair;
+		}
+	}
+	table->envp[i] = NULL;
+	table->envp_generation = table->generation;
+	return table->envp;
+}
@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "unit.h"
+#include "variables.h"
+
+static size_t envp_count(char *const *envp)
+{
+	size_t count = 0;
+
+	while (envp[count])
+		count++;
+	return count;
+}
+
+static bool envp_contains(char *const *envp, const char *pair)
+{
+	for (; *envp; envp++) {
+		if (!strcmp(*envp, pair))
+			return true;
+	}
+	return false;
+}
+
+DEFTEST("variables.simple")
+{
+	struct variable_table *vars = variable_table_new();
+	ASSERT_NOT_NULL(vars);
+
+	variable_set(vars, "KITTENS", "cute");
+	EXPECT(!strcmp(variable_get(vars, "KITTENS"), "cute"));
+	EXPECT_NULL(variable_get(vars, "KITTEN"));
+	EXPECT(!strcmp(variable_sized_get(vars, "KITTENS!", 7), "cute"));
+
+	variable_set(vars, "KITTENS", "fluffy");
+	EXPECT(!strcmp(variable_get(vars, "KITTENS"), "fluffy"));
+
+	variable_unset(vars, "KITTENS");
+	EXPECT_NULL(variable_get(vars, "KITTENS"));
+
+	variable_table_free(vars);
+}
+
+DEFTEST("variables.locals_not_exported")
+{
+	struct variable_table *vars = variable_table_new();
+	char *const env[] = { "HOME=/home/me", "PATH=/bin", NULL };
+	ASSERT_NOT_NULL(vars);
+
+	variable_table_import(vars, env);
+	variable_set(vars, "LOCAL", "yes");
+	variable_set(vars, "HOME", "/root");
+
+	char *const *envp = variable_table_envp(vars);
+	EXPECT(envp_count(envp) == 2);
+	EXPECT(envp_contains(envp, "HOME=/root"));
+	EXPECT(envp_contains(envp, "PATH=/bin"));
+	EXPECT(!envp_contains(envp, "LOCAL=yes"));
+
+	variable_export(vars, "LOCAL");
+	envp = variable_table_envp(vars);
+	EXPECT(envp_count(envp) == 3);
+	EXPECT(envp_contains(envp, "LOCAL=yes"));
+
+	variable_table_free(vars);
+}
+
+DEFTEST("variables.export_unset_name")
+{
+	struct variable_table *vars = variable_table_new();
+	ASSERT_NOT_NULL(vars);
+
+	/* Exporting a name with no value must not make it set */
+	variable_export(vars, "LATER");
+	EXPECT(variable_is_exported(vars, "LATER"));
+	EXPECT_NULL(variable_get(vars, "LATER"));
+	EXPECT(envp_count(variable_table_envp(vars)) == 0);
+
+	/* It is in the environment once given a value */
+	variable_set(vars, "LATER", "now");
+	EXPECT(envp_contains(variable_table_envp(vars), "LATER=now"));
+
+	variable_unset(vars, "LATER");
+	EXPECT(!variable_is_exported(vars, "LATER"));
+	EXPECT(envp_count(variable_table_envp(vars)) == 0);
+
+	variable_table_free(vars);
+}
+
+DEFTEST("variables.envp_cached")
+{
+	struct variable_table *vars = variable_table_new();
+	char *const env[] = { "A=1", "B=2", NULL };
+	ASSERT_NOT_NULL(vars);
+
+	variable_table_import(vars, env);
+	char *const *envp = variable_table_envp(vars);
+	char *first = envp[0];
+
+	/* Changing a local must not cause a rebuild */
+	variable_set(vars, "LOCAL", "x");
+	EXPECT(variable_table_envp(vars) == envp);
+	EXPECT(variable_table_envp(vars)[0] == first);
+
+	/* Changing an exported variable must */
+	variable_set(vars, "A", "3");
+	envp = variable_table_envp(vars);
+	EXPECT(envp_contains(envp, "A=3"));
+	EXPECT(!envp_contains(envp, "A=1"));
+
+	variable_unset(vars, "B");
+	envp = variable_table_envp(vars);
+	EXPECT(envp_count(envp) == 1);
+
+	variable_table_free(vars);
+}
+
+DEFTEST("variables.many")
+{
+	struct variable_table *vars = variable_table_new();
+	char name[32];
+	char value[32];
+	ASSERT_NOT_NULL(vars);
+
+	for (int i = 0; i < 1000; i++) {
+		snprintf(name, sizeof(name), "VAR_%d", i);
+		snprintf(value, sizeof(value), "%d", i * 7);
+		variable_set(vars, name, value);
+		if (i % 2)
+			variable_export(vars, name);
+	}
+
+	for (int i = 0; i < 1000; i++) {
+		snprintf(name, sizeof(name), "VAR_%d", i);
+		snprintf(value, sizeof(value), "%d", i * 7);
+		EXPECT(!strcmp(variable_get(vars, name), value));
+		EXPECT(variable_is_exported(vars, name) == !!(i % 2));
+	}
+	EXPECT(envp_count(variable_table_envp(vars)) == 500);
+
+	variable_table_free(vars);
+}
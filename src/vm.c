@@ -0,0 +1,307 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "ast.h"
+#include "error.h"
+#include "parser.h"
+#include "unit.h"
+#include "vm.h"
+
+const char *vm_op_as_string[] = PPLIST_STRINGIFY(VM_OP_PPLIST);
+
+static size_t emit(struct vm_program *program, enum vm_op op, uint32_t arg,
+		   void *ptr)
+{
+	if (program->count == program->capacity) {
+		program->capacity = program->capacity * 2 + 16;
+		program->code = checked_realloc(program->code,
+						sizeof(struct vm_insn),
+						program->capacity);
+	}
+	program->code[program->count] = (struct vm_insn){
+		.op = op,
+		.arg = arg,
+		.ptr = ptr,
+	};
+	return program->count++;
+}
+
+/* Point the jump at insn to the next instruction to be emitted */
+static void patch(struct vm_program *program, size_t insn)
+{
+	if (program->count > UINT32_MAX)
+		RAISE(ERROR_OVERFLOW, "The program is too long.");
+	program->code[insn].arg = program->count;
+}
+
+static char *string_copy(struct vm_program *program, struct ast_string *str)
+{
+	char *copy = arena_malloc(&program->strings, sizeof(char),
+				  str->size + 1);
+
+	memcpy(copy, str->data, str->size);
+	copy[str->size] = '\0';
+	return copy;
+}
+
+/* Build the words of args in the argv register */
+static void compile_words(struct vm_program *program,
+			  struct ast_argument_list *args)
+{
+	emit(program, VM_ARGV, 0, NULL);
+	for (; args; args = args->rest) {
+		if (!args->first->literal) {
+			emit(program, VM_EXPAND, 0, args->first);
+			continue;
+		}
+		emit(program, VM_PUSH, 0,
+		     string_copy(program, args->first->parts->first->string));
+	}
+}
+
+static void compile_argv(struct vm_program *program, struct ast_command *cmd)
+{
+	if (cmd->argv)
+		emit(program, VM_ARGV, 0, cmd->argv);
+	else
+		compile_words(program, cmd->arglist);
+}
+
+static void compile_statement_list(struct vm_program *program,
+				   struct ast_statement_list *list, bool final);
+
+/*
+ * The words of a for loop are expanded once, before it starts. The
+ * body (and the condition of a while loop) is compiled in line, and
+ * each iteration jumps back to the top.
+ */
+static void compile_loop(struct vm_program *program, struct ast_command *cmd)
+{
+	struct ast_loop *loop = cmd->loop;
+	size_t top, done;
+
+	if (loop->kind == LOOP_FOR)
+		compile_words(program, loop->words);
+	emit(program, VM_LOOP_START, 0, cmd);
+	top = program->count;
+
+	if (loop->kind == LOOP_FOR) {
+		done = emit(program, VM_FOR_NEXT, 0,
+			    string_copy(program, loop->variable));
+	} else {
+		compile_statement_list(program, loop->condition, false);
+		done = emit(program,
+			    loop->kind == LOOP_WHILE ? VM_JUMP_IF_FAILURE :
+						       VM_JUMP_IF_SUCCESS,
+			    0, NULL);
+	}
+	compile_statement_list(program, loop->body, false);
+	emit(program, VM_LOOP_NEXT, top, NULL);
+	patch(program, done);
+	emit(program, VM_LOOP_END, 0, NULL);
+}
+
+/*
+ * A lone command in the foreground runs from the shell; anything else
+ * forks a child per command, and each child expands its own words.
+ * When final is set, nothing runs after the pipeline.
+ */
+static void compile_pipeline(struct vm_program *program,
+			     struct ast_and_or *and_or, bool background,
+			     bool final)
+{
+	struct ast_pipeline *pipeline = and_or->pipeline;
+	size_t try = emit(program, VM_TRY, 0, NULL);
+
+	if (and_or->timed)
+		emit(program, VM_TIME_START, 0, NULL);
+	if (!pipeline->rest && !background && pipeline->first->loop) {
+		compile_loop(program, pipeline->first);
+	} else if (!pipeline->rest && !background &&
+		   pipeline->first->function) {
+		emit(program, VM_DEFINE, 0, pipeline->first->function);
+	} else if (!pipeline->rest && !background) {
+		compile_argv(program, pipeline->first);
+		emit(program, final && !and_or->timed ? VM_EXEC : VM_RUN, 0,
+		     pipeline->first);
+	} else {
+		emit(program, VM_PIPELINE, background, pipeline);
+	}
+	if (and_or->timed)
+		emit(program, VM_TIME_STOP, 0, NULL);
+	patch(program, try);
+}
+
+/*
+ * Each pipeline after && is jumped over when the one before failed,
+ * and each after || when it succeeded, so it is not even expanded.
+ */
+static void compile_and_or(struct vm_program *program,
+			   struct ast_and_or *and_or, bool background,
+			   bool final)
+{
+	compile_pipeline(program, and_or, background,
+			 final && !and_or->rest);
+	for (; and_or->rest; and_or = and_or->rest) {
+		size_t jump = emit(program,
+				   and_or->connective == CONNECTIVE_AND ?
+					   VM_JUMP_IF_FAILURE :
+					   VM_JUMP_IF_SUCCESS,
+				   0, NULL);
+
+		emit(program, VM_SET_STATUS, 0, NULL);
+		compile_pipeline(program, and_or->rest, background,
+				 final && !and_or->rest->rest);
+		patch(program, jump);
+	}
+}
+
+static void compile_statement(struct vm_program *program,
+			      struct ast_statement *statement, bool final)
+{
+	size_t start = emit(program, VM_STATEMENT, 0, NULL);
+	size_t job;
+
+	if (statement->background && statement->and_or->rest) {
+		/* The whole list runs in the background, in a subshell */
+		job = emit(program, VM_BACKGROUND, 0, statement->and_or);
+		compile_and_or(program, statement->and_or, false, false);
+		emit(program, VM_EXIT, 0, NULL);
+		patch(program, job);
+	} else {
+		compile_and_or(program, statement->and_or,
+			       statement->background,
+			       final && !statement->background);
+	}
+
+	/* Errors in the statement give it a status of 1 */
+	patch(program, start);
+	emit(program, VM_SET_STATUS, 0, NULL);
+}
+
+static bool has_statements(struct ast_statement_list *list)
+{
+	for (; list; list = list->rest) {
+		if (list->first)
+			return true;
+	}
+	return false;
+}
+
+static void compile_statement_list(struct vm_program *program,
+				   struct ast_statement_list *list, bool final)
+{
+	for (; list; list = list->rest) {
+		if (list->first)
+			compile_statement(program, list->first,
+					  final && !has_statements(list->rest));
+	}
+}
+
+static struct vm_program *compile(struct ast_statement_list *list,
+				  bool final)
+{
+	struct vm_program *program =
+		checked_calloc(sizeof(struct vm_program), 1);
+	struct error error;
+
+	if (GET_ERROR(&error)) {
+		vm_program_free(program);
+		reraise(&error);
+	}
+	compile_statement_list(program, list, final);
+	exit_error_handler(&error);
+	return program;
+}
+
+struct vm_program *vm_compile(struct ast_statement_list *list)
+{
+	return compile(list, false);
+}
+
+struct vm_program *vm_compile_final(struct ast_statement_list *list)
+{
+	return compile(list, true);
+}
+
+struct vm_program *vm_compile_command(struct ast_command *cmd)
+{
+	struct ast_pipeline pipeline = { .first = cmd };
+	struct ast_and_or and_or = { .pipeline = &pipeline };
+	struct ast_statement statement = { .and_or = &and_or };
+	struct ast_statement_list list = { .first = &statement };
+
+	return vm_compile(&list);
+}
+
+void vm_program_free(struct vm_program *program)
+{
+	free(program->code);
+	arena_free(&program->strings);
+	free(program);
+}
+
+DEFTEST("vm.compile")
+{
+	struct ast_statement_list *list =
+		parse_input("a && b $x || c; d | e &");
+	struct vm_program *program = vm_compile(list);
+	const enum vm_op expected[] = {
+		VM_STATEMENT, VM_TRY, VM_ARGV, VM_RUN,
+		VM_JUMP_IF_FAILURE, VM_SET_STATUS,
+		VM_TRY, VM_ARGV, VM_PUSH, VM_EXPAND, VM_RUN,
+		VM_JUMP_IF_SUCCESS, VM_SET_STATUS,
+		VM_TRY, VM_ARGV, VM_RUN,
+		VM_SET_STATUS,
+		VM_STATEMENT, VM_TRY, VM_PIPELINE,
+		VM_SET_STATUS,
+	};
+
+	ASSERT(program->count == ARRAY_SIZE(expected));
+	for (size_t i = 0; i < program->count; i++)
+		EXPECT(program->code[i].op == expected[i]);
+
+	/* b $x is skipped when a fails; c when either succeeded */
+	EXPECT(program->code[4].arg == 11);
+	EXPECT(program->code[11].arg == 16);
+	EXPECT(!strcmp(program->code[8].ptr, "b"));
+	EXPECT(program->code[0].arg == 16 && program->code[17].arg == 20);
+	EXPECT(program->code[19].arg == 1);
+
+	vm_program_free(program);
+	ast_statement_list_free(list);
+}
+
+DEFTEST("vm.compile_final")
+{
+	const struct {
+		const char *input;
+		/* The index of the VM_EXEC, or 0 for none */
+		size_t exec;
+	} cases[] = {
+		{ "a; b", 8 },
+		{ "a; b\n\n", 8 },
+		{ "a && b", 8 },
+		{ "a || b $x", 10 },
+		{ "a; b &", 0 },
+		{ "a | b", 0 },
+		{ "time a", 0 },
+		{ "for i in a; do b; done", 0 },
+	};
+
+	for (size_t i = 0; i < ARRAY_SIZE(cases); i++) {
+		struct ast_statement_list *list = parse_input(cases[i].input);
+		struct vm_program *program = vm_compile_final(list);
+		size_t exec = 0;
+
+		for (size_t j = 0; j < program->count; j++) {
+			if (program->code[j].op == VM_EXEC)
+				exec = exec ? SIZE_MAX : j;
+		}
+		EXPECT(exec == cases[i].exec);
+		vm_program_free(program);
+		ast_statement_list_free(list);
+	}
+}